@@ -0,0 +1,78 @@
+'''Compares the number of block reads per equality lookup of an unsorted id
+field with a hash index and with a B+-tree, and of a sorted id field with
+binary search, against a scan of the table.
+
+usage: python3 benchmark_index.py [num_records] [num_lookups] [columnar]
+
+The one-time reads, such as reading the catalog and the zone map, are left
+out by subtracting the reads of a session with a single lookup.
+'''
+from os import makedirs, path
+from random import sample, seed, shuffle
+from re import search
+from shutil import rmtree
+from subprocess import PIPE, run
+from sys import argv
+
+DB_DIR = './tests/bench_index'
+# (name, field, search method, index file)
+LOOKUPS = [('binary search', 's', 'auto', None),
+           ('hash index', 'h', 'auto', 'T.h.hash'),
+           ('B+-tree', 'b', 'auto', 'T.b.bt'),
+           ('scan', 'h', 'linear', None)]
+
+def front(method:str, cmds:list[str]) -> tuple[str, str]:
+  '''returns the output of the commands and the info of show pager'''
+  res = run(['./run_front', '-n', f'-s{method}', '-d', DB_DIR],
+            input='\n'.join(cmds + ['show pager', 'quit', '']),
+            stdout=PIPE, stderr=PIPE, text=True)
+  at = res.stdout.rindex('Memory of fence keys')
+  return res.stdout[:at], res.stdout[at:]
+
+def reads(info:str) -> int:
+  return int(search(r'seeks/reads/writes/IOs: \d+/(\d+)/', info).group(1))
+
+def num_blocks(fname:str) -> int:
+  return path.getsize(path.join(DB_DIR, fname)) // 512
+
+def load(ids:list[int], columnar:bool):
+  '''s is the position of the record, h and b are the same unsorted ids'''
+  rmtree(DB_DIR, ignore_errors=True)
+  makedirs(DB_DIR)
+  cmds = ['create table T (s int, h int, b int, name str[20]){};'
+          .format(' columnar' if columnar else '')]
+  cmds += [f'insert into T values ( {i}, {k}, {k}, n{i} );'
+           for i, k in enumerate(ids)]
+  cmds += ['create index on T ( h ) using hash;',
+           'create index on T ( b ) using btree;']
+  front('auto', cmds)
+
+def main():
+  num_records = int(argv[1]) if len(argv) > 1 else 5000
+  num_lookups = int(argv[2]) if len(argv) > 2 else 100
+  columnar = len(argv) > 3 and argv[3] == 'columnar'
+  seed(2700)
+
+  ids = list(range(num_records))
+  shuffle(ids)
+  load(ids, columnar)
+  keys = sample(ids, num_lookups)
+
+  print(f'{num_records} records, {num_lookups} lookups of "field = key"'
+        + (', columnar' if columnar else ''))
+  print('{:<16}{:>14}{:>16}'.format('access', 'reads/lookup', 'index blocks'))
+  results = {}
+  for name, field, method, fname in LOOKUPS:
+    lookups = [f'select * from T where {field} = {k};' for k in keys]
+    _, first = front(method, lookups[:1])
+    out, info = front(method, lookups[:1] + lookups)
+    if results.setdefault(field, out) != out:
+      print(f'results of the {name} differ from those of the others')
+      exit(1)
+    print('{:<16}{:>14.2f}{:>16}'
+          .format(name, (reads(info) - reads(first)) / num_lookups,
+                  num_blocks(fname) if fname else '-'))
+  rmtree(DB_DIR, ignore_errors=True)
+
+if __name__ == '__main__':
+  main()
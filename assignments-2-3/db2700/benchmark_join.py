@@ -0,0 +1,78 @@
+'''Compares the number of block reads of a natural join of two tables by the
+nested loop, which scans the right table anew for every left record as
+table_natural_join() does, with the block nested loop, which scans it once
+for every chunk of left records, with the index nested loop, which looks up
+the right records of every left record with the B+-tree of the right table,
+and with the hash join.
+
+usage: python3 benchmark_join.py [num_left] [num_right] [columnar]
+
+The reads of the catalog are left out by subtracting the reads of a session
+that only counts the records of both tables.
+'''
+from os import makedirs
+from random import randrange, seed
+from re import search
+from shutil import rmtree
+from subprocess import PIPE, run
+from sys import argv
+
+DB_DIR = './tests/bench_join'
+# (name, join method)
+METHODS = [('nested loop', 'nested'),
+           ('block nested', 'block'),
+           ('index nested', 'index'),
+           ('hash join', 'hash')]
+
+def front(method:str, cmds:list[str]) -> tuple[str, str]:
+  '''returns the output of the commands and the info of show pager'''
+  res = run(['./run_front', '-n', f'-j{method}', '-d', DB_DIR],
+            input='\n'.join(cmds + ['show pager', 'quit', '']),
+            stdout=PIPE, stderr=PIPE, text=True)
+  at = res.stdout.rindex('Memory of fence keys')
+  return res.stdout[:at], res.stdout[at:]
+
+def reads(info:str) -> int:
+  return int(search(r'seeks/reads/writes/IOs: \d+/(\d+)/', info).group(1))
+
+def load(num_left:int, num_right:int, columnar:bool):
+  '''the shared field k takes about one value for every 4 records of the
+  larger table'''
+  rmtree(DB_DIR, ignore_errors=True)
+  makedirs(DB_DIR)
+  layout = ' columnar' if columnar else ''
+  num_keys = max(1, max(num_left, num_right) // 4)
+  cmds = [f'create table L (a int, k int, s str[12]){layout};',
+          f'create table R (b int, k int, t str[12]){layout};']
+  cmds += [f'insert into L values ( {i}, {randrange(num_keys)}, l{i} );'
+           for i in range(num_left)]
+  cmds += [f'insert into R values ( {i}, {randrange(num_keys)}, r{i} );'
+           for i in range(num_right)]
+  cmds += ['create index on R ( k ) using btree;']
+  front('auto', cmds)
+
+def main():
+  num_left = int(argv[1]) if len(argv) > 1 else 2000
+  num_right = int(argv[2]) if len(argv) > 2 else 1000
+  columnar = len(argv) > 3 and argv[3] == 'columnar'
+  seed(2700)
+  load(num_left, num_right, columnar)
+
+  print(f'{num_left} x {num_right} records'
+        + (', columnar' if columnar else ''))
+  print('{:<16}{:>10}{:>12}'.format('join', 'reads', 'records'))
+  counts = ['select count(*) from L;', 'select count(*) from R;']
+  _, base = front('auto', counts)
+  result = None
+  for name, method in METHODS:
+    out, info = front(method, counts + ['select count(*) from L natural join R;'])
+    num = int(out.split()[-1])
+    if result not in (None, num):
+      print(f'the {name} joins {num} records, the others {result}')
+      exit(1)
+    result = num
+    print('{:<16}{:>10}{:>12}'.format(name, reads(info) - reads(base), num))
+  rmtree(DB_DIR, ignore_errors=True)
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,93 @@
+'''Compares the number of block reads per lookup of the search methods
+(run_front -s) on a sorted int field, for keys of different distributions.
+
+usage: python3 benchmark_search.py [num_records] [num_lookups] [columnar]
+
+The one-time reads, such as reading the catalog and the zone map, are left
+out by subtracting the reads of a session with a single lookup.
+'''
+from os import makedirs
+from random import randint, sample, seed
+from re import search
+from shutil import rmtree
+from subprocess import PIPE, run
+from sys import argv
+
+METHODS = ['auto', 'interpolation', 'learned', 'linear']
+DB_DIR = './tests/bench_search'
+
+def uniform(n:int) -> list[int]:
+  return [3 * i for i in range(n)]
+
+def gaps(n:int) -> list[int]:
+  keys, k = [], 0
+  for _ in range(n):
+    k += randint(1, 10)
+    keys.append(k)
+  return keys
+
+def skewed(n:int) -> list[int]:
+  return [i * i // 7 for i in range(n)]
+
+def clustered(n:int) -> list[int]:
+  return [(i // 100) * 100000 + i % 100 for i in range(n)]
+
+DISTRIBUTIONS = {'uniform': uniform, 'gaps': gaps, 'skewed': skewed,
+                 'clustered': clustered}
+
+def front(method:str, cmds:list[str]) -> tuple[str, str]:
+  '''returns the output of the commands and the info of show pager'''
+  res = run(['./run_front', '-n', f'-s{method}', '-d', DB_DIR],
+            input='\n'.join(cmds + ['show pager', 'quit', '']),
+            stdout=PIPE, stderr=PIPE, text=True)
+  at = res.stdout.rindex('Memory of fence keys')
+  return res.stdout[:at], res.stdout[at:]
+
+def reads(info:str) -> int:
+  return int(search(r'seeks/reads/writes/IOs: \d+/(\d+)/', info).group(1))
+
+def memory(info:str) -> int:
+  return sum(int(m) for m in
+             [search(r'fence keys: (\d+)', info).group(1),
+              search(r'learned indexes: (\d+)', info).group(1)])
+
+def load(keys:list[int], columnar:bool):
+  rmtree(DB_DIR, ignore_errors=True)
+  makedirs(DB_DIR)
+  cmds = ['create table T (k int, name str[20], v int){};'
+          .format(' columnar' if columnar else '')]
+  cmds += [f'insert into T values ( {k}, n{i}, {i % 7} );'
+           for i, k in enumerate(keys)]
+  front('auto', cmds)
+
+def main():
+  num_records = int(argv[1]) if len(argv) > 1 else 5000
+  num_lookups = int(argv[2]) if len(argv) > 2 else 100
+  columnar = len(argv) > 3 and argv[3] == 'columnar'
+  seed(2700)
+
+  print(f'{num_records} records, {num_lookups} lookups of "k = key"'
+        + (', columnar' if columnar else ''))
+  print('{:<12}{:<16}{:>14}{:>16}'
+        .format('keys', 'method', 'reads/lookup', 'memory (bytes)'))
+  for name, dist in DISTRIBUTIONS.items():
+    keys = dist(num_records)
+    load(keys, columnar)
+    lookups = [f'select * from T where k = {k};'
+               for k in sample(keys, num_lookups)]
+    results = None
+    for method in METHODS:
+      _, first = front(method, lookups[:1])
+      out, info = front(method, lookups[:1] + lookups)
+      if results is None:
+        results = out
+      elif out != results:
+        print(f'{name}: results of {method} differ from those of {METHODS[0]}')
+        exit(1)
+      print('{:<12}{:<16}{:>14.2f}{:>16}'
+            .format(name, method, (reads(info) - reads(first)) / num_lookups,
+                    memory(info)))
+  rmtree(DB_DIR, ignore_errors=True)
+
+if __name__ == '__main__':
+  main()
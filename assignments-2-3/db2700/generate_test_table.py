@@ -394,8 +394,8 @@ total = 0
 successes = 0
 
 def run_and_compare(query:str):
-  bres = run(['./run_front', '-n', '-by'], text=True, input=query, stderr=PIPE).stderr
-  lres = run(['./run_front', '-n', ], text=True, input=query, stderr=PIPE).stderr
+  bres = run(['./run_front', '-n', '-sauto'], text=True, input=query, stderr=PIPE).stderr
+  lres = run(['./run_front', '-n', '-slinear'], text=True, input=query, stderr=PIPE).stderr
   global total
   global successes
   total+=1
@@ -406,7 +406,7 @@ def run_and_compare(query:str):
     if not SUPPRESS: print('\tfailed')
     if not SUPPRESS: print('expected:', lres, sep='\n')
     if not SUPPRESS: print('got:', bres, sep='\n')
-    if DEBUG: run(['gdb', '--args', 'run_front', '-n', '-by'], text=True, stderr=PIPE)
+    if DEBUG: run(['gdb', '--args', 'run_front', '-n', '-sauto'], text=True, stderr=PIPE)
 
 def run_queries():
   for test, q in tests.items():
@@ -427,8 +427,8 @@ def run_benchmark():
   with open(BFNAME, 'w+') as bout:
     with open(LFNAME, 'w+') as lout:
       try:
-        bout.write(run(['./run_front', '-n', '-by', '-c{}'.format(QFNAME)], text=True, stderr=PIPE, ).stderr)
-        lout.write(run(['./run_front', '-n', '-c{}'.format(QFNAME)], text=True, stderr=PIPE, ).stderr)
+        bout.write(run(['./run_front', '-n', '-sauto', '-c{}'.format(QFNAME)], text=True, stderr=PIPE, ).stderr)
+        lout.write(run(['./run_front', '-n', '-slinear', '-c{}'.format(QFNAME)], text=True, stderr=PIPE, ).stderr)
       except UnicodeDecodeError:
         print('error decoding')
         if CLEANUP: cleanup()
@@ -466,8 +466,8 @@ def gen_simple_query(s:Schema):
 def run_simple_query(val):
   print('== Simple query')
   print('Searching for value: {}'.format(val))
-  bres = run(['./run_front', '-n', '-by'], text=True, input=simple_query, stderr=PIPE).stderr
-  lres = run(['./run_front', '-n'], text=True, input=simple_query, stderr=PIPE).stderr
+  bres = run(['./run_front', '-n', '-sauto'], text=True, input=simple_query, stderr=PIPE).stderr
+  lres = run(['./run_front', '-n', '-slinear'], text=True, input=simple_query, stderr=PIPE).stderr
   if (lres == bres):
     print('\tpassed')
   else:
@@ -488,8 +488,8 @@ def run_simple_benchmark():
   with open(BFNAME, 'w+') as bout:
     with open(LFNAME, 'w+') as lout:
       try:
-        bout.write(run(['./run_front', '-n', '-by'], text=True, input=simple_query, stderr=PIPE, ).stderr)
-        lout.write(run(['./run_front', '-n'], text=True, input=simple_query, stderr=PIPE, ).stderr)
+        bout.write(run(['./run_front', '-n', '-sauto'], text=True, input=simple_query, stderr=PIPE, ).stderr)
+        lout.write(run(['./run_front', '-n', '-slinear'], text=True, input=simple_query, stderr=PIPE, ).stderr)
       except UnicodeDecodeError:
         print('error decoding')
         if CLEANUP: cleanup()
@@ -675,7 +675,7 @@ if __name__ == '__main__':
       exit(0)
     else:
       exit(1)
-    #res = run(['./run_front', '-n', '-by',], text=True, input='help', stdout=PIPE)
+    #res = run(['./run_front', '-n', '-sauto',], text=True, input='help', stdout=PIPE)
     #print_tests()
     #print(res.stdout)
   finally:
@@ -0,0 +1,469 @@
+/************************************************************
+ * Bitmaps for db2700 in the Databases course INF-2700      *
+ * UIT - The Arctic University of Norway                    *
+ ************************************************************/
+
+#include "bitmap.h"
+#include "pmsg.h"
+#include <string.h>
+
+/* The file of a bitmap index is a sequence of ints that goes on from one
+   block to the next: whether the index was saved after its last change,
+   the number of values, then for every value the value, the number of runs
+   and the runs. The file of Bloom filters likewise holds whether it was
+   saved, the number of words of a filter, of hashes and of blocks, then
+   the words of the filters. */
+#define BMI_SAVED 1
+
+/* with the best number of hashes, every bit per value takes the false
+   positive rate of a Bloom filter down by this factor */
+#define BF_RATE_PER_BIT 0.6185
+#define BF_MAX_BITS_PER_KEY 32
+#define BF_WORD_BITS 32
+
+void bm_init(rl_bitmap *b) {
+  b->num_runs = b->max_runs = 0;
+  b->runs = 0;
+}
+
+void bm_release(rl_bitmap *b) {
+  free(b->runs);
+  bm_init(b);
+}
+
+/** @b run_idx
+ *
+ * returns the index of the last run starting at or before pos,
+ * -1 if there is none
+ */
+static int run_idx(rl_bitmap const* b, int pos) {
+  int low = -1, high = b->num_runs, mid;
+  /* positions are mostly added at the end */
+  if (b->num_runs > 0 && b->runs[2 * (b->num_runs - 1)] <= pos)
+    return b->num_runs - 1;
+  while (high - low > 1) {
+    mid = (low + high) / 2;
+    if (b->runs[2 * mid] <= pos)
+      low = mid;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static void insert_run(rl_bitmap *b, int i, int start, int len) {
+  if (b->num_runs == b->max_runs) {
+    b->max_runs = b->max_runs ? 2 * b->max_runs : 4;
+    b->runs = realloc(b->runs, 2 * b->max_runs * sizeof (int));
+  }
+  memmove(b->runs + 2 * (i + 1), b->runs + 2 * i,
+          2 * (b->num_runs - i) * sizeof (int));
+  b->runs[2 * i] = start;
+  b->runs[2 * i + 1] = len;
+  b->num_runs++;
+}
+
+static void remove_run(rl_bitmap *b, int i) {
+  memmove(b->runs + 2 * i, b->runs + 2 * (i + 1),
+          2 * (b->num_runs - i - 1) * sizeof (int));
+  b->num_runs--;
+}
+
+/** @b add_run
+ *
+ * adds the run to the end of b, joining it with the last run of b
+ * if there is no gap between them
+ */
+static void add_run(rl_bitmap *b, int start, int len) {
+  int *last = b->num_runs ? b->runs + 2 * (b->num_runs - 1) : 0;
+  if (last && last[0] + last[1] >= start) {
+    if (start + len > last[0] + last[1])
+      last[1] = start + len - last[0];
+  } else
+    insert_run(b, b->num_runs, start, len);
+}
+
+void bm_set(rl_bitmap *b, int pos) {
+  int i = run_idx(b, pos);
+  int *run = i >= 0 ? b->runs + 2 * i : 0;
+  if (run && pos < run[0] + run[1])
+    return;
+  int joins_prev = run && run[0] + run[1] == pos;
+  int joins_next = i + 1 < b->num_runs && b->runs[2 * (i + 1)] == pos + 1;
+  if (joins_prev && joins_next) {
+    run[1] += 1 + b->runs[2 * (i + 1) + 1];
+    remove_run(b, i + 1);
+  } else if (joins_prev)
+    run[1]++;
+  else if (joins_next) {
+    b->runs[2 * (i + 1)]--;
+    b->runs[2 * (i + 1) + 1]++;
+  } else
+    insert_run(b, i + 1, pos, 1);
+}
+
+void bm_clear(rl_bitmap *b, int pos) {
+  int i = run_idx(b, pos);
+  if (i < 0)
+    return;
+  int start = b->runs[2 * i], end = start + b->runs[2 * i + 1];
+  if (pos >= end)
+    return;
+  if (end - start == 1)
+    remove_run(b, i);
+  else if (pos == start) {
+    b->runs[2 * i]++;
+    b->runs[2 * i + 1]--;
+  } else if (pos == end - 1)
+    b->runs[2 * i + 1]--;
+  else {
+    b->runs[2 * i + 1] = pos - start;
+    insert_run(b, i + 1, pos + 1, end - pos - 1);
+  }
+}
+
+int bm_count(rl_bitmap const* b) {
+  int n = 0;
+  for (int i = 0; i < b->num_runs; i++)
+    n += b->runs[2 * i + 1];
+  return n;
+}
+
+void bm_and(rl_bitmap *res, rl_bitmap const* a, rl_bitmap const* b) {
+  bm_init(res);
+  for (int i = 0, k = 0; i < a->num_runs && k < b->num_runs; ) {
+    int const *x = a->runs + 2 * i, *y = b->runs + 2 * k;
+    int start = x[0] > y[0] ? x[0] : y[0];
+    int x_end = x[0] + x[1], y_end = y[0] + y[1];
+    int end = x_end < y_end ? x_end : y_end;
+    if (start < end)
+      add_run(res, start, end - start);
+    /* the run that ends first has no more in common with the others */
+    if (x_end <= y_end) i++;
+    if (y_end <= x_end) k++;
+  }
+}
+
+void bm_or(rl_bitmap *res, rl_bitmap const* a, rl_bitmap const* b) {
+  bm_init(res);
+  int i = 0, k = 0;
+  while (i < a->num_runs || k < b->num_runs) {
+    int const *r;
+    if (k == b->num_runs
+        || (i < a->num_runs && a->runs[2 * i] <= b->runs[2 * k]))
+      r = a->runs + 2 * i++;
+    else
+      r = b->runs + 2 * k++;
+    add_run(res, r[0], r[1]);
+  }
+}
+
+/** @brief A sequence of ints in the blocks of a file */
+typedef struct int_stream_struct {
+  char const* fname; /**< file of the ints */
+  page_p pg;         /**< page of the current block, NULL before the first */
+  int blk;           /**< the current block */
+  int pos;           /**< position of the next int in the current block */
+} int_stream;
+
+static void open_stream(int_stream *st, char const* fname) {
+  st->fname = fname;
+  st->pg = 0;
+  st->blk = -1;
+  st->pos = BLOCK_SIZE;
+}
+
+static void close_stream(int_stream *st) {
+  if (st->pg)
+    unpin(st->pg);
+  st->pg = 0;
+}
+
+/** @b stream_next_block
+ *
+ * moves on to the next block of the stream if the current one is full.
+ * Returns 0 if the stream is at the end of its file and may not grow.
+ */
+static int stream_next_block(int_stream *st, int grow) {
+  if (st->pos + INT_SIZE <= BLOCK_SIZE)
+    return 1;
+  close_stream(st);
+  if (!grow && st->blk + 1 >= file_num_blocks(st->fname))
+    return 0;
+  st->pg = get_page(st->fname, ++st->blk);
+  if (!st->pg)
+    return 0;
+  st->pos = PAGE_HEADER_SIZE;
+  if (grow)
+    page_set_free_pos(st->pg, st->pos);
+  return 1;
+}
+
+static int stream_put(int_stream *st, int val) {
+  if (!stream_next_block(st, 1))
+    return 0;
+  page_put_int_at(st->pg, st->pos, val);
+  st->pos += INT_SIZE;
+  return 1;
+}
+
+static int stream_get(int_stream *st, int *val) {
+  if (!stream_next_block(st, 0) || !page_valid_pos_for_get(st->pg, st->pos))
+    return 0;
+  *val = page_get_int_at(st->pg, st->pos);
+  st->pos += INT_SIZE;
+  return 1;
+}
+
+static void put_saved_flag(char const* fname, int saved) {
+  page_p pg = get_page(fname, 0);
+  if (!pg) return;
+  page_put_int_at(pg, PAGE_HEADER_SIZE, saved);
+  unpin(pg);
+}
+
+bm_index *bmi_new(void) {
+  bm_index *bi = malloc(sizeof (bm_index));
+  bi->num_vals = bi->max_vals = 0;
+  bi->vals = 0;
+  bi->maps = 0;
+  bi->changed = 1; /* not saved yet */
+  return bi;
+}
+
+bm_index *bmi_load(char const* fname) {
+  int_stream st;
+  int saved, num_vals, val, num_runs, run[2];
+  open_stream(&st, fname);
+  int ok = stream_get(&st, &saved) && saved == BMI_SAVED
+    && stream_get(&st, &num_vals);
+  bm_index *bi = bmi_new();
+  bi->changed = 0;
+  for (int i = 0; ok && i < num_vals; i++) {
+    ok = stream_get(&st, &val) && stream_get(&st, &num_runs);
+    rl_bitmap *b = ok ? bmi_bitmap(bi, val, 1) : 0;
+    for (int k = 0; ok && k < num_runs; k++) {
+      ok = stream_get(&st, run) && stream_get(&st, run + 1);
+      if (ok)
+        add_run(b, run[0], run[1]);
+    }
+  }
+  close_stream(&st);
+  if (!ok) {
+    bmi_release(bi);
+    return 0;
+  }
+  return bi;
+}
+
+void bmi_save(bm_index *bi, char const* fname) {
+  if (!bi->changed)
+    return;
+  int_stream st;
+  int ok = 1;
+  open_stream(&st, fname);
+  /* saved only when all is written */
+  ok &= stream_put(&st, !BMI_SAVED);
+  ok &= stream_put(&st, bi->num_vals);
+  for (int i = 0; i < bi->num_vals; i++) {
+    rl_bitmap *b = bi->maps + i;
+    ok &= stream_put(&st, bi->vals[i]);
+    ok &= stream_put(&st, b->num_runs);
+    for (int k = 0; k < 2 * b->num_runs; k++)
+      ok &= stream_put(&st, b->runs[k]);
+  }
+  close_stream(&st);
+  if (!ok) {
+    put_msg(ERROR, "Failed to save the bitmap index \"%s\".\n", fname);
+    return;
+  }
+  put_saved_flag(fname, BMI_SAVED);
+  bi->changed = 0;
+}
+
+void bmi_changed(bm_index *bi, char const* fname) {
+  if (bi->changed)
+    return;
+  bi->changed = 1;
+  if (file_num_blocks(fname) > 0)
+    put_saved_flag(fname, !BMI_SAVED);
+}
+
+void bmi_release(bm_index *bi) {
+  if (!bi) return;
+  for (int i = 0; i < bi->num_vals; i++)
+    bm_release(bi->maps + i);
+  free(bi->vals);
+  free(bi->maps);
+  free(bi);
+}
+
+rl_bitmap *bmi_bitmap(bm_index *bi, int val, int add) {
+  int low = 0, high = bi->num_vals, mid;
+  while (low < high) {
+    mid = (low + high) / 2;
+    if (bi->vals[mid] < val)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (low < bi->num_vals && bi->vals[low] == val)
+    return bi->maps + low;
+  if (!add)
+    return 0;
+  if (bi->num_vals == bi->max_vals) {
+    bi->max_vals = bi->max_vals ? 2 * bi->max_vals : 8;
+    bi->vals = realloc(bi->vals, bi->max_vals * sizeof (int));
+    bi->maps = realloc(bi->maps, bi->max_vals * sizeof (rl_bitmap));
+  }
+  memmove(bi->vals + low + 1, bi->vals + low,
+          (bi->num_vals - low) * sizeof (int));
+  memmove(bi->maps + low + 1, bi->maps + low,
+          (bi->num_vals - low) * sizeof (rl_bitmap));
+  bi->vals[low] = val;
+  bm_init(bi->maps + low);
+  bi->num_vals++;
+  return bi->maps + low;
+}
+
+long bmi_mem(bm_index const* bi) {
+  long n = sizeof (bm_index)
+    + bi->max_vals * (sizeof (int) + sizeof (rl_bitmap));
+  for (int i = 0; i < bi->num_vals; i++)
+    n += 2 * bi->maps[i].max_runs * sizeof (int);
+  return n;
+}
+
+bloom_filters *bf_new(double fpr, int keys_per_block) {
+  int bits_per_key = 1;
+  for (double p = BF_RATE_PER_BIT;
+       p > fpr && bits_per_key < BF_MAX_BITS_PER_KEY; p *= BF_RATE_PER_BIT)
+    bits_per_key++;
+  if (keys_per_block < 1)
+    keys_per_block = 1;
+  bloom_filters *bf = malloc(sizeof (bloom_filters));
+  bf->num_words = (bits_per_key * keys_per_block + BF_WORD_BITS - 1) / BF_WORD_BITS;
+  /* ln 2 bits per hash */
+  bf->num_hashes = (int) (bits_per_key * 0.693 + 0.5);
+  if (bf->num_hashes < 1)
+    bf->num_hashes = 1;
+  bf->num_blocks = bf->max_blocks = 0;
+  bf->words = 0;
+  bf->changed = 1; /* not saved yet */
+  return bf;
+}
+
+bloom_filters *bf_load(char const* fname) {
+  int_stream st;
+  int saved, vals[3], word;
+  open_stream(&st, fname);
+  int ok = stream_get(&st, &saved) && saved == BMI_SAVED;
+  for (int i = 0; ok && i < 3; i++)
+    ok = stream_get(&st, vals + i);
+  ok = ok && vals[0] > 0 && vals[1] > 0 && vals[2] >= 0;
+  bloom_filters *bf = 0;
+  if (ok) {
+    bf = malloc(sizeof (bloom_filters));
+    bf->num_words = vals[0];
+    bf->num_hashes = vals[1];
+    bf->num_blocks = bf->max_blocks = vals[2];
+    bf->words = malloc((long) bf->num_blocks * bf->num_words * sizeof (unsigned));
+    bf->changed = 0;
+    for (long i = 0; ok && i < (long) bf->num_blocks * bf->num_words; i++) {
+      ok = stream_get(&st, &word);
+      bf->words[i] = word;
+    }
+  }
+  close_stream(&st);
+  if (!ok) {
+    bf_release(bf);
+    return 0;
+  }
+  return bf;
+}
+
+void bf_save(bloom_filters *bf, char const* fname) {
+  if (!bf->changed)
+    return;
+  int_stream st;
+  int ok = 1;
+  open_stream(&st, fname);
+  /* saved only when all is written */
+  ok &= stream_put(&st, !BMI_SAVED);
+  ok &= stream_put(&st, bf->num_words);
+  ok &= stream_put(&st, bf->num_hashes);
+  ok &= stream_put(&st, bf->num_blocks);
+  for (long i = 0; i < (long) bf->num_blocks * bf->num_words; i++)
+    ok &= stream_put(&st, bf->words[i]);
+  close_stream(&st);
+  if (!ok) {
+    put_msg(ERROR, "Failed to save the Bloom filters \"%s\".\n", fname);
+    return;
+  }
+  put_saved_flag(fname, BMI_SAVED);
+  bf->changed = 0;
+}
+
+void bf_changed(bloom_filters *bf, char const* fname) {
+  if (bf->changed)
+    return;
+  bf->changed = 1;
+  if (file_num_blocks(fname) > 0)
+    put_saved_flag(fname, !BMI_SAVED);
+}
+
+void bf_release(bloom_filters *bf) {
+  if (!bf) return;
+  free(bf->words);
+  free(bf);
+}
+
+/** @b bf_hashes
+ * 
+ * gives the two hashes of val that the bits of val are chosen by,
+ * the second one odd so that it steps through all bits of a filter
+ */
+static void bf_hashes(int val, unsigned *h1, unsigned *h2) {
+  unsigned long long h = (unsigned) val * 0x9e3779b97f4a7c15ull;
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9ull;
+  h ^= h >> 32;
+  *h1 = (unsigned) h;
+  *h2 = (unsigned) (h >> 32) | 1;
+}
+
+void bf_add(bloom_filters *bf, int blk, int val) {
+  if (blk >= bf->max_blocks) {
+    int n = bf->max_blocks ? 2 * bf->max_blocks : 8;
+    while (n <= blk)
+      n *= 2;
+    bf->words = realloc(bf->words, (long) n * bf->num_words * sizeof (unsigned));
+    bf->max_blocks = n;
+  }
+  if (blk >= bf->num_blocks) {
+    memset(bf->words + (long) bf->num_blocks * bf->num_words, 0,
+           (long) (blk + 1 - bf->num_blocks) * bf->num_words * sizeof (unsigned));
+    bf->num_blocks = blk + 1;
+  }
+  unsigned *filter = bf->words + (long) blk * bf->num_words;
+  unsigned num_bits = bf->num_words * BF_WORD_BITS, h1, h2;
+  bf_hashes(val, &h1, &h2);
+  for (int i = 0; i < bf->num_hashes; i++, h1 += h2)
+    filter[h1 % num_bits / BF_WORD_BITS] |= 1u << (h1 % num_bits % BF_WORD_BITS);
+}
+
+int bf_may_contain(bloom_filters const* bf, int blk, int val) {
+  if (blk >= bf->num_blocks)
+    return 1;
+  unsigned const *filter = bf->words + (long) blk * bf->num_words;
+  unsigned num_bits = bf->num_words * BF_WORD_BITS, h1, h2;
+  bf_hashes(val, &h1, &h2);
+  for (int i = 0; i < bf->num_hashes; i++, h1 += h2)
+    if (!(filter[h1 % num_bits / BF_WORD_BITS] & 1u << (h1 % num_bits % BF_WORD_BITS)))
+      return 0;
+  return 1;
+}
+
+long bf_mem(bloom_filters const* bf) {
+  return sizeof (bloom_filters) + (long) bf->max_blocks * bf->num_words * sizeof (unsigned);
+}
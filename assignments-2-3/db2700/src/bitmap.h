@@ -0,0 +1,113 @@
+/** @file bitmap.h
+ * @brief Run-length compressed bitmaps, and bitmap indexes made of them.
+ *
+ * A @ref rl_bitmap "bitmap" is a set of positions, kept as the runs of
+ * consecutive positions it holds. The records of a table mostly come one
+ * after another, so the positions of records with the same value of a field
+ * with few distinct values form long runs.
+ *
+ * Set and clear positions with @ref bm_set "bm_set()" and
+ * @ref bm_clear "bm_clear()", and combine bitmaps with
+ * @ref bm_and "bm_and()" and @ref bm_or "bm_or()", which go through the runs
+ * of both bitmaps once.
+ *
+ * A @ref bm_index "bitmap index" holds one bitmap for every distinct value.
+ * It is kept in memory, read from its file with @ref bmi_load "bmi_load()"
+ * and written with @ref bmi_save "bmi_save()". The file tells whether it
+ * was saved after the last change, see @ref bmi_changed "bmi_changed()".
+ *
+ * The @ref bloom_filters "Bloom filters" of a field hold one plain bitmap for
+ * every block of a table, where a value sets a few bits chosen by hashing it.
+ * A value with any of its bits unset is not in the block, see
+ * @ref bf_may_contain "bf_may_contain()". They are kept in memory and saved
+ * the same way as bitmap indexes.
+ */
+
+#ifndef _BITMAP_H_
+#define _BITMAP_H_
+
+#include "pager.h"
+
+/** @brief Bitmap of positions, stored as runs */
+typedef struct rl_bitmap_struct {
+  int num_runs; /**< number of runs */
+  int max_runs; /**< number of runs allocated */
+  int *runs;    /**< first position and length of every run, in ascending
+                     order, with a gap between two runs */
+} rl_bitmap;
+
+/** Make an empty bitmap. */
+extern void bm_init(rl_bitmap *b);
+/** Release the memory of the runs. The bitmap is empty afterwards. */
+extern void bm_release(rl_bitmap *b);
+/** Add position @em pos. */
+extern void bm_set(rl_bitmap *b, int pos);
+/** Remove position @em pos. */
+extern void bm_clear(rl_bitmap *b, int pos);
+/** Return the number of positions. */
+extern int bm_count(rl_bitmap const* b);
+/** Make @em res the positions in both @em a and @em b.
+    @em res is made anew and must not be one of the others. */
+extern void bm_and(rl_bitmap *res, rl_bitmap const* a, rl_bitmap const* b);
+/** Make @em res the positions in @em a or @em b.
+    @em res is made anew and must not be one of the others. */
+extern void bm_or(rl_bitmap *res, rl_bitmap const* a, rl_bitmap const* b);
+
+/** @brief Bitmap index of an int field */
+typedef struct bm_index_struct {
+  int num_vals; /**< number of distinct values */
+  int max_vals; /**< number of values allocated */
+  int *vals;    /**< the distinct values, in ascending order */
+  rl_bitmap *maps; /**< the positions of the records of every value */
+  int changed;  /**< whether it changed after it was loaded or saved */
+} bm_index;
+
+/** Make an empty bitmap index. */
+extern bm_index *bmi_new(void);
+/** Read the bitmap index in file @em fname. Returns NULL if there is none
+    or it was not saved after its last change. */
+extern bm_index *bmi_load(char const* fname);
+/** Write the bitmap index to file @em fname, if it changed. */
+extern void bmi_save(bm_index *bi, char const* fname);
+/** Record that the index is about to change, in memory and in file
+    @em fname, so that a file that is not saved afterwards is not loaded. */
+extern void bmi_changed(bm_index *bi, char const* fname);
+/** Release the memory of the index. */
+extern void bmi_release(bm_index *bi);
+/** Return the bitmap of value @em val, NULL if the value has none.
+    An empty bitmap is added for the value if @em add is set. */
+extern rl_bitmap *bmi_bitmap(bm_index *bi, int val, int add);
+/** Return the memory used by the index in bytes. */
+extern long bmi_mem(bm_index const* bi);
+
+/** @brief Bloom filters of an int field, one for every block of a table */
+typedef struct bloom_filters_struct {
+  int num_words;  /**< number of unsigned words of the filter of a block */
+  int num_hashes; /**< number of bits a value sets */
+  int num_blocks; /**< number of blocks with a filter */
+  int max_blocks; /**< number of filters allocated */
+  unsigned *words; /**< the filters of the blocks, one after another */
+  int changed;    /**< whether they changed after they were loaded or saved */
+} bloom_filters;
+
+/** Make empty Bloom filters for blocks of about @em keys_per_block values,
+    with a false positive rate of about @em fpr. */
+extern bloom_filters *bf_new(double fpr, int keys_per_block);
+/** Read the Bloom filters in file @em fname. Returns NULL if there are none
+    or they were not saved after their last change. */
+extern bloom_filters *bf_load(char const* fname);
+/** Write the Bloom filters to file @em fname, if they changed. */
+extern void bf_save(bloom_filters *bf, char const* fname);
+/** Same as bmi_changed() for Bloom filters. */
+extern void bf_changed(bloom_filters *bf, char const* fname);
+/** Release the memory of the filters. */
+extern void bf_release(bloom_filters *bf);
+/** Add value @em val to the filter of block @em blk. */
+extern void bf_add(bloom_filters *bf, int blk, int val);
+/** Return false if value @em val is surely not in block @em blk.
+    A block without a filter may hold any value. */
+extern int bf_may_contain(bloom_filters const* bf, int blk, int val);
+/** Return the memory used by the filters in bytes. */
+extern long bf_mem(bloom_filters const* bf);
+
+#endif
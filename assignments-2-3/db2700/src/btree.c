@@ -0,0 +1,305 @@
+/************************************************************
+ * B+-trees for db2700 in the Databases course INF-2700     *
+ * UIT - The Arctic University of Norway                    *
+ ************************************************************/
+
+#include "btree.h"
+#include "pmsg.h"
+#include <string.h>
+
+/* Block 0 of the file holds the number of the root block and the height
+   of the tree. Every other block is a node: after the page header, whether
+   it is a leaf, then the next leaf of a leaf or the first child of an inner
+   node, then the entries. The number of entries is the number of records
+   of the page. A leaf entry is (key, block, slot), and an inner entry is
+   (key, child), where the child holds the keys from key on. */
+#define BT_META_BLOCK 0
+#define BT_MAX_HEIGHT 16
+#define BT_NODE_VALS \
+  (3 * (BT_LEAF_CAPACITY + 1) > 2 * (BT_INNER_CAPACITY + 1) ? \
+   3 * (BT_LEAF_CAPACITY + 1) : 2 * (BT_INNER_CAPACITY + 1))
+
+/** @brief A node of a B+-tree in memory */
+typedef struct bt_node_struct {
+  int blk;  /**< block of the node */
+  int leaf; /**< whether the node is a leaf */
+  int link; /**< next leaf of a leaf, -1 if none, or first child of an inner node */
+  int n;    /**< number of entries */
+  int vals[BT_NODE_VALS]; /**< entries, with room for one more than a block holds */
+} bt_node;
+
+static int entry_len(bt_node *nd) {
+  return nd->leaf ? 3 : 2;
+}
+
+static int node_capacity(bt_node *nd) {
+  return nd->leaf ? BT_LEAF_CAPACITY : BT_INNER_CAPACITY;
+}
+
+static page_p get_bt_page(char const* fname, int blk) {
+  page_p pg = get_page(fname, blk);
+  if (!pg) {
+    put_msg(FATAL, "Failed to get page for \"%s\" block %d.\n", fname, blk);
+    exit(EXIT_FAILURE);
+  }
+  return pg;
+}
+
+static void read_node(char const* fname, int blk, bt_node *nd) {
+  page_p pg = get_bt_page(fname, blk);
+  int pos = PAGE_HEADER_SIZE;
+  nd->blk = blk;
+  nd->leaf = page_get_int_at(pg, pos);
+  nd->link = page_get_int_at(pg, pos + INT_SIZE);
+  nd->n = page_num_records(pg);
+  pos += BT_NODE_HEADER_INTS * INT_SIZE;
+  for (int i = 0; i < nd->n * entry_len(nd); i++, pos += INT_SIZE)
+    nd->vals[i] = page_get_int_at(pg, pos);
+  unpin(pg);
+}
+
+static void write_node(char const* fname, bt_node *nd) {
+  page_p pg = get_bt_page(fname, nd->blk);
+  int pos = PAGE_HEADER_SIZE;
+  /* the values are put one after another from the beginning */
+  page_set_free_pos(pg, pos);
+  page_put_int_at(pg, pos, nd->leaf);
+  page_put_int_at(pg, pos + INT_SIZE, nd->link);
+  pos += BT_NODE_HEADER_INTS * INT_SIZE;
+  for (int i = 0; i < nd->n * entry_len(nd); i++, pos += INT_SIZE)
+    page_put_int_at(pg, pos, nd->vals[i]);
+  page_set_num_records(pg, nd->n);
+  unpin(pg);
+}
+
+static void read_meta(char const* fname, int *root, int *height) {
+  page_p pg = get_bt_page(fname, BT_META_BLOCK);
+  *root = page_get_int_at(pg, PAGE_HEADER_SIZE);
+  *height = page_get_int_at(pg, PAGE_HEADER_SIZE + INT_SIZE);
+  unpin(pg);
+  if (*height > BT_MAX_HEIGHT) {
+    put_msg(FATAL, "B+-tree \"%s\" is corrupt.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void write_meta(char const* fname, int root, int height) {
+  page_p pg = get_bt_page(fname, BT_META_BLOCK);
+  page_set_free_pos(pg, PAGE_HEADER_SIZE);
+  page_put_int_at(pg, PAGE_HEADER_SIZE, root);
+  page_put_int_at(pg, PAGE_HEADER_SIZE + INT_SIZE, height);
+  unpin(pg);
+}
+
+/** @b entry_idx
+ *
+ * returns the index of the first entry of the node whose key is not below
+ * key, or is above key if after is set. In an inner node, this is also the
+ * child the entries with that key start in.
+ */
+static int entry_idx(bt_node *nd, int key, int after) {
+  int low = 0, high = nd->n, mid, k;
+  while (low < high) {
+    mid = (low + high) / 2;
+    k = nd->vals[mid * entry_len(nd)];
+    if (k < key || (after && k == key))
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static int child_blk(bt_node *nd, int i) {
+  return i == 0 ? nd->link : nd->vals[2 * (i - 1) + 1];
+}
+
+/** @b find_leaf
+ *
+ * reads the nodes from the root to the leaf of key into path, see
+ * entry_idx() for after. Returns the number of nodes in path, 0 if there is
+ * no tree in the file.
+ */
+static int find_leaf(char const* fname, int key, int after,
+                     bt_node path[], int child[]) {
+  if (file_num_blocks(fname) == 0)
+    return 0;
+  int root, height;
+  read_meta(fname, &root, &height);
+  int blk = root;
+  for (int l = 0; l < height; l++) {
+    read_node(fname, blk, path + l);
+    if (path[l].leaf)
+      return l + 1;
+    child[l] = entry_idx(path + l, key, after);
+    blk = child_blk(path + l, child[l]);
+  }
+  put_msg(FATAL, "B+-tree \"%s\" is corrupt.\n", fname);
+  exit(EXIT_FAILURE);
+}
+
+static void insert_entry(bt_node *nd, int i, int const* entry) {
+  int len = entry_len(nd);
+  memmove(nd->vals + (i + 1) * len, nd->vals + i * len,
+          (nd->n - i) * len * sizeof (int));
+  memcpy(nd->vals + i * len, entry, len * sizeof (int));
+  nd->n++;
+}
+
+/** @b split_node
+ *
+ * moves the entries of node nd from entry m on to a new node right, and
+ * returns the key that separates them. The key of entry m of an inner node
+ * moves up to the parent, and its child becomes the first child of right.
+ */
+static int split_node(char const* fname, bt_node *nd, int m, bt_node *right) {
+  int len = entry_len(nd), sep = nd->vals[m * len];
+  right->blk = file_num_blocks(fname);
+  right->leaf = nd->leaf;
+  if (nd->leaf) {
+    right->link = nd->link;
+    nd->link = right->blk;
+    right->n = nd->n - m;
+    memcpy(right->vals, nd->vals + m * len, right->n * len * sizeof (int));
+  } else {
+    right->link = nd->vals[m * len + 1];
+    right->n = nd->n - m - 1;
+    memcpy(right->vals, nd->vals + (m + 1) * len, right->n * len * sizeof (int));
+  }
+  nd->n = m;
+  write_node(fname, right);
+  write_node(fname, nd);
+  return sep;
+}
+
+void bt_insert(char const* fname, int key, int blk, int slot) {
+  bt_node path[BT_MAX_HEIGHT], right;
+  int child[BT_MAX_HEIGHT];
+
+  int height = find_leaf(fname, key, 1, path, child);
+  if (height == 0) {
+    /* a new tree, with an empty leaf as the root */
+    write_meta(fname, 1, 1);
+    path[0].blk = 1;
+    path[0].leaf = 1;
+    path[0].link = -1;
+    path[0].n = 0;
+    height = 1;
+  }
+
+  int entry[3] = {key, blk, slot};
+  int l = height - 1;
+  int i = entry_idx(path + l, key, 1);
+  insert_entry(path + l, i, entry);
+  for (;;) {
+    bt_node *nd = path + l;
+    if (nd->n <= node_capacity(nd)) {
+      write_node(fname, nd);
+      return;
+    }
+    /* When keys are added in ascending order, the entry is always the last
+       one of the last node. The full node then stays full and the new node
+       gets just that entry, instead of leaving two half-empty nodes. */
+    int m = nd->n / 2;
+    if (i == nd->n - 1 && (!nd->leaf || nd->link == -1))
+      m = nd->leaf ? nd->n - 1 : nd->n - 2;
+    entry[0] = split_node(fname, nd, m, &right);
+    entry[1] = right.blk;
+    if (l == 0) {
+      /* a new root above the old one, reusing the memory of right */
+      right.link = nd->blk;
+      right.blk = file_num_blocks(fname);
+      right.leaf = 0;
+      right.n = 0;
+      insert_entry(&right, 0, entry);
+      write_node(fname, &right);
+      write_meta(fname, right.blk, height + 1);
+      return;
+    }
+    l--;
+    i = child[l];
+    insert_entry(path + l, i, entry);
+  }
+}
+
+int bt_delete(char const* fname, int key, int blk, int slot) {
+  bt_node path[BT_MAX_HEIGHT];
+  int child[BT_MAX_HEIGHT];
+
+  int height = find_leaf(fname, key, 0, path, child);
+  if (height == 0)
+    return 0;
+  /* the entries with the key may go on in the next leaves. Leaves are not
+     merged when they become empty, a scan just moves on to the next one. */
+  bt_node *nd = path + height - 1;
+  for (int i = entry_idx(nd, key, 0); ; i++) {
+    if (i == nd->n) {
+      if (nd->link < 0)
+        return 0;
+      read_node(fname, nd->link, nd);
+      i = -1;
+      continue;
+    }
+    int *e = nd->vals + 3 * i;
+    if (e[0] > key)
+      return 0;
+    if (e[1] == blk && e[2] == slot) {
+      memmove(e, e + 3, (nd->n - i - 1) * 3 * sizeof (int));
+      nd->n--;
+      write_node(fname, nd);
+      return 1;
+    }
+  }
+}
+
+void bt_seek(bt_cursor *c, char const* fname, int key, int above) {
+  bt_node path[BT_MAX_HEIGHT];
+  int child[BT_MAX_HEIGHT];
+
+  c->fname = fname;
+  c->next_leaf = -1;
+  c->pos = c->num_entries = 0;
+  int height = find_leaf(fname, key, above, path, child);
+  if (height == 0)
+    return;
+  bt_node *nd = path + height - 1;
+  c->next_leaf = nd->link;
+  c->num_entries = nd->n;
+  c->pos = entry_idx(nd, key, above);
+  memcpy(c->entries, nd->vals, 3 * nd->n * sizeof (int));
+}
+
+int bt_next(bt_cursor *c, int *key, int *blk, int *slot) {
+  while (c->pos >= c->num_entries) {
+    if (c->next_leaf < 0)
+      return 0;
+    bt_node nd;
+    read_node(c->fname, c->next_leaf, &nd);
+    c->next_leaf = nd.link;
+    c->num_entries = nd.n;
+    c->pos = 0;
+    memcpy(c->entries, nd.vals, 3 * nd.n * sizeof (int));
+  }
+  int *e = c->entries + 3 * c->pos++;
+  *key = e[0];
+  *blk = e[1];
+  *slot = e[2];
+  return 1;
+}
+
+void put_bt_info(pmsg_level level, char const* fname) {
+  if (file_num_blocks(fname) == 0) {
+    put_msg(level, "B+-tree \"%s\" is empty.\n", fname);
+    return;
+  }
+  int root, height;
+  read_meta(fname, &root, &height);
+  put_msg(level, "B+-tree \"%s\": root %d, height %d.\n", fname, root, height);
+  bt_node nd;
+  for (int b = 1; b < file_num_blocks(fname); b++) {
+    read_node(fname, b, &nd);
+    put_msg(level, "  %s %d: %d entries from key %d, %s %d\n",
+            nd.leaf ? "leaf" : "inner", b, nd.n, nd.n ? nd.vals[0] : 0,
+            nd.leaf ? "next" : "first child", nd.link);
+  }
+}
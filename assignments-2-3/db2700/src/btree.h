@@ -0,0 +1,60 @@
+/** @file btree.h
+ * @brief B+-trees of int keys, stored in the blocks of a pager file.
+ *
+ * A B+-tree maps int keys to record ids, each consisting of a block and a
+ * slot, and may hold the same key many times.
+ * Every node of the tree is one block of the file, so that a lookup reads
+ * one block per level of the tree and holds at most one buffer page at a
+ * time. Block 0 of the file tells where the root is.
+ *
+ * Add an entry with @ref bt_insert "bt_insert()" and remove it with
+ * @ref bt_delete "bt_delete()". To go through the entries in the order of
+ * the keys, position a @ref bt_cursor "cursor" with
+ * @ref bt_seek "bt_seek()" and fetch the entries with
+ * @ref bt_next "bt_next()".
+ */
+
+#ifndef _BTREE_H_
+#define _BTREE_H_
+
+#include "pager.h"
+
+/** number of ints stored ahead of the entries of a node */
+#define BT_NODE_HEADER_INTS 2
+
+/** max number of entries (key, block, slot) in a leaf */
+#define BT_LEAF_CAPACITY \
+  ((BLOCK_SIZE - PAGE_HEADER_SIZE - BT_NODE_HEADER_INTS * INT_SIZE) / (3 * INT_SIZE))
+
+/** max number of entries (key, child) in an inner node */
+#define BT_INNER_CAPACITY \
+  ((BLOCK_SIZE - PAGE_HEADER_SIZE - BT_NODE_HEADER_INTS * INT_SIZE) / (2 * INT_SIZE))
+
+/** @brief Position among the entries of a B+-tree
+
+    A cursor holds a copy of the current leaf, so that no page stays pinned
+    between two calls of bt_next(). */
+typedef struct bt_cursor_struct {
+  char const* fname; /**< file of the tree */
+  int next_leaf;     /**< block of the leaf after the current one, -1 if none */
+  int pos;           /**< index of the next entry in the current leaf */
+  int num_entries;   /**< number of entries in the current leaf */
+  int entries[3 * BT_LEAF_CAPACITY]; /**< (key, block, slot) of the current leaf */
+} bt_cursor;
+
+/** Print the nodes of the tree in the file. */
+extern void put_bt_info(pmsg_level level, char const* fname);
+
+/** Add an entry to the tree in the file @em fname,
+    making the tree if the file is empty. */
+extern void bt_insert(char const* fname, int key, int blk, int slot);
+/** Remove an entry from the tree. Returns 0 if there is no such entry. */
+extern int bt_delete(char const* fname, int key, int blk, int slot);
+/** Position cursor @em c at the first entry whose key is not below @em key,
+    or is above @em key if @em above is set. */
+extern void bt_seek(bt_cursor *c, char const* fname, int key, int above);
+/** Fetch the entry at the cursor and move on to the next one.
+    Returns 0 when there are no more entries. */
+extern int bt_next(bt_cursor *c, int *key, int *blk, int *slot);
+
+#endif
@@ -0,0 +1,374 @@
+/************************************************************
+ * Hash indexes for db2700 in the Databases course INF-2700 *
+ * UIT - The Arctic University of Norway                    *
+ ************************************************************/
+
+#include "hashidx.h"
+#include "pmsg.h"
+#include <string.h>
+
+/* Block 0 of the file holds the number of bits of the directory, called its
+   depth, and the blocks that hold the directory, in order. A directory of
+   depth d has 2^d entries, each the block of a bucket. After the page
+   header, a bucket holds the number of bits its keys have in common, then
+   its next overflow bucket, then the entries. The number of entries is the
+   number of records of the page. An entry is (key, block, slot). */
+#define HASH_META_BLOCK 0
+#define HASH_DIR_PER_BLOCK ((BLOCK_SIZE - PAGE_HEADER_SIZE) / INT_SIZE)
+#define HASH_MAX_DIR_BLOCKS ((BLOCK_SIZE - PAGE_HEADER_SIZE) / INT_SIZE - 2)
+
+/** @brief The block 0 of a hash index in memory */
+typedef struct hash_meta_struct {
+  int depth;          /**< number of bits of the hash the directory uses */
+  int num_dir_blocks; /**< number of blocks of the directory */
+  int dir_blks[HASH_MAX_DIR_BLOCKS]; /**< blocks of the directory */
+} hash_meta;
+
+/** @brief A bucket of a hash index in memory */
+typedef struct hash_bucket_struct {
+  int blk;   /**< block of the bucket */
+  int depth; /**< number of bits of the hash its keys have in common */
+  int link;  /**< next overflow bucket, -1 if none */
+  int n;     /**< number of entries */
+  int vals[3 * HASH_BUCKET_CAPACITY]; /**< entries */
+} hash_bucket;
+
+/** @b hash_key
+ *
+ * mixes the bits of the key, so that keys close to each other, which are
+ * common, still spread over the buckets by the low bits of the hash
+ */
+static unsigned hash_key(int key) {
+  unsigned h = key;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+static unsigned low_bits(unsigned h, int depth) {
+  return h & ((1u << depth) - 1);
+}
+
+static page_p get_hash_page(char const* fname, int blk) {
+  page_p pg = get_page(fname, blk);
+  if (!pg) {
+    put_msg(FATAL, "Failed to get page for \"%s\" block %d.\n", fname, blk);
+    exit(EXIT_FAILURE);
+  }
+  return pg;
+}
+
+static void read_meta(char const* fname, hash_meta *m) {
+  page_p pg = get_hash_page(fname, HASH_META_BLOCK);
+  int pos = PAGE_HEADER_SIZE;
+  m->depth = page_get_int_at(pg, pos);
+  m->num_dir_blocks = page_get_int_at(pg, pos + INT_SIZE);
+  if (m->num_dir_blocks < 1 || m->num_dir_blocks > HASH_MAX_DIR_BLOCKS) {
+    put_msg(FATAL, "Hash index \"%s\" is corrupt.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+  pos += 2 * INT_SIZE;
+  for (int i = 0; i < m->num_dir_blocks; i++, pos += INT_SIZE)
+    m->dir_blks[i] = page_get_int_at(pg, pos);
+  unpin(pg);
+}
+
+static void write_meta(char const* fname, hash_meta *m) {
+  page_p pg = get_hash_page(fname, HASH_META_BLOCK);
+  int pos = PAGE_HEADER_SIZE;
+  page_set_free_pos(pg, pos);
+  page_put_int_at(pg, pos, m->depth);
+  page_put_int_at(pg, pos + INT_SIZE, m->num_dir_blocks);
+  pos += 2 * INT_SIZE;
+  for (int i = 0; i < m->num_dir_blocks; i++, pos += INT_SIZE)
+    page_put_int_at(pg, pos, m->dir_blks[i]);
+  unpin(pg);
+}
+
+static int dir_get(char const* fname, hash_meta *m, int i) {
+  page_p pg = get_hash_page(fname, m->dir_blks[i / HASH_DIR_PER_BLOCK]);
+  int blk = page_get_int_at(pg, PAGE_HEADER_SIZE + i % HASH_DIR_PER_BLOCK * INT_SIZE);
+  unpin(pg);
+  return blk;
+}
+
+/** @b dir_set
+ *
+ * sets entry i of the directory, adding a block to the directory if the
+ * entry is the first one of it. The entries are set in ascending order when
+ * the directory grows, so that the free position of a block is never behind.
+ */
+static void dir_set(char const* fname, hash_meta *m, int i, int blk) {
+  if (i / HASH_DIR_PER_BLOCK == m->num_dir_blocks)
+    m->dir_blks[m->num_dir_blocks++] = file_num_blocks(fname);
+  page_p pg = get_hash_page(fname, m->dir_blks[i / HASH_DIR_PER_BLOCK]);
+  page_put_int_at(pg, PAGE_HEADER_SIZE + i % HASH_DIR_PER_BLOCK * INT_SIZE, blk);
+  unpin(pg);
+}
+
+static void read_bucket(char const* fname, int blk, hash_bucket *b) {
+  page_p pg = get_hash_page(fname, blk);
+  int pos = PAGE_HEADER_SIZE;
+  b->blk = blk;
+  b->depth = page_get_int_at(pg, pos);
+  b->link = page_get_int_at(pg, pos + INT_SIZE);
+  b->n = page_num_records(pg);
+  pos += HASH_BUCKET_HEADER_INTS * INT_SIZE;
+  for (int i = 0; i < 3 * b->n; i++, pos += INT_SIZE)
+    b->vals[i] = page_get_int_at(pg, pos);
+  unpin(pg);
+}
+
+static void write_bucket(char const* fname, hash_bucket *b) {
+  page_p pg = get_hash_page(fname, b->blk);
+  int pos = PAGE_HEADER_SIZE;
+  /* the values are put one after another from the beginning */
+  page_set_free_pos(pg, pos);
+  page_put_int_at(pg, pos, b->depth);
+  page_put_int_at(pg, pos + INT_SIZE, b->link);
+  pos += HASH_BUCKET_HEADER_INTS * INT_SIZE;
+  for (int i = 0; i < 3 * b->n; i++, pos += INT_SIZE)
+    page_put_int_at(pg, pos, b->vals[i]);
+  page_set_num_records(pg, b->n);
+  unpin(pg);
+}
+
+static void new_bucket(char const* fname, hash_bucket *b, int depth) {
+  b->blk = file_num_blocks(fname);
+  b->depth = depth;
+  b->link = -1;
+  b->n = 0;
+  write_bucket(fname, b);
+}
+
+/** @b find_bucket
+ *
+ * reads the meta block into m and the first bucket of hash h into b
+ * and returns the index of the directory entry of h
+ */
+static int find_bucket(char const* fname, unsigned h, hash_meta *m,
+                       hash_bucket *b) {
+  read_meta(fname, m);
+  int i = low_bits(h, m->depth);
+  read_bucket(fname, dir_get(fname, m, i), b);
+  return i;
+}
+
+static void add_entry(hash_bucket *b, int const* entry) {
+  memmove(b->vals + 3 * b->n, entry, 3 * sizeof (int));
+  b->n++;
+}
+
+/** @b first_hash
+ *
+ * gets the hash of the first entry of bucket b and its overflow buckets.
+ * Returns 0 if they are all empty.
+ */
+static int first_hash(char const* fname, hash_bucket const* b, unsigned *h) {
+  hash_bucket ovf;
+  for (;;) {
+    if (b->n > 0) {
+      *h = hash_key(b->vals[0]);
+      return 1;
+    }
+    if (b->link < 0)
+      return 0;
+    read_bucket(fname, b->link, &ovf);
+    b = &ovf;
+  }
+}
+
+static int all_same_hash(hash_bucket const* b, unsigned h) {
+  for (int i = 0; i < b->n; i++)
+    if (hash_key(b->vals[3 * i]) != h)
+      return 0;
+  return 1;
+}
+
+/** @b add_overflow_entry
+ *
+ * adds the entry to the first of bucket b and its overflow buckets with
+ * room for it, adding an overflow bucket if there is none
+ */
+static void add_overflow_entry(char const* fname, hash_bucket *b,
+                               int const* entry) {
+  while (b->n == HASH_BUCKET_CAPACITY && b->link >= 0)
+    read_bucket(fname, b->link, b);
+  if (b->n < HASH_BUCKET_CAPACITY) {
+    add_entry(b, entry);
+    write_bucket(fname, b);
+    return;
+  }
+  hash_bucket ovf;
+  new_bucket(fname, &ovf, b->depth);
+  add_entry(&ovf, entry);
+  write_bucket(fname, &ovf);
+  b->link = ovf.blk;
+  write_bucket(fname, b);
+}
+
+static void double_dir(char const* fname, hash_meta *m) {
+  int size = 1 << m->depth;
+  for (int i = 0; i < size; i++)
+    dir_set(fname, m, size + i, dir_get(fname, m, i));
+  m->depth++;
+  write_meta(fname, m);
+}
+
+/** @b split_bucket
+ *
+ * splits bucket b, found at entry i of the directory, by the next bit of the
+ * hash. Its entries with the bit set move to a new bucket, unless b has
+ * overflow buckets: then all the entries have the same hash, and they stay
+ * where they are while the new bucket takes the other half of the keys.
+ */
+static void split_bucket(char const* fname, hash_meta *m, hash_bucket *b,
+                         int i) {
+  unsigned bit = 1u << b->depth, h;
+  hash_bucket nb;
+  new_bucket(fname, &nb, ++b->depth);
+  int upper = nb.blk, lower = b->blk;
+  if (b->link >= 0) {
+    if (first_hash(fname, b, &h) && (h & bit)) {
+      upper = b->blk;
+      lower = nb.blk;
+    }
+  } else {
+    int n = b->n;
+    b->n = 0;
+    for (int k = 0; k < n; k++) {
+      int *e = b->vals + 3 * k;
+      add_entry(hash_key(e[0]) & bit ? &nb : b, e);
+    }
+    write_bucket(fname, &nb);
+  }
+  write_bucket(fname, b);
+  for (int k = low_bits(i, b->depth - 1); k < 1 << m->depth; k += bit)
+    dir_set(fname, m, k, k & bit ? upper : lower);
+}
+
+void hash_insert(char const* fname, int key, int blk, int slot) {
+  hash_meta m;
+  hash_bucket b;
+  unsigned h = hash_key(key), fh;
+  int entry[3] = {key, blk, slot};
+
+  if (file_num_blocks(fname) == 0) {
+    /* a new index, with a directory of one entry */
+    m.depth = 0;
+    m.num_dir_blocks = 0;
+    write_meta(fname, &m);
+    dir_set(fname, &m, 0, 2);
+    new_bucket(fname, &b, 0);
+    write_meta(fname, &m);
+  }
+
+  for (;;) {
+    int i = find_bucket(fname, h, &m, &b);
+    if (b.link < 0 && b.n < HASH_BUCKET_CAPACITY) {
+      add_entry(&b, entry);
+      write_bucket(fname, &b);
+      return;
+    }
+    /* Splitting does not separate entries of the same hash, so they go to
+       overflow buckets, as do all entries when the directory is at its
+       largest. A bucket then has overflow buckets only if all its entries
+       have the same hash, or if it uses all the bits of the directory. */
+    int can_grow = b.depth < m.depth
+      || (2 << m.depth) <= HASH_MAX_DIR_BLOCKS * HASH_DIR_PER_BLOCK;
+    if (!can_grow || (b.link >= 0 && (!first_hash(fname, &b, &fh) || fh == h))
+        || (b.link < 0 && all_same_hash(&b, h))) {
+      add_overflow_entry(fname, &b, entry);
+      return;
+    }
+    if (b.depth == m.depth)
+      double_dir(fname, &m);
+    split_bucket(fname, &m, &b, i);
+  }
+}
+
+int hash_delete(char const* fname, int key, int blk, int slot) {
+  hash_meta m;
+  hash_bucket b;
+
+  if (file_num_blocks(fname) == 0)
+    return 0;
+  /* buckets are not merged when they become empty */
+  find_bucket(fname, hash_key(key), &m, &b);
+  for (;;) {
+    for (int i = 0; i < b.n; i++) {
+      int *e = b.vals + 3 * i;
+      if (e[0] == key && e[1] == blk && e[2] == slot) {
+        memmove(e, e + 3, (b.n - i - 1) * 3 * sizeof (int));
+        b.n--;
+        write_bucket(fname, &b);
+        return 1;
+      }
+    }
+    if (b.link < 0)
+      return 0;
+    read_bucket(fname, b.link, &b);
+  }
+}
+
+void hash_seek(hash_cursor *c, char const* fname, int key) {
+  hash_meta m;
+  hash_bucket b;
+
+  c->fname = fname;
+  c->key = key;
+  c->next_bucket = -1;
+  c->pos = c->num_entries = 0;
+  if (file_num_blocks(fname) == 0)
+    return;
+  find_bucket(fname, hash_key(key), &m, &b);
+  c->next_bucket = b.link;
+  c->num_entries = b.n;
+  memcpy(c->entries, b.vals, 3 * b.n * sizeof (int));
+}
+
+int hash_next(hash_cursor *c, int *blk, int *slot) {
+  for (;;) {
+    while (c->pos < c->num_entries) {
+      int *e = c->entries + 3 * c->pos++;
+      if (e[0] == c->key) {
+        *blk = e[1];
+        *slot = e[2];
+        return 1;
+      }
+    }
+    if (c->next_bucket < 0)
+      return 0;
+    hash_bucket b;
+    read_bucket(c->fname, c->next_bucket, &b);
+    c->next_bucket = b.link;
+    c->num_entries = b.n;
+    c->pos = 0;
+    memcpy(c->entries, b.vals, 3 * b.n * sizeof (int));
+  }
+}
+
+void put_hash_info(pmsg_level level, char const* fname) {
+  if (file_num_blocks(fname) == 0) {
+    put_msg(level, "Hash index \"%s\" is empty.\n", fname);
+    return;
+  }
+  hash_meta m;
+  read_meta(fname, &m);
+  put_msg(level, "Hash index \"%s\": depth %d, directory in %d blocks.\n",
+          fname, m.depth, m.num_dir_blocks);
+  hash_bucket b;
+  for (int blk = 1; blk < file_num_blocks(fname); blk++) {
+    int is_dir = 0;
+    for (int i = 0; i < m.num_dir_blocks; i++)
+      is_dir |= m.dir_blks[i] == blk;
+    if (is_dir)
+      continue;
+    read_bucket(fname, blk, &b);
+    put_msg(level, "  bucket %d: depth %d, %d entries, overflow %d\n",
+            blk, b.depth, b.n, b.link);
+  }
+}
@@ -0,0 +1,62 @@
+/** @file hashidx.h
+ * @brief Extendible hash indexes of int keys, stored in the blocks of a
+ * pager file.
+ *
+ * A hash index maps int keys to record ids, each consisting of a block and a
+ * slot, and may hold the same key many times. It only finds the entries of
+ * one key, but it does so with a fixed number of block reads.
+ *
+ * The low bits of the hash of a key give the entry of the directory that
+ * tells which bucket holds the key. A full bucket is split in two, by one
+ * more bit of the hash, and the directory doubles when the bucket already
+ * uses as many bits as the directory. The entries of keys with the same hash
+ * cannot be split apart, so they go on in overflow buckets instead.
+ * Every bucket is one block of the file, and so is every part of the
+ * directory. Block 0 of the file tells where the directory is.
+ *
+ * Add an entry with @ref hash_insert "hash_insert()" and remove it with
+ * @ref hash_delete "hash_delete()". To go through the entries of a key,
+ * position a @ref hash_cursor "cursor" with @ref hash_seek "hash_seek()"
+ * and fetch the entries with @ref hash_next "hash_next()".
+ */
+
+#ifndef _HASHIDX_H_
+#define _HASHIDX_H_
+
+#include "pager.h"
+
+/** number of ints stored ahead of the entries of a bucket */
+#define HASH_BUCKET_HEADER_INTS 2
+
+/** max number of entries (key, block, slot) in a bucket */
+#define HASH_BUCKET_CAPACITY \
+  ((BLOCK_SIZE - PAGE_HEADER_SIZE - HASH_BUCKET_HEADER_INTS * INT_SIZE) / (3 * INT_SIZE))
+
+/** @brief Position among the entries of a key in a hash index
+
+    A cursor holds a copy of the current bucket, so that no page stays pinned
+    between two calls of hash_next(). */
+typedef struct hash_cursor_struct {
+  char const* fname; /**< file of the index */
+  int key;           /**< key of the entries */
+  int next_bucket;   /**< block of the overflow bucket after the current one, -1 if none */
+  int pos;           /**< index of the next entry in the current bucket */
+  int num_entries;   /**< number of entries in the current bucket */
+  int entries[3 * HASH_BUCKET_CAPACITY]; /**< (key, block, slot) of the current bucket */
+} hash_cursor;
+
+/** Print the directory and the buckets of the index in the file. */
+extern void put_hash_info(pmsg_level level, char const* fname);
+
+/** Add an entry to the index in the file @em fname,
+    making the index if the file is empty. */
+extern void hash_insert(char const* fname, int key, int blk, int slot);
+/** Remove an entry from the index. Returns 0 if there is no such entry. */
+extern int hash_delete(char const* fname, int key, int blk, int slot);
+/** Position cursor @em c at the first entry of @em key. */
+extern void hash_seek(hash_cursor *c, char const* fname, int key);
+/** Fetch the record id of the entry at the cursor and move on to the next
+    entry of the key. Returns 0 when there are no more entries. */
+extern int hash_next(hash_cursor *c, int *blk, int *slot);
+
+#endif
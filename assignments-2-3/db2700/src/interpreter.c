@@ -25,17 +25,30 @@ static const char* const t_print = "print";
 static const char* const t_create = "create";
 static const char* const t_drop = "drop";
 static const char* const t_table = "table";
+static const char* const t_index = "index";
+static const char* const t_on = "on";
+static const char* const t_using = "using";
+static const char* const t_btree = "btree";
+static const char* const t_hash = "hash";
+static const char* const t_bitmap = "bitmap";
+static const char* const t_bloom = "bloom";
+static const char* const t_count = "count(*)";
 static const char* const t_insert = "insert";
 static const char* const t_into = "into";
 static const char* const t_values = "values";
 static const char* const t_select = "select";
+static const char* const t_update = "update";
+static const char* const t_set = "set";
+static const char* const t_delete = "delete";
+static const char* const t_from = "from";
 static const char* const t_quit = "quit";
 static const char* const t_help = "help";
 static const char* const t_int = "int";
+static const char* const t_pax = "pax";
+static const char* const t_columnar = "columnar";
 
 static FILE *in_s; /* input stream, default to stdin */
 
-int b_search = 0;
 int no_interface = 0;
 
 static int init_with_options (int argc, char* argv[]) {
@@ -45,7 +58,7 @@ static int init_with_options (int argc, char* argv[]) {
 
   msglevel = INFO;
 
-  while ((c = getopt(argc, argv, "hnm:b:d:c:")) != -1)
+  while ((c = getopt(argc, argv, "hnm:s:d:c:b:j:M:")) != -1)
     switch (c) {
     case 'h':
       printf("Usage: runtest [switches]\n");
@@ -53,7 +66,13 @@ static int init_with_options (int argc, char* argv[]) {
       printf("\t-m [fewid]   msg level [fatal,error,warn,info,debug]\n");
       printf("\t-d db_dir    default to ./tests/testfront\n");
       printf("\t-c cmd_file  eg. ./tests/testcmd.dbcmd, default to stdin\n");
-      printf("\t-b yes/no    use the binary search algorithm or not\n");
+      printf("\t-s method    search method on sorted fields [auto,interpolation,learned,linear],\n");
+      printf("\t             auto uses binary search, linear always scans\n");
+      printf("\t-b fpr       false positive rate of new Bloom filters, default 0.01\n");
+      printf("\t-j method    natural join method [auto,nested,hash,merge,block,index],\n");
+      printf("\t             auto looks up an index for few left records,\n");
+      printf("\t             merges inputs sorted on the key, else uses hash\n");
+      printf("\t-M bytes     memory of the hash table of a hash join, default 1048576\n");
       printf("\t-n           suppress printing 'db2700>'for each line in stdin\n");
       exit(0);
     case 'm':
@@ -70,23 +89,50 @@ static int init_with_options (int argc, char* argv[]) {
     case 'c':
       strcpy(cmd_file, optarg);
       break;
+    case 's':
+      if (strcmp(optarg, "auto") == 0)
+        set_search_method(SEARCH_AUTO);
+      else if (strcmp(optarg, "interpolation") == 0)
+        set_search_method(SEARCH_INTERPOLATION);
+      else if (strcmp(optarg, "learned") == 0)
+        set_search_method(SEARCH_LEARNED);
+      else if (strcmp(optarg, "linear") == 0)
+        set_search_method(SEARCH_LINEAR);
+      else {
+        printf("Option -s requires arguments auto/interpolation/learned/linear\n");
+        abort();
+      }
+      break;
     case 'b':
-      switch (optarg[0])
-      {
-      case 't':
-      case 'y': b_search = 1;break;
-      case 'f':
-      case 'n': b_search = 0;break;
-      default:
-        printf("Option -b requires arguments yes/no or true/false\n");
+      set_bloom_fpr(atof(optarg));
+      break;
+    case 'j':
+      if (strcmp(optarg, "auto") == 0)
+        set_join_method(JOIN_AUTO);
+      else if (strcmp(optarg, "nested") == 0)
+        set_join_method(JOIN_NESTED_LOOP);
+      else if (strcmp(optarg, "hash") == 0)
+        set_join_method(JOIN_HASH);
+      else if (strcmp(optarg, "merge") == 0)
+        set_join_method(JOIN_MERGE);
+      else if (strcmp(optarg, "block") == 0)
+        set_join_method(JOIN_BLOCK_NESTED_LOOP);
+      else if (strcmp(optarg, "index") == 0)
+        set_join_method(JOIN_INDEX_NESTED_LOOP);
+      else {
+        printf("Option -j requires arguments auto/nested/hash/merge/block/index\n");
         abort();
       }
       break;
+    case 'M':
+      set_join_mem_budget(atol(optarg));
+      break;
     case 'n':
       no_interface = 1;
       break;
     case '?':
-      if (optopt == 'm' || optopt == 'd' || optopt == 'c' || optopt == 'b')
+      if (optopt == 'm' || optopt == 'd' || optopt == 'c' || optopt == 's'
+          || optopt == 'b' || optopt == 'j' || optopt == 'M')
         printf("Option -%c requires an argument.\n", optopt);
       else if (isprint(optopt))
         printf("Unknown option `-%c'.\n", optopt);
@@ -144,7 +190,7 @@ static int next_token_max_len(char* token, size_t len) {
 }
 
 static int next_token(char* token) {
-  return next_token_max_len(token, MAX_TOKEN_LEN);
+  return next_token_max_len(token, MAX_TOKEN_LEN - 1);
 }
 
 static char next_char() {
@@ -161,7 +207,7 @@ static char next_char() {
     - does not contain a semicolon */
 static int read_till(char* stmnt_str, char c) {
   char format[16];
-  snprintf(format, sizeof format, "%%%u[^%c\n];", MAX_LINE_WIDTH, c);
+  snprintf(format, sizeof format, "%%%u[^%c\n];", MAX_LINE_WIDTH - 1, c);
   if (fscanf(in_s, format, stmnt_str))
     return 1;
   else
@@ -199,7 +245,7 @@ static int str_split(char* str, char c, char* substrs[],
   for (p = str; *p != '\0'; p++) {
     if (*p == c) {
       *p = '\0';
-      if (++count > max_count) {
+      if (++count >= max_count) {
         put_msg(DEBUG, "str_split: too many substrings.\n");
         return 0;
       }
@@ -213,7 +259,7 @@ static int str_split(char* str, char c, char* substrs[],
   p = str;
 
   for (int i = 0; i < count; i++, p += strlen(p) + 1) {
-    int n_tmps = sscanf(p,"%s%s%s", str_tmp1, str_tmp2, str_tmp3);
+    int n_tmps = sscanf(p,"%31s%31s%31s", str_tmp1, str_tmp2, str_tmp3);
 
     if (n_tmps != n_white_space + 1) {
       put_msg(DEBUG,
@@ -257,10 +303,14 @@ static void show_help_info() {
   printf(" - # some comments in the rest of a line\n");
   printf(" - print text\n");
   printf(" - show database\n");
-  printf(" - create table table_name ( field_name field_type, ... )\n");
+  printf(" - create table table_name ( field_name field_type, ... ) [pax|columnar]\n");
+  printf(" - create index on table_name ( int_field_name ) [using btree|hash|bitmap|bloom]\n");
   printf(" - drop table table_name (CAUTION: data will be deleted!!!)\n");
   printf(" - insert into table_name values ( value_1, value_2, ... )\n");
-  printf(" - select attr1, attr2 from table_name where attr = int_val;\n\n");
+  printf(" - select attr1, attr2 from table_name where attr = int_val;\n");
+  printf(" - select count(*) from table_name where attr = int_val;\n");
+  printf(" - update table_name set attr = val where attr = int_val;\n");
+  printf(" - delete from table_name where attr = int_val;\n\n");
 }
 
 static void quit() {
@@ -279,6 +329,7 @@ static void show() {
   }
   else
   if (strcmp(token, t_pager) == 0) {
+    put_access_info(FORCE);
     put_pager_profiler_info(FORCE);
   } else {
     put_msg(ERROR, "Cannot show \"%s\".\n", token);
@@ -293,6 +344,51 @@ static void print_str() {
     printf("%s", rest_of_line + 1);
 }
 
+/* create index on table_name ( field_name ) [using btree|hash|bitmap|bloom]; */
+static void create_idx() {
+  char in_str[MAX_LINE_WIDTH] = "";
+  char on_str[MAX_TOKEN_LEN], tbl_name[MAX_TOKEN_LEN], fld_name[MAX_TOKEN_LEN];
+  char using_str[MAX_TOKEN_LEN], kind_str[MAX_TOKEN_LEN];
+  int len = 0;
+
+  if (!read_till(in_str, ';')) {
+    error_near("create index ");
+    return;
+  }
+  skip_line();
+
+  if (sscanf(in_str, "%31s %31[^( ] ( %31[^) ] )%n", on_str, tbl_name, fld_name,
+             &len) != 3 || strcmp(on_str, t_on) != 0) {
+    put_msg(ERROR, "create index %s: expecting \"on table_name ( field_name )\".\n",
+            in_str);
+    return;
+  }
+  index_kind kind = BTREE_INDEX;
+  int num_kind_strs = sscanf(in_str + len, "%31s %31s", using_str, kind_str);
+  if (num_kind_strs > 0) {
+    if (num_kind_strs != 2 || strcmp(using_str, t_using) != 0
+        || (strcmp(kind_str, t_btree) != 0 && strcmp(kind_str, t_hash) != 0
+            && strcmp(kind_str, t_bitmap) != 0 && strcmp(kind_str, t_bloom) != 0)) {
+      put_msg(ERROR, "create index %s: expecting \"using btree|hash|bitmap|bloom\".\n",
+              in_str);
+      return;
+    }
+    if (strcmp(kind_str, t_hash) == 0)
+      kind = HASH_INDEX;
+    else if (strcmp(kind_str, t_bitmap) == 0)
+      kind = BITMAP_INDEX;
+    else if (strcmp(kind_str, t_bloom) == 0)
+      kind = BLOOM_FILTER;
+  }
+  tbl_p tbl = get_table(tbl_name);
+  if (!tbl) {
+    put_msg(ERROR, "create index: table \"%s\" does not exist.\n", tbl_name);
+    return;
+  }
+  if (create_index(tbl, fld_name, kind))
+    put_msg(INFO, "Index created on \"%s\" of \"%s\".\n", fld_name, tbl_name);
+}
+
 static void create_tbl() {
   char tbl_name[MAX_TOKEN_LEN], token[MAX_TOKEN_LEN];
 
@@ -300,6 +396,10 @@ static void create_tbl() {
     put_msg(ERROR, "Must create something.\n");
     return;
   }
+  if (strcmp(token, t_index) == 0) {
+    create_idx();
+    return;
+  }
   if (strcmp(token, t_table) != 0) {
     put_msg(ERROR, "Cannot create \"%s\".\n", token);
     return;
@@ -326,38 +426,62 @@ static void create_tbl() {
     skip_line();
     return;
   }
-  skip_line();
 
-  schema_p sch = get_schema(tbl_name);
+  char* attrs[MAX_ATTRS];
+  int num_attrs = 0;
+  schema_p sch = 0;
 
-  if (sch) {
+  /* table options between ')' and the end of the statement */
+  char rest_of_line[MAX_LINE_WIDTH] = "";
+  tbl_layout layout = ROW_LAYOUT;
+  if (fgets(rest_of_line, MAX_LINE_WIDTH, in_s)) {
+    char* opt;
+    for (opt = strtok(rest_of_line, " \t\n;");
+         opt && opt[0] != '#';
+         opt = strtok(NULL, " \t\n;")) {
+      if (strcmp(opt, t_pax) == 0) {
+        layout = PAX_LAYOUT;
+      } else if (strcmp(opt, t_columnar) == 0) {
+        layout = COL_LAYOUT;
+      } else {
+        put_msg(ERROR, "create table %s: unknown option \"%s\"\n",
+                tbl_name, opt);
+        goto abort_create;
+      }
+    }
+  }
+
+  if (get_schema(tbl_name)) {
     put_msg(ERROR, "Table \"%s\" already exists.\n", tbl_name);
-    return;
+    goto abort_create;
   }
 
-  char* attrs[MAX_ATTRS];
-  int num_attrs = str_split(attrs_str, ',', attrs, MAX_ATTRS, 1);
+  num_attrs = str_split(attrs_str, ',', attrs, MAX_ATTRS, 1);
   if (num_attrs == 0) {
     put_msg(ERROR, "create table %s: incorrect attributes\n", tbl_name);
-    return;
+    goto abort_create;
   }
 
   sch = new_schema(tbl_name);
+  /* the fields have to fit in a page with the layout */
+  set_schema_layout(sch, layout);
 
   char attr_name[MAX_TOKEN_LEN], attr_type[MAX_TOKEN_LEN];
   int str_attr_len;
 
   for (int i = 0; i < num_attrs; i++) {
-    if (sscanf(attrs[i], "%s%s", attr_name, attr_type) != 2) {
+    if (sscanf(attrs[i], "%31s%31s", attr_name, attr_type) != 2) {
       put_msg(ERROR, "create table %s: incorrect attribute \"%s\"\n",
 	      tbl_name, attrs[i]);
       goto abort_create;
     }
 
     if (strcmp(attr_type, t_int) == 0) {
-      add_field(sch, new_int_field(attr_name));
+      if (!add_field(sch, new_int_field(attr_name)))
+        goto abort_create;
     } else if (sscanf(attr_type, "str[%d]", &str_attr_len) == 1) {
-      add_field(sch, new_str_field(attr_name, str_attr_len));
+      if (!add_field(sch, new_str_field(attr_name, str_attr_len)))
+        goto abort_create;
     } else {
       put_msg(ERROR, "create table %s: unknown type \"%s\" for attribute \"%s\"\n",
 	      tbl_name, attr_type, attr_name);
@@ -366,6 +490,7 @@ static void create_tbl() {
   }
 
   release_strs(attrs, num_attrs);
+  save_table(get_table(tbl_name));
   return;
 
  abort_create:
@@ -493,7 +618,8 @@ static void insert_row() {
 /** A selector descriptor contains the elements of a "select" statement.
 */
 typedef struct select_desc {
-  tbl_p from_tbl, right_tbl;
+  tbl_p tbls[MAX_JOIN_TBLS]; /* the from table, then the ones joined */
+  int num_tbls;
   char where_attr[MAX_TOKEN_LEN], where_op[3];
   int where_val;
   int num_attrs;
@@ -506,8 +632,7 @@ static select_desc* new_select_desc() {
   slct->where_attr[0] = '\0';
   slct->where_op[0] = '\0';
   slct->num_attrs = 0;
-  slct->from_tbl = 0;
-  slct->right_tbl = 0;
+  slct->num_tbls = 0;
   return slct;
 }
 
@@ -517,6 +642,19 @@ static void release_select_desc(select_desc* slct) {
   free(slct); slct = 0;
 }
 
+/* parse "attr op int_val" of a where clause, attr of MAX_TOKEN_LEN */
+static int parse_where(char const* where_str,
+                       char* attr, char* op, int* val) {
+  char op_str[MAX_TOKEN_LEN];
+  if (sscanf(where_str, "%31s %31s %d", attr, op_str, val) != 3
+      || strlen(op_str) > 2) {
+    put_msg(ERROR, "query \"%s\" is not supported.\n", where_str);
+    return 0;
+  }
+  strcpy(op, op_str);
+  return 1;
+}
+
 static select_desc* parse_select() {
   select_desc *slct = new_select_desc();
   char in_str[MAX_LINE_WIDTH] = "";
@@ -536,13 +674,13 @@ static select_desc* parse_select() {
   }
   *p = '\0';
   p += 6;
-  if (sscanf(p, "%s", from_str) != 1) {
+  if (sscanf(p, "%31s", from_str) != 1) {
     put_msg(ERROR, "select from what?\n");
     release_select_desc(slct);
     return 0;
   }
-  slct->from_tbl = get_table(from_str);
-  if (!slct->from_tbl) {
+  slct->tbls[0] = get_table(from_str);
+  if (!slct->tbls[0]) {
     put_msg(ERROR, "select: table \"%s\" does not exist.\n", from_str);
     release_select_desc(slct);
     return 0;
@@ -555,30 +693,41 @@ static select_desc* parse_select() {
     return 0;
   }
 
+  slct->num_tbls = 1;
+
   p += strlen(from_str);
-  join_str = strstr(p, " natural join ");
-  if (join_str) {
+  /* from a natural join b natural join c ... */
+  while ((join_str = strstr(p, " natural join "))) {
     join_str += 14;
     put_msg(DEBUG, "from: \"%s\", natural join: \"%s\"\n",
             from_str, join_str);
-    if (sscanf(join_str, "%s", join_with) != 1) {
+    if (sscanf(join_str, "%31s", join_with) != 1) {
       put_msg(ERROR, "natural join with \"%s\" is not supported.\n",
               join_str);
       release_select_desc(slct);
       return 0;
     }
-    if (strcmp(from_str, join_str) == 0) {
-      put_msg(ERROR, "natural join on same table is not supported.\n");
+    if (slct->num_tbls == MAX_JOIN_TBLS) {
+      put_msg(ERROR, "natural join of more than %d tables"
+              " is not supported.\n", MAX_JOIN_TBLS);
       release_select_desc(slct);
       return 0;
     }
-    slct->right_tbl = get_table(join_with);
-    if (!slct->right_tbl) {
+    tbl_p tbl = get_table(join_with);
+    if (!tbl) {
       put_msg(ERROR, "natural join: table \"%s\" does not exist.\n",
               join_with);
       release_select_desc(slct);
       return 0;
     }
+    for (int i = 0; i < slct->num_tbls; i++)
+      if (slct->tbls[i] == tbl) {
+        put_msg(ERROR, "natural join on same table is not supported.\n");
+        release_select_desc(slct);
+        return 0;
+      }
+    slct->tbls[slct->num_tbls++] = tbl;
+    p = join_str + strlen(join_with);
   }
 
   where_str = strstr(p, " where ");
@@ -587,10 +736,8 @@ static select_desc* parse_select() {
   put_msg(DEBUG, "from: \"%s\", where: \"%s\"\n", from_str, where_str);
 
   if (where_str) {
-    if (sscanf(where_str, "%s %s %d",
-               slct->where_attr, slct->where_op, &slct->where_val)
-        != 3) {
-      put_msg(ERROR, "query \"%s\" is not supported.\n", where_str);
+    if (!parse_where(where_str,
+                     slct->where_attr, slct->where_op, &slct->where_val)) {
       release_select_desc(slct);
       return 0;
     }
@@ -600,45 +747,125 @@ static select_desc* parse_select() {
 
 static void select_rows() {
   select_desc *slct = parse_select();
-  tbl_p where_tbl = 0, res_tbl = 0, join_tbl = 0;
 
   if (!slct) return;
 
-  if (slct->right_tbl) {
-    join_tbl = table_natural_join(slct->from_tbl, slct->right_tbl);
-    if (!join_tbl) {
-      release_select_desc(slct);
-      return;
-    }
-  }
+  int has_where = slct->where_attr[0] != '\0' && slct->where_op[0] != '\0';
+  int is_count = slct->num_attrs == 1 && strcmp(slct->attrs[0], t_count) == 0;
 
-  if (slct->where_attr[0] != '\0' && slct->where_op[0] != '\0') {
-    where_tbl = table_search(join_tbl ? join_tbl : slct->from_tbl,
-                             slct->where_attr,
-                             slct->where_op,
-                             slct->where_val,
-                             b_search);
-    if (!where_tbl) {
-      release_select_desc(slct);
-      return;
-    }
+  /* a count needs no records, e.g. with a bitmap index */
+  if (is_count && slct->num_tbls == 1) {
+    int n = table_count(slct->tbls[0], has_where ? slct->where_attr : 0,
+                        slct->where_op, slct->where_val);
+    if (n >= 0)
+      put_msg(FORCE, "%20s\n%20s\n%20d\n\n", t_count, "--------", n);
+    release_select_desc(slct);
+    return;
   }
 
-  if (slct->attrs[0][0] == '*')
-    table_display(where_tbl ? where_tbl
-                  : (join_tbl ? join_tbl : slct->from_tbl));
+  /* the records stream through the plan, from the scans to the display.
+     The where condition goes down to the scans of the tables that have
+     its field, ahead of the joins, which go in the cheapest order. */
+  plan_p plan;
+  if (slct->num_tbls > 1)
+    plan = plan_natural_joins(slct->num_tbls, slct->tbls,
+                              has_where ? slct->where_attr : 0,
+                              slct->where_op, slct->where_val);
   else {
-    res_tbl = table_project(where_tbl ? where_tbl : slct->from_tbl,
-                            slct->num_attrs, slct->attrs);
-    table_display(res_tbl);
+    plan = plan_scan(slct->tbls[0], 0, 0, 0);
+    if (has_where)
+      plan = plan_filter(plan, slct->where_attr, slct->where_op,
+                         slct->where_val);
   }
 
-  remove_table(join_tbl);
-  remove_table(where_tbl);
-  remove_table(res_tbl);
+  if (is_count) {
+    int n = plan_count(plan);
+    if (n >= 0)
+      put_msg(FORCE, "%20s\n%20s\n%20d\n\n", t_count, "--------", n);
+  } else {
+    if (slct->attrs[0][0] != '*')
+      plan = plan_project(plan, slct->num_attrs, slct->attrs);
+    plan_display(plan);
+  }
+
+  plan_release(plan);
   release_select_desc(slct);
 }
 
+/* update table_name set attr = val [where attr op int_val]; */
+static void update_rows() {
+  char in_str[MAX_LINE_WIDTH] = "";
+  char tbl_name[MAX_TOKEN_LEN], set_attr[MAX_TOKEN_LEN];
+  char set_val[MAX_LINE_WIDTH], where_attr[MAX_TOKEN_LEN], where_op[3];
+  int where_val;
+
+  if (!read_till(in_str, ';')) {
+    error_near("update ");
+    return;
+  }
+  skip_line();
+
+  char *where_str = strstr(in_str, " where ");
+  if (where_str) {
+    *where_str = '\0';
+    where_str += 7;
+  }
+  char set_str[MAX_TOKEN_LEN];
+  if (sscanf(in_str, "%31s %31s %31[^= ] = %511s",
+             tbl_name, set_str, set_attr, set_val) != 4
+      || strcmp(set_str, t_set) != 0) {
+    put_msg(ERROR, "update %s: expecting \"set attr = val\".\n", in_str);
+    return;
+  }
+  tbl_p tbl = get_table(tbl_name);
+  if (!tbl) {
+    put_msg(ERROR, "update: table \"%s\" does not exist.\n", tbl_name);
+    return;
+  }
+  if (where_str && !parse_where(where_str, where_attr, where_op, &where_val))
+    return;
+
+  int n = table_update(tbl, set_attr, set_val,
+                       where_str ? where_attr : 0, where_op, where_val);
+  if (n >= 0)
+    put_msg(INFO, "%d record(s) updated in \"%s\".\n", n, tbl_name);
+}
+
+/* delete from table_name [where attr op int_val]; */
+static void delete_rows() {
+  char in_str[MAX_LINE_WIDTH] = "";
+  char from_str[MAX_TOKEN_LEN], tbl_name[MAX_TOKEN_LEN];
+  char where_attr[MAX_TOKEN_LEN], where_op[3];
+  int where_val;
+
+  if (!read_till(in_str, ';')) {
+    error_near("delete ");
+    return;
+  }
+  skip_line();
+
+  char *where_str = strstr(in_str, " where ");
+  if (where_str) {
+    *where_str = '\0';
+    where_str += 7;
+  }
+  if (sscanf(in_str, "%31s %31s", from_str, tbl_name) != 2
+      || strcmp(from_str, t_from) != 0) {
+    put_msg(ERROR, "delete %s: delete from which table?\n", in_str);
+    return;
+  }
+  tbl_p tbl = get_table(tbl_name);
+  if (!tbl) {
+    put_msg(ERROR, "delete: table \"%s\" does not exist.\n", tbl_name);
+    return;
+  }
+  if (where_str && !parse_where(where_str, where_attr, where_op, &where_val))
+    return;
+
+  int n = table_delete(tbl, where_str ? where_attr : 0, where_op, where_val);
+  if (n >= 0)
+    put_msg(INFO, "%d record(s) deleted from \"%s\".\n", n, tbl_name);
+}
 
 void interpret(int argc, char* argv[]) {
   if (!init_with_options(argc, argv))
@@ -671,6 +898,10 @@ void interpret(int argc, char* argv[]) {
       { insert_row(); continue; }
     if (strcmp(token, t_select) == 0)
       { select_rows(); continue; }
+    if (strcmp(token, t_update) == 0)
+      { update_rows(); continue; }
+    if (strcmp(token, t_delete) == 0)
+      { delete_rows(); continue; }
     error_near(token);
   }
 }
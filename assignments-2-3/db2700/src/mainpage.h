@@ -20,6 +20,17 @@
  * also handles table operations including
  * @ref table_display "display", @ref table_search "search" and
  * @ref table_project "project" of a table.
+ * A query of the frontend runs as a @ref plan_scan "query plan", whose
+ * nodes pass the records on one at a time instead of writing
+ * intermediate tables. A @ref plan_natural_join "natural join" looks up
+ * the records of a large right table with its index for a few left records,
+ * and merges inputs that are sorted on the shared field. Otherwise it reads
+ * the smaller input into a hash table in memory, or partitions both inputs
+ * into temporary tables when the table would not fit in its
+ * @ref set_join_mem_budget "memory budget", see
+ * @ref set_join_method "set_join_method()". A chain of
+ * @ref plan_natural_joins "natural joins" is taken in the order that
+ * reads the fewest blocks by the statistics of the tables.
  *
  * A database user can run SQL-like commands through a
  * @ref front.c "frontend".
@@ -48,6 +48,16 @@ then a series of records, and finally free space.
 The header includes:
  - bytes 0-3: header size
  - bytes 4-7: position of the beginning of the unused space
+ - bytes 8-11: number of records stored in the page, or number of slots
+   (including freed ones) of a slotted page
+ - bytes 12-15: beginning of the slot directory of a slotted page,
+   0 when the page has no slot directory
+
+A slotted page stores records of any length one after another from the
+header, and the slot directory grows from the end of the block towards the
+records. Slot i (the i-th @ref SLOT_SIZE bytes from the end) holds the
+position and the length of the i-th record of the page, so that a record
+keeps its (block, slot) identity when the page is compacted.
  - possibly some more, for example, when implementing variable-length records,
    file as linked list of blocks, or lsn for write-ahead logging
 */
@@ -91,6 +101,11 @@ static struct {
   int num_disk_writes; /**< number of disk writes after the reset of pager profiler */
   int last_fd;     /** fd of the last visited block, used to check if a new seek is needed */
   int last_blk_nr; /** nr of the last visited block, used to check if a new seek is needed */
+  struct {
+    char const* event; /**< description of the event */
+    int count;         /**< number of events after the reset of pager profiler */
+  } events[MAX_PROFILER_EVENTS]; /**< events counted by the users of the pager */
+  int num_events;
 } pager_profiler;
 
 
@@ -182,6 +197,9 @@ void put_pager_info(pmsg_level level,  char const* msg) {
 }
 
 void put_pager_profiler_info(pmsg_level level) {
+  for (int i = 0; i < pager_profiler.num_events; i++)
+    put_msg(level, "Number of %s: %d\n",
+            pager_profiler.events[i].event, pager_profiler.events[i].count);
   put_msg(level, "Number of disk seeks/reads/writes/IOs: %d/%d/%d/%d\n",
           pager_profiler.num_seeks,
           pager_profiler.num_disk_reads,
@@ -220,6 +238,30 @@ void pager_profiler_reset(void) {
   pager_profiler.num_disk_writes = 0;
   pager_profiler.last_fd = -1;
   pager_profiler.last_blk_nr = -1;
+  for (int i = 0; i < pager_profiler.num_events; i++)
+    pager_profiler.events[i].count = 0;
+}
+
+int pager_profiler_reads(void) {
+  return pager_profiler.num_disk_reads;
+}
+
+void pager_profiler_count(char const* event, int n) {
+  int i;
+  for (i = 0; i < pager_profiler.num_events; i++)
+    if (strcmp(pager_profiler.events[i].event, event) == 0)
+      break;
+  if (i == pager_profiler.num_events) {
+    if (i == MAX_PROFILER_EVENTS) {
+      put_msg(WARN, "pager_profiler_count: too many events, \"%s\" ignored\n",
+              event);
+      return;
+    }
+    pager_profiler.events[i].event = event;
+    pager_profiler.events[i].count = 0;
+    pager_profiler.num_events++;
+  }
+  pager_profiler.events[i].count += n;
 }
 
 int set_system_dir(char const* dir) {
@@ -318,6 +360,62 @@ static void set_page_free_pos_from_content(page_p p) {
   p->free_pos = get_header_int_at(p, 4);
 }
 
+int page_free_pos(page_p p) {
+  if (!p) {
+    put_msg(ERROR, "page_free_pos: NULL page.\n");
+    return -1;
+  }
+  return p->free_pos;
+}
+
+int page_set_free_pos(page_p p, int pos) {
+  if (!p) {
+    put_msg(ERROR, "page_set_free_pos: NULL page.\n");
+    return 0;
+  }
+  if (pos < PAGE_HEADER_SIZE || pos > BLOCK_SIZE) {
+    put_msg(ERROR, "page_set_free_pos: pos %d out of range [%d,%ld]\n",
+            pos, PAGE_HEADER_SIZE, BLOCK_SIZE);
+    return 0;
+  }
+  set_page_free_pos(p, pos);
+  return 1;
+}
+
+int page_num_records(page_p p) {
+  if (!p) {
+    put_msg(ERROR, "page_num_records: NULL page.\n");
+    return -1;
+  }
+  return get_header_int_at(p, 8);
+}
+
+void page_set_num_records(page_p p, int n) {
+  if (!p) {
+    put_msg(ERROR, "page_set_num_records: NULL page.\n");
+    return;
+  }
+  put_header_int_at(p, 8, n);
+}
+
+/* The slot directory grows downwards from the end of the block. */
+static int get_page_slots_pos(page_p p) {
+  int pos = get_header_int_at(p, 12);
+  return pos == 0 ? BLOCK_SIZE : pos;
+}
+
+static void set_page_slots_pos(page_p p, int pos) {
+  put_header_int_at(p, 12, pos);
+}
+
+int page_free_space(page_p p) {
+  if (!p) {
+    put_msg(ERROR, "page_free_space: NULL page.\n");
+    return -1;
+  }
+  return get_page_slots_pos(p) - p->free_pos;
+}
+
 static void init_page(page_p p) {
   if (!p) return;
   memset(p->content, 0, BLOCK_SIZE);
@@ -531,12 +629,50 @@ static fhandle_p get_tbl_file(char const* fname) {
   return file_handles[file_i];
 }
 
+/* forward declaration */
+static void close_tbl_file(fhandle_p fhandle);
+
+/* Search the global file_handles[] for a file that has no block pinned
+   to a buffer page, preferably one without any buffered block at all.
+   If all open files have pinned blocks, take the file of the least recently
+   used pinned page, just as available_page() does with pages.
+   Returns -1 if there is no open file.
+*/
+static int get_idle_fhandle_i() {
+  int idle_i = -1, idle_blocks = NUM_PAGES + 1;
+  for (size_t i = 0; i < MAX_OPEN_FILES; i++) {
+    fhandle_p fh = file_handles[i];
+    if (!fh) continue;
+    int num_in_mem = 0, pinned = 0;
+    for (size_t j = 0; j < NUM_PAGES; j++)
+      if (fh->blocks_in_mem[j]) {
+        num_in_mem++;
+        if (fh->blocks_in_mem[j]->page->pinned) pinned = 1;
+      }
+    if (!pinned && num_in_mem < idle_blocks) {
+      idle_i = i;
+      idle_blocks = num_in_mem;
+    }
+  }
+  if (idle_i == -1 && q_pinned->first)
+    idle_i = find_fhandle_i(q_pinned->first->page->block->fhandle->fname);
+  return idle_i;
+}
+
 static fhandle_p open_tbl_file(char const* fname) {
   if (num_file_handles == MAX_OPEN_FILES) {
-    put_msg(WARN,
-            "Cannot open file %s because the limit %d of open files has reached.\n",
-            fname, MAX_OPEN_FILES);
-    return 0;
+    /* a table stored as one file per column easily reaches the limit,
+       so make room by closing a file that is not in use */
+    int idle_i = get_idle_fhandle_i();
+    if (idle_i == -1) {
+      put_msg(WARN,
+              "Cannot open file %s because the limit %d of open files has reached.\n",
+              fname, MAX_OPEN_FILES);
+      return 0;
+    }
+    put_msg(DEBUG, "open_tbl_file: closing idle file %s.\n",
+            file_handles[idle_i]->fname);
+    close_tbl_file(file_handles[idle_i]);
   }
 
   int fd = open(fname, O_RDWR, 0);
@@ -580,8 +716,17 @@ static void release_block(block_p b);
 static void close_tbl_file(fhandle_p fhandle) {
   if (!fhandle) return;
   for (size_t i = 0; i < NUM_PAGES; i++) {
-    if (fhandle->blocks_in_mem[i])
-      release_block(fhandle->blocks_in_mem[i]);
+    block_p b = fhandle->blocks_in_mem[i];
+    if (b) {
+      page_p pg = b->page;
+      release_block(b);
+      /* the page becomes unused, so that available_page() finds it */
+      if (pg->qelm) {
+        pq_remove(q_unpinned, pg->qelm);
+        free(pg->qelm);
+      }
+      init_page(pg);
+    }
   }
   if (close(fhandle->fd) == 0) {
     int file_i = find_fhandle_i(fhandle->fname);
@@ -669,11 +814,13 @@ int peof(page_p p) {
   return (is_last_block(p->block) && eop(p));
 }
 
-/** Release a block (and unpinn). */
+/** Release a block (and unpinn). A dirty page is written back. */
 static void release_block(block_p b) {
   if (!b) return;
   if (b->page->pinned)
     unpin(b->page);
+  else if (b->page->dirty)
+    write_page(b->page);
   remove_blk_from_fhandle(b);
   if (b->fhandle->current_block == b)
     b->fhandle->current_block = 0;
@@ -778,6 +925,11 @@ page_p get_page(char const* fname, int blknr) {
     }
     set_blk_in_fhandle(fh, blk);
     blk->page->current_pos = PAGE_HEADER_SIZE;
+  } else if (!blk->page->pinned) {
+    /* a buffered page is pinned too, or it may be given to another block
+       while the caller holds it */
+    pq_turn_pinned(blk->page);
+    blk->page->pinned = 1;
   }
   /* put_msg (DEBUG, "get_page: blk %d, page %d\n",
      blk->blk_nr, blk->page->page_nr); */
@@ -853,9 +1005,12 @@ int read_page(page_p p) {
   }
   int bytes_read = read(fd, p->content, BLOCK_SIZE);
   if (bytes_read == -1) return 0;
-  if (bytes_read == 0)
+  if (bytes_read == 0) {
+    /* a new block: the page may still hold the content of a released block */
+    memset(p->content, 0, BLOCK_SIZE);
+    init_page_header_size(p);
     set_page_free_pos(p, PAGE_HEADER_SIZE);
-  else {
+  } else {
     inc_num_reads(fd, p->block->blk_nr);
     check_page_header_size(p);
     set_page_free_pos_from_content(p);
@@ -959,7 +1114,7 @@ int page_valid_pos_for_get(page_p p, int offset) {
 
 int page_valid_pos_for_put(page_p p, int offset, int len) {
   if (offset >= PAGE_HEADER_SIZE && offset <= p->free_pos
-      && offset <= BLOCK_SIZE - len)
+      && offset <= get_page_slots_pos(p) - len)
     return 1;
   return 0;
 }
@@ -982,7 +1137,9 @@ int page_get_int(page_p p) {
     put_msg(FATAL, "page_get_int\n");
     exit(EXIT_FAILURE);
   }
-  int res = (int) *((int *)((p->content) + p->current_pos));
+  int res;
+  /* the int may follow a str, e.g. in the catalog, and be misaligned */
+  memcpy(&res, p->content + p->current_pos, INT_SIZE);
   p->current_pos += INT_SIZE;
   return res;
 }
@@ -1002,7 +1159,8 @@ int page_get_int_at(page_p p, int offset) {
     put_msg(FATAL, "page_get_int_at\n");
     exit(EXIT_FAILURE);
   }
-  int res = (int) *((int *)((p->content) + offset));
+  int res;
+  memcpy(&res, p->content + offset, INT_SIZE);
   p->current_pos += INT_SIZE;
   return res;
 }
@@ -1056,3 +1214,145 @@ int page_put_str_at(page_p p, int offset, char const* str, int len) {
   set_pos_after_put(p, offset + len);
   return 1;
 }
+
+/* A slot holds the position of the record in the upper and its length in
+   the lower half. A freed slot is marked with SLOT_FREED and keeps its
+   position until the page is compacted. */
+#define SLOT_FREED 0x8000
+#define SLOT(pos, len) (((pos) << 16) | (len))
+#define SLOT_POS(slot) ((slot) >> 16)
+#define SLOT_LEN(slot) ((slot) & 0x7fff)
+
+static int slot_offset(int slot_nr) {
+  return BLOCK_SIZE - (slot_nr + 1) * SLOT_SIZE;
+}
+
+static int get_slot(page_p p, int slot_nr) {
+  return (int) *((int *)((p->content) + slot_offset(slot_nr)));
+}
+
+static void set_slot(page_p p, int slot_nr, int slot) {
+  memcpy(p->content + slot_offset(slot_nr), (char *) &slot, SLOT_SIZE);
+  p->dirty = 1;
+}
+
+static int valid_slot_nr(page_p p, int slot_nr, char const* caller) {
+  if (!p) {
+    put_msg(ERROR, "%s: NULL page.\n", caller);
+    return 0;
+  }
+  if (slot_nr < 0 || slot_nr >= page_num_records(p)) {
+    put_msg(ERROR, "%s: slot %d out of range [0,%d)\n",
+            caller, slot_nr, page_num_records(p));
+    return 0;
+  }
+  return 1;
+}
+
+int page_slot_pos(page_p p, int slot_nr) {
+  if (!valid_slot_nr(p, slot_nr, "page_slot_pos")) return 0;
+  int slot = get_slot(p, slot_nr);
+  return (slot & SLOT_FREED) ? 0 : SLOT_POS(slot);
+}
+
+int page_slot_len(page_p p, int slot_nr) {
+  if (!valid_slot_nr(p, slot_nr, "page_slot_len")) return 0;
+  int slot = get_slot(p, slot_nr);
+  return (slot & SLOT_FREED) ? 0 : SLOT_LEN(slot);
+}
+
+/* Number of bytes that compacting the page would make free */
+static int page_reclaimable_space(page_p p) {
+  int used = 0, n = page_num_records(p);
+  for (int i = 0; i < n; i++)
+    if (!(get_slot(p, i) & SLOT_FREED))
+      used += SLOT_LEN(get_slot(p, i));
+  return p->free_pos - PAGE_HEADER_SIZE - used;
+}
+
+void page_compact(page_p p) {
+  if (!p) {
+    put_msg(ERROR, "page_compact: NULL page.\n");
+    return;
+  }
+  char old_content[BLOCK_SIZE];
+  memcpy(old_content, p->content, BLOCK_SIZE);
+  int pos = PAGE_HEADER_SIZE, n = page_num_records(p);
+  for (int i = 0; i < n; i++) {
+    int slot = get_slot(p, i);
+    if (slot & SLOT_FREED) {
+      set_slot(p, i, SLOT_FREED);
+      continue;
+    }
+    memcpy(p->content + pos, old_content + SLOT_POS(slot), SLOT_LEN(slot));
+    set_slot(p, i, SLOT(pos, SLOT_LEN(slot)));
+    pos += SLOT_LEN(slot);
+  }
+  set_page_free_pos(p, pos);
+}
+
+/* Copy the record to the beginning of the free space, compacting the page
+   first if needed. Returns the position of the copy, 0 if it does not fit. */
+static int put_slot_record(page_p p, char const* rec, int len, int extra) {
+  if (page_free_space(p) < len + extra) {
+    if (page_free_space(p) + page_reclaimable_space(p) < len + extra)
+      return 0;
+    page_compact(p);
+  }
+  int pos = p->free_pos;
+  memcpy(p->content + pos, rec, len);
+  set_page_free_pos(p, pos + len);
+  return pos;
+}
+
+int page_add_slot(page_p p, char const* rec, int len) {
+  if (!p) {
+    put_msg(ERROR, "page_add_slot: NULL page.\n");
+    return -1;
+  }
+  int n = page_num_records(p);
+  if (n == 0 && get_header_int_at(p, 12) == 0) {
+    if (p->free_pos != PAGE_HEADER_SIZE) {
+      put_msg(ERROR, "page_add_slot: page %d is not a slotted page.\n",
+              p->page_nr);
+      return -1;
+    }
+    set_page_slots_pos(p, BLOCK_SIZE);
+  }
+  int pos = put_slot_record(p, rec, len, SLOT_SIZE);
+  if (!pos) return -1;
+  set_page_slots_pos(p, slot_offset(n));
+  set_slot(p, n, SLOT(pos, len));
+  page_set_num_records(p, n + 1);
+  return n;
+}
+
+int page_free_slot(page_p p, int slot_nr) {
+  if (!valid_slot_nr(p, slot_nr, "page_free_slot")) return 0;
+  int slot = get_slot(p, slot_nr);
+  if (slot & SLOT_FREED) return 0;
+  set_slot(p, slot_nr, slot | SLOT_FREED);
+  return 1;
+}
+
+int page_resize_slot(page_p p, int slot_nr, char const* rec, int len) {
+  if (!valid_slot_nr(p, slot_nr, "page_resize_slot")) return 0;
+  int slot = get_slot(p, slot_nr);
+  if (slot & SLOT_FREED) {
+    put_msg(ERROR, "page_resize_slot: slot %d has been freed.\n", slot_nr);
+    return 0;
+  }
+  int pos = SLOT_POS(slot);
+  if (len > SLOT_LEN(slot)) {
+    /* free the old copy so that compaction can reclaim it */
+    set_slot(p, slot_nr, slot | SLOT_FREED);
+    pos = put_slot_record(p, rec, len, 0);
+    if (!pos) {
+      set_slot(p, slot_nr, get_slot(p, slot_nr) & ~SLOT_FREED);
+      return 0;
+    }
+  } else
+    memcpy(p->content + pos, rec, len);
+  set_slot(p, slot_nr, SLOT(pos, len));
+  return 1;
+}
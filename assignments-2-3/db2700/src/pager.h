@@ -36,6 +36,12 @@
  * To access a value at a particular position,
  * use @ref page_get_int_at "page_get_x_at()" and @ref page_put_int_at "page_put_x_at()".
  *
+ * A @em slotted page holds records of any length, each identified by its
+ * slot number in the page. Add a record with @ref page_add_slot
+ * "page_add_slot()", find it with @ref page_slot_pos "page_slot_pos()",
+ * and free or resize it with @ref page_free_slot "page_free_slot()" and
+ * @ref page_resize_slot "page_resize_slot()".
+ *
  * @ref put_block_info "put_..._info()" are useful for printing out various info
  * during debugging.
  *
@@ -67,6 +73,12 @@
 /** an integer consists of 4 bytes */
 #define INT_SIZE 4
 
+/** max number of kinds of events counted by the pager profiler */
+#define MAX_PROFILER_EVENTS 8
+
+/** an entry of the slot directory of a slotted page consists of 4 bytes */
+#define SLOT_SIZE 4
+
 typedef struct block_struct * block_p;
 typedef struct page_struct * page_p;
 
@@ -101,6 +113,14 @@ extern void pager_terminate(void);
 
 /** Reset th pager profiler */
 extern void pager_profiler_reset(void);
+/** Return the number of disk reads since the pager profiler was reset. */
+extern int pager_profiler_reads(void);
+/** Count @em n events of a kind the pager does not know about, such as
+blocks that were not read thanks to some access structure. @em event
+describes the events and must remain valid; the counts are printed by
+put_pager_profiler_info() and reset by pager_profiler_reset().
+*/
+extern void pager_profiler_count(char const* event, int n);
 
 /** Get a page for a file block.
 A block is identified by the file and the block number @em blknr
@@ -150,6 +170,23 @@ enum whence{
 };
 extern int page_seek(page_p p, int whence, int offset);
 
+/** Return the beginning of the free space of the page. */
+extern int page_free_pos(page_p p);
+/** Move the beginning of the free space to @em pos.
+Useful when a page is partitioned in advance, for example,
+into a minipage per field. Returns 0 if @em pos is out of range.
+*/
+extern int page_set_free_pos(page_p p, int pos);
+/** Return the number of records stored in the page (kept in the page header).
+For a slotted page, this is the number of slots, including freed ones. */
+extern int page_num_records(page_p p);
+/** Set the number of records stored in the page. */
+extern void page_set_num_records(page_p p, int n);
+
+/** Return the number of free bytes between the records and the
+slot directory of the page. */
+extern int page_free_space(page_p p);
+
 /** Check if @em offset is valid for getting a value */
 extern int page_valid_pos_for_get(page_p p, int offset);
 /** Check if @em offset is valid for putting a value with lenth @em len */
@@ -201,4 +238,28 @@ Returns 0 if fails (@em offset out of range).
 */
 extern int page_put_str_at(page_p p, int offset, char const* str, int len);
 
+/** Add a slot for the record @em rec of length @em len to a slotted page.
+The page becomes a slotted page if it is empty.
+The page is compacted if that is needed to make room for the record.
+Returns the slot number, or -1 if there is not enough space in the page.
+*/
+extern int page_add_slot(page_p p, char const* rec, int len);
+/** Return the position of the record of slot @em slot_nr,
+0 if the slot has been freed. */
+extern int page_slot_pos(page_p p, int slot_nr);
+/** Return the length of the record of slot @em slot_nr,
+0 if the slot has been freed. */
+extern int page_slot_len(page_p p, int slot_nr);
+/** Free slot @em slot_nr. The slot number is not reused, so that the
+slot numbers of the other records do not change.
+Returns 0 if the slot is already freed. */
+extern int page_free_slot(page_p p, int slot_nr);
+/** Replace the record of slot @em slot_nr with @em rec of length @em len,
+in place if it is not longer than the old record.
+Returns 0 if there is not enough space in the page. */
+extern int page_resize_slot(page_p p, int slot_nr, char const* rec, int len);
+/** Move the records of a slotted page together, so that the space of
+freed and resized records becomes free space. */
+extern void page_compact(page_p p);
+
 #endif
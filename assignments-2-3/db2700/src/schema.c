@@ -5,17 +5,68 @@
  ************************************************************/
 
 #include "schema.h"
+#include "bitmap.h"
+#include "btree.h"
+#include "hashidx.h"
 #include "pmsg.h"
 #include <string.h>
+#include <limits.h>
 
 static void display_record(record,schema_p);
 
+/* In a record stored with ROW_LAYOUT, a str field holds the position of its
+   value, relative to the record, in the upper and its length in the lower half.
+   The values follow the fields in the record. */
+#define STR_REF_SIZE INT_SIZE
+#define STR_REF(pos, len) (((pos) << 16) | (len))
+#define STR_REF_POS(ref) ((ref) >> 16)
+#define STR_REF_LEN(ref) ((ref) & 0xffff)
+
+#define AVG(x1,x2)  (x1+x2)/2 // < mean of two numbers
+
+/* states of the zone map of a table */
+#define ZM_UNLOADED 0 /**< not read from its file yet */
+#define ZM_NONE     1 /**< not available, e.g. the table has no int field */
+#define ZM_LOADED   2
+static char const* col_file(schema_p s, field_desc_p f);
+static int tbl_num_blocks(tbl_p t);
+static char const* zm_file(schema_p s);
+static void save_zone_map(tbl_p t);
+static void release_zone_map(tbl_p t);
+static void load_mem_indexes(tbl_p t);
+static void save_mem_indexes(tbl_p t);
+static void drop_fence_keys(field_desc_p f);
+static void drop_learned_index(field_desc_p f);
+
+/** @brief Segment of a learned index */
+typedef struct pla_segment_struct {
+  int key;      /**< smallest value the segment predicts the block of */
+  int blk;      /**< block of key */
+  double slope; /**< number of blocks per unit of the values */
+} pla_segment_struct;
+
 /** @brief Field descriptor */
 typedef struct field_desc_struct {
   char *name;        /**< field name */
   field_type type;   /**< field type */
   int len;           /**< field length (number of bytes) */
   int offset;        /**< offset from the beginning of the record */
+  int row_offset;    /**< offset in a record stored with ROW_LAYOUT,
+                          where a str field is a reference to its value */
+  char *col_fname;   /**< file of the field in a COL_LAYOUT table, or NULL */
+  int zm_idx;        /**< index of an int field among the int fields, -1 for str */
+  int sorted;        /**< whether the int values are in ascending order in the table */
+  int last_val;      /**< the int value of the record appended last */
+  int *fences;       /**< first value of every block of a sorted field, or NULL */
+  int num_fences;    /**< number of blocks in fences */
+  pla_segment_struct *pla; /**< learned index of a sorted field, or NULL */
+  int num_pla;       /**< number of segments in pla */
+  char *bt_fname;    /**< file of the B+-tree index of the field, or NULL */
+  char *hash_fname;  /**< file of the hash index of the field, or NULL */
+  char *bm_fname;    /**< file of the bitmap index of the field, or NULL */
+  bm_index *bm;      /**< the bitmap index, kept in memory */
+  char *bf_fname;    /**< file of the Bloom filters of the field, or NULL */
+  bloom_filters *bf; /**< the Bloom filters, kept in memory */
   field_desc_p next; /**< next field_desc of the table, NULL if no more */
 } field_desc_struct;
 
@@ -29,6 +80,9 @@ typedef struct schema_struct {
   field_desc_p last;    /**< last field_desc */
   int num_fields;       /**< number of fields in the table */
   int len;              /**< record length */
+  int row_len;          /**< length of a record stored with ROW_LAYOUT,
+                             not counting the str values */
+  int num_int_fields;   /**< number of int fields */
   tbl_p tbl;            /**< table descriptor */
 } schema_struct;
 
@@ -38,15 +92,88 @@ typedef struct schema_struct {
  */
 typedef struct tbl_desc_struct {
   schema_p sch;      /**< schema of this table. */
+  tbl_layout layout; /**< how records are laid out in the blocks. */
   int num_records;   /**< number of records this table has. */
+  int num_freed;     /**< number of slots freed by deleting records. */
   page_p current_pg; /**< current page being accessed. */
+  int current_rec;   /**< index of the current record in current_pg,
+                          or in the table with COL_LAYOUT. */
   tbl_p next;        /**< next tbl_desc in the database. */
+  tbl_p prev;        /**< previous tbl_desc in the database. */
+  tbl_p hash_next;   /**< next tbl_desc in the same bucket of the table index. */
+  int is_tmp;        /**< intermediate result, not kept when removed. */
+  int cat_idx;       /**< entry in the catalog, -1 if not saved yet. */
+  int loaded;        /**< whether the descriptor has been read from the catalog. */
+  int saved_num_records; /**< num_records in the catalog. */
+  int saved_num_freed;   /**< num_freed in the catalog. */
+  int saved_num_sorted;  /**< number of sorted fields in the catalog. */
+  int zm_state;      /**< whether the zone map is loaded, see @ref ZM_LOADED. */
+  int *zm;           /**< min and max of each int field, per block. */
+  int zm_num_blocks; /**< number of blocks in the zone map. */
+  int zm_max_blocks; /**< number of blocks allocated for the zone map. */
+  int zm_dirty_from; /**< first block whose zone map is not saved. */
+  char *zm_fname;    /**< file of the zone map, or NULL. */
 } tbl_desc_struct;
 
 
 /** @brief Database tables*/
 tbl_p db_tables; /**< a linked list of table descriptors */
 
+/** @brief Table index
+
+The tables of the database are also chained in buckets by the hash of their
+names, so that a table is found without walking through @ref db_tables.
+The number of buckets is doubled when there are more tables than buckets.
+*/
+static tbl_p *tbl_buckets = 0;
+static int num_tbl_buckets = 0;
+static int num_tables = 0;
+
+static unsigned tbl_name_hash(char const* name) {
+  unsigned h = 5381;
+  for (; *name; name++)
+    h = h * 33 + (unsigned char) *name;
+  return h;
+}
+
+static void index_table(tbl_p t) {
+  if (num_tables >= num_tbl_buckets) {
+    free(tbl_buckets);
+    num_tbl_buckets = num_tbl_buckets ? 2 * num_tbl_buckets : 64;
+    tbl_buckets = calloc(num_tbl_buckets, sizeof (tbl_p));
+    for (tbl_p tbl = db_tables; tbl; tbl = tbl->next)
+      if (tbl != t) {
+        unsigned b = tbl_name_hash(tbl->sch->name) % num_tbl_buckets;
+        tbl->hash_next = tbl_buckets[b];
+        tbl_buckets[b] = tbl;
+      }
+  }
+  unsigned b = tbl_name_hash(t->sch->name) % num_tbl_buckets;
+  t->hash_next = tbl_buckets[b];
+  tbl_buckets[b] = t;
+  num_tables++;
+}
+
+static void unindex_table(tbl_p t) {
+  tbl_p *pp = &tbl_buckets[tbl_name_hash(t->sch->name) % num_tbl_buckets];
+  for (; *pp; pp = &(*pp)->hash_next)
+    if (*pp == t) {
+      *pp = t->hash_next;
+      num_tables--;
+      return;
+    }
+}
+
+static tbl_p find_table(char const* name) {
+  if (!num_tbl_buckets) return 0;
+  for (tbl_p tbl = tbl_buckets[tbl_name_hash(name) % num_tbl_buckets];
+       tbl;
+       tbl = tbl->hash_next)
+    if (strcmp(name, tbl->sch->name) == 0)
+      return tbl;
+  return 0;
+}
+
 void put_field_info(pmsg_level level, field_desc_p f) {
   if (!f) {
     put_msg(level,  "  empty field\n");
@@ -58,6 +185,16 @@ void put_field_info(pmsg_level level, field_desc_p f) {
   else
     append_msg(level,  "str ");
   append_msg(level, "field, len: %d, offset: %d, ", f->len, f->offset);
+  if (is_int_field(f) && f->sorted)
+    append_msg(level, "sorted ");
+  if (f->bt_fname)
+    append_msg(level, "B+-tree indexed ");
+  if (f->hash_fname)
+    append_msg(level, "hash indexed ");
+  if (f->bm_fname)
+    append_msg(level, "bitmap indexed ");
+  if (f->bf_fname)
+    append_msg(level, "Bloom filtered");
   if (f->next)
     append_msg(level,  ", next field: %s\n", f->next->name);
   else
@@ -82,10 +219,15 @@ void put_tbl_info(pmsg_level level, tbl_p t) {
     put_msg(level,  "--empty tbl desc\n");
     return;
   }
+  static char const* const layout_names[] = {"row", "pax", "columnar"};
   put_schema_info(level, t->sch);
-  put_file_info(level, t->sch->name);
-  put_msg(level, " %d blocks, %d records\n",
-          file_num_blocks(t->sch->name), t->num_records);
+  if (t->layout == COL_LAYOUT)
+    for (field_desc_p f = t->sch->first; f; f = f->next)
+      put_file_info(level, col_file(t->sch, f));
+  else
+    put_file_info(level, t->sch->name);
+  put_msg(level, " %s layout, %d blocks, %d records\n",
+          layout_names[t->layout], tbl_num_blocks(t), t->num_records);
   put_msg(level, "----\n");
 }
 
@@ -110,7 +252,7 @@ void put_db_info(pmsg_level level) {
   if (!db_dir) return;
   put_msg(level, "======Database at %s:\n", db_dir);
   for (tbl_p tbl = db_tables; tbl; tbl = tbl->next)
-    put_tbl_info(level, tbl);
+    put_tbl_info(level, get_table(tbl->sch->name));
   put_msg(level, "======\n");
 }
 
@@ -120,6 +262,20 @@ field_desc_p new_int_field(char const* name) {
   res->type = INT_TYPE;
   res->len = INT_SIZE;
   res->offset = 0;
+  res->row_offset = 0;
+  res->col_fname = 0;
+  res->sorted = 1; /* as long as the table has no records */
+  res->last_val = INT_MIN;
+  res->fences = 0;
+  res->num_fences = 0;
+  res->pla = 0;
+  res->num_pla = 0;
+  res->bt_fname = 0;
+  res->hash_fname = 0;
+  res->bm_fname = 0;
+  res->bm = 0;
+  res->bf_fname = 0;
+  res->bf = 0;
   res->next = 0;
   return res;
 }
@@ -130,6 +286,20 @@ field_desc_p new_str_field(char const* name, int len) {
   res->type = STR_TYPE;
   res->len = len;
   res->offset = 0;
+  res->row_offset = 0;
+  res->col_fname = 0;
+  res->sorted = 0; /* not tracked for str fields */
+  res->last_val = INT_MIN;
+  res->fences = 0;
+  res->num_fences = 0;
+  res->pla = 0;
+  res->num_pla = 0;
+  res->bt_fname = 0;
+  res->hash_fname = 0;
+  res->bm_fname = 0;
+  res->bm = 0;
+  res->bf_fname = 0;
+  res->bf = 0;
   res->next = 0;
   return res;
 }
@@ -137,6 +307,15 @@ field_desc_p new_str_field(char const* name, int len) {
 static void release_field_desc(field_desc_p f) {
   if (f) {
     free(f->name);
+    free(f->col_fname);
+    free(f->bt_fname);
+    free(f->hash_fname);
+    free(f->bm_fname);
+    bmi_release(f->bm);
+    free(f->bf_fname);
+    bf_release(f->bf);
+    drop_fence_keys(f);
+    drop_learned_index(f);
     free(f);
     f = 0;
   }
@@ -162,6 +341,9 @@ static schema_p make_schema(char const* name) {
   res->last = 0;
   res->num_fields = 0;
   res->len = 0;
+  res->row_len = 0;
+  res->num_int_fields = 0;
+  res->tbl = 0;
   return res;
 }
 
@@ -225,7 +407,43 @@ int schema_len(schema_p sch) {
   }
 }
 
-const char tables_desc_file[] = "db.db"; /***< File holding table descriptors */
+tbl_layout schema_layout(schema_p sch) {
+  if (sch && sch->tbl)
+    return sch->tbl->layout;
+  else {
+    put_msg(ERROR, "schema_layout: NULL schema.\n");
+    return ROW_LAYOUT;
+  }
+}
+
+/** @b row_fits
+ * 
+ * returns true if a page holds a record with ROW_LAYOUT of row_len bytes
+ * of fields and references, and str values of at most len bytes, with
+ * its slot
+ */
+static int row_fits(int row_len, int len) {
+  return row_len + len + SLOT_SIZE <= BLOCK_SIZE - PAGE_HEADER_SIZE;
+}
+
+int set_schema_layout(schema_p sch, tbl_layout layout) {
+  if (!(sch && sch->tbl)) {
+    put_msg(ERROR, "set_schema_layout: NULL schema.\n");
+    return 0;
+  }
+  if (sch->tbl->num_records > 0) {
+    put_msg(ERROR, "set_schema_layout: \"%s\" already has records.\n",
+            sch->name);
+    return 0;
+  }
+  if (layout == ROW_LAYOUT && !row_fits(sch->row_len, sch->len)) {
+    put_msg(ERROR, "set_schema_layout: the records of \"%s\" are too long"
+            " for a page with ROW_LAYOUT.\n", sch->name);
+    return 0;
+  }
+  sch->tbl->layout = layout;
+  return 1;
+}
 
 /** @b concat_names
  * 
@@ -235,66 +453,348 @@ const char tables_desc_file[] = "db.db"; /***< File holding table descriptors */
  * @param sep
  */
 static char* concat_names(char const* name1, char const* sep, char const* name2) {
-  char *res = malloc((sizeof name1) + (sizeof sep) + (sizeof name2) + 1);
+  char *res = malloc(strlen(name1) + strlen(sep) + strlen(name2) + 1);
   strcpy(res, name1);
   strcat(res, sep);
   strcat(res, name2);
   return res;
 }
 
-static void save_tbl_desc(FILE *fp, tbl_p tbl) {
-  schema_p sch = tbl->sch;
-  fprintf(fp, "%s %d\n", sch->name, sch->num_fields);
-  field_desc_p fld = schema_first_fld_desc(sch);
-  while (fld) {
-    fprintf(fp, "%s %d %d %d\n",
-            fld->name, fld->type, fld->len, fld->offset);
-    fld = fld->next;
+/** @b field_file_name
+ * 
+ * returns the name of a file kept for field f, "table.field.ext"
+ */
+static char* field_file_name(schema_p s, field_desc_p f, char const* ext) {
+  char *tbl_fld = concat_names(s->name, ".", f->name);
+  char *res = concat_names(tbl_fld, ".", ext);
+  free(tbl_fld);
+  return res;
+}
+
+/* extensions of the files of the indexes, and their names, by index_kind */
+static char const* const index_exts[] = {"bt", "hash", "bm", "bf"};
+static char const* const index_names[] = {"B+-tree", "hash", "bitmap",
+                                          "Bloom filter"};
+
+/** @b index_fname
+ * 
+ * returns where field f keeps the file of its index of the kind,
+ * which is NULL if the field has no such index
+ */
+static char** index_fname(field_desc_p f, index_kind kind) {
+  switch (kind) {
+  case HASH_INDEX:   return &f->hash_fname;
+  case BITMAP_INDEX: return &f->bm_fname;
+  case BLOOM_FILTER: return &f->bf_fname;
+  default:           return &f->bt_fname;
+  }
+}
+
+/** @brief Catalog
+
+The catalog consists of two files that are accessed through the pager:
+ - the directory @ref catalog_dir_file, an array of entries of
+   @ref CAT_DIR_ENTRY_SIZE bytes, each with the status of the entry,
+   a checksum and the table name,
+ - the table descriptors @ref catalog_file, where block i holds the
+   descriptor of the table of directory entry i, with a checksum.
+
+Opening a database reads the directory only. The descriptor of a table is
+read when the table is used for the first time (see @ref get_table), and
+written when the table is created (see @ref save_table), changed or removed.
+*/
+const char catalog_dir_file[] = "db.dir"; /***< directory of the catalog */
+const char catalog_file[] = "db.cat";     /***< table descriptors, one block each */
+const char tables_desc_file[] = "db.db";  /***< text catalog of earlier versions */
+
+#define CAT_FREE 0
+#define CAT_USED 1
+#define CAT_NAME_LEN 56 /**< max length of a table name in the catalog, with '\0' */
+#define CAT_DIR_ENTRY_SIZE (2 * INT_SIZE + CAT_NAME_LEN)
+#define CAT_DIR_ENTRIES_PER_BLOCK ((BLOCK_SIZE - PAGE_HEADER_SIZE) / CAT_DIR_ENTRY_SIZE)
+#define CAT_FLD_VALS 4 /**< type, len, sorted and last_val of a field */
+
+static int num_cat_entries = 0; /**< number of directory entries, used or free */
+static int *free_cat_entries = 0; /**< free directory entries for reuse */
+static int num_free_cat_entries = 0, max_free_cat_entries = 0;
+
+static void push_free_cat_entry(int i) {
+  if (num_free_cat_entries == max_free_cat_entries) {
+    max_free_cat_entries = max_free_cat_entries ? 2 * max_free_cat_entries : 16;
+    free_cat_entries = realloc(free_cat_entries,
+                               max_free_cat_entries * sizeof (int));
+  }
+  free_cat_entries[num_free_cat_entries++] = i;
+}
+
+static void reset_cat_entries() {
+  free(free_cat_entries);
+  free_cat_entries = 0;
+  num_free_cat_entries = max_free_cat_entries = 0;
+  num_cat_entries = 0;
+}
+
+static unsigned cat_checksum_int(unsigned sum, int val) {
+  return sum * 31 + (unsigned) val;
+}
+
+static unsigned cat_checksum_str(unsigned sum, char const* str) {
+  for (; *str; str++)
+    sum = cat_checksum_int(sum, *str);
+  return sum;
+}
+
+static int cat_dir_pos(int i) {
+  return PAGE_HEADER_SIZE + (i % CAT_DIR_ENTRIES_PER_BLOCK) * CAT_DIR_ENTRY_SIZE;
+}
+
+static page_p get_cat_page(char const* fname, int blk_nr) {
+  page_p pg = get_page(fname, blk_nr);
+  if (!pg) {
+    put_msg(FATAL, "Failed to get page for \"%s\" block %d.\n", fname, blk_nr);
+    exit(EXIT_FAILURE);
+  }
+  return pg;
+}
+
+/** @b put_cat_dir_entry
+ * 
+ * writes directory entry i, with the name of the table if it is used
+ */
+static void put_cat_dir_entry(int i, int status, char const* name) {
+  page_p pg = get_cat_page(catalog_dir_file, i / CAT_DIR_ENTRIES_PER_BLOCK);
+  int pos = cat_dir_pos(i);
+  if (status == CAT_FREE) name = "";
+  page_put_int_at(pg, pos, status);
+  page_put_int_at(pg, pos + INT_SIZE,
+                  cat_checksum_str(cat_checksum_int(0, status), name));
+  page_put_str_at(pg, pos + 2 * INT_SIZE, name, CAT_NAME_LEN);
+  unpin(pg);
+}
+
+/** @b num_sorted_fields
+ * 
+ * returns the number of fields known to be sorted. As a field never becomes
+ * sorted again, a change of this number tells that the catalog is outdated.
+ */
+static int num_sorted_fields(schema_p s) {
+  int n = 0;
+  for (field_desc_p f = s->first; f; f = f->next)
+    n += f->sorted;
+  return n;
+}
+
+static int num_indexes(schema_p s) {
+  int n = 0;
+  for (field_desc_p f = s->first; f; f = f->next)
+    for (index_kind kind = BTREE_INDEX; kind <= BLOOM_FILTER; kind++)
+      n += *index_fname(f, kind) != 0;
+  return n;
+}
+
+/** @b save_table
+ * 
+ * writes the descriptor of the table to its block of the catalog,
+ * adding the table to the directory of the catalog if it is not there yet
+ */
+int save_table(tbl_p t) {
+  if (!t) return 0;
+  if (!t->loaded) return 1; /* nothing to save */
+
+  schema_p sch = t->sch;
+  if (strlen(sch->name) >= CAT_NAME_LEN) {
+    put_msg(ERROR, "save_table: table name \"%s\" is longer than %d.\n",
+            sch->name, CAT_NAME_LEN - 1);
+    return 0;
+  }
+  int len = 5 * INT_SIZE;
+  for (field_desc_p f = sch->first; f; f = f->next)
+    len += (CAT_FLD_VALS + 1) * INT_SIZE + strlen(f->name) + 1;
+  len += (1 + 2 * num_indexes(sch)) * INT_SIZE;
+  if (len > BLOCK_SIZE - PAGE_HEADER_SIZE) {
+    put_msg(ERROR, "save_table: descriptor of \"%s\" does not fit in a block.\n",
+            sch->name);
+    return 0;
+  }
+
+  if (t->cat_idx < 0) {
+    t->cat_idx = num_free_cat_entries ?
+      free_cat_entries[--num_free_cat_entries] : num_cat_entries++;
+    put_cat_dir_entry(t->cat_idx, CAT_USED, sch->name);
   }
-  fprintf(fp, "%d\n", tbl->num_records);
+
+  page_p pg = get_cat_page(catalog_file, t->cat_idx);
+  page_put_int_at(pg, PAGE_HEADER_SIZE, 0); /* checksum, set at the end */
+  int pos = PAGE_HEADER_SIZE + INT_SIZE;
+  unsigned sum = 0;
+  int vals[] = {t->layout, sch->num_fields, t->num_records, t->num_freed};
+  for (size_t i = 0; i < 4; i++, pos += INT_SIZE) {
+    page_put_int_at(pg, pos, vals[i]);
+    sum = cat_checksum_int(sum, vals[i]);
+  }
+  for (field_desc_p f = sch->first; f; f = f->next) {
+    int fld_vals[CAT_FLD_VALS] = {f->type, f->len, f->sorted, f->last_val};
+    for (size_t i = 0; i < CAT_FLD_VALS; i++, pos += INT_SIZE) {
+      page_put_int_at(pg, pos, fld_vals[i]);
+      sum = cat_checksum_int(sum, fld_vals[i]);
+    }
+    int name_len = strlen(f->name) + 1;
+    page_put_int_at(pg, pos, name_len);
+    page_put_str_at(pg, pos + INT_SIZE, f->name, name_len);
+    pos += INT_SIZE + name_len;
+    sum = cat_checksum_str(sum, f->name);
+  }
+  /* the number of indexes, then the field number and the index_kind of each */
+  page_put_int_at(pg, pos, num_indexes(sch));
+  sum = cat_checksum_int(sum, num_indexes(sch));
+  pos += INT_SIZE;
+  int fld_nr = 0;
+  for (field_desc_p f = sch->first; f; f = f->next, fld_nr++)
+    for (index_kind kind = BTREE_INDEX; kind <= BLOOM_FILTER; kind++) {
+      if (!*index_fname(f, kind))
+        continue;
+      int idx_vals[] = {fld_nr, kind};
+      for (size_t i = 0; i < 2; i++, pos += INT_SIZE) {
+        page_put_int_at(pg, pos, idx_vals[i]);
+        sum = cat_checksum_int(sum, idx_vals[i]);
+      }
+    }
+  page_set_free_pos(pg, pos);
+  page_put_int_at(pg, PAGE_HEADER_SIZE, sum);
+  unpin(pg);
+
+  t->saved_num_records = t->num_records;
+  t->saved_num_freed = t->num_freed;
+  t->saved_num_sorted = num_sorted_fields(sch);
+  return 1;
 }
 
-/** @b save_tbl_descs
+/** @b load_tbl_desc
  * 
- * write all table descriptors in memory back to drive
+ * reads the descriptor of a table found in the directory of the catalog
  */
-static void save_tbl_descs() {
-  /* backup the descriptors first in case we need some manual investigation */
-  char *tbl_desc_backup = concat_names("__backup", "_", tables_desc_file);
-  rename(tables_desc_file, tbl_desc_backup);
-  free(tbl_desc_backup);
+static void load_tbl_desc(tbl_p t) {
+  schema_p sch = t->sch;
+  page_p pg = get_cat_page(catalog_file, t->cat_idx);
+  int pos = PAGE_HEADER_SIZE + INT_SIZE;
+  unsigned sum = 0;
+  int vals[4];
+  for (size_t i = 0; i < 4; i++, pos += INT_SIZE) {
+    vals[i] = page_get_int_at(pg, pos);
+    sum = cat_checksum_int(sum, vals[i]);
+  }
+  char name[BLOCK_SIZE];
+  t->layout = vals[0]; /* which the fields must fit */
+  for (int i = 0; i < vals[1]; i++) {
+    int fld_vals[CAT_FLD_VALS];
+    for (size_t k = 0; k < CAT_FLD_VALS; k++, pos += INT_SIZE) {
+      fld_vals[k] = page_get_int_at(pg, pos);
+      sum = cat_checksum_int(sum, fld_vals[k]);
+    }
+    int name_len = page_get_int_at(pg, pos);
+    if (name_len <= 0 || pos + INT_SIZE + name_len > BLOCK_SIZE)
+      break; /* caught by the checksum */
+    page_get_str_at(pg, pos + INT_SIZE, name, name_len);
+    pos += INT_SIZE + name_len;
+    field_desc_p f = fld_vals[0] == INT_TYPE ?
+      new_int_field(name) : new_str_field(name, fld_vals[1]);
+    f->sorted = fld_vals[2];
+    f->last_val = fld_vals[3];
+    add_field(sch, f);
+    sum = cat_checksum_str(sum, name);
+  }
+  /* the indexes, which the entries of earlier versions end without */
+  if ((unsigned) page_get_int_at(pg, PAGE_HEADER_SIZE) != sum
+      && page_valid_pos_for_get(pg, pos)) {
+    int num_idx = page_get_int_at(pg, pos);
+    sum = cat_checksum_int(sum, num_idx);
+    pos += INT_SIZE;
+    for (int i = 0; i < num_idx && page_valid_pos_for_get(pg, pos + INT_SIZE);
+         i++, pos += 2 * INT_SIZE) {
+      int fld_nr = page_get_int_at(pg, pos);
+      int kind = page_get_int_at(pg, pos + INT_SIZE);
+      sum = cat_checksum_int(cat_checksum_int(sum, fld_nr), kind);
+      field_desc_p f = sch->first;
+      for (int k = 0; f && k < fld_nr; k++)
+        f = f->next;
+      if (f && kind >= BTREE_INDEX && kind <= BLOOM_FILTER
+          && !*index_fname(f, kind))
+        *index_fname(f, kind) = field_file_name(sch, f, index_exts[kind]);
+    }
+  }
+  if ((unsigned) page_get_int_at(pg, PAGE_HEADER_SIZE) != sum) {
+    put_msg(FATAL, "Catalog entry %d of table \"%s\" is corrupt.\n",
+            t->cat_idx, sch->name);
+    exit(EXIT_FAILURE);
+  }
+  unpin(pg);
 
-  FILE *dbfile = fopen(tables_desc_file, "w");
-  tbl_p tbl = db_tables, next_tbl = 0;
-  while (tbl) {
-    save_tbl_desc(dbfile, tbl);
-    release_schema(tbl->sch);
-    next_tbl = tbl->next;
-    free(tbl);
-    tbl = next_tbl;
+  t->saved_num_records = t->num_records = vals[2];
+  t->saved_num_freed = t->num_freed = vals[3];
+  t->saved_num_sorted = num_sorted_fields(sch);
+  t->loaded = 1;
+  load_mem_indexes(t);
+}
+
+/** @b read_catalog_dir
+ * 
+ * makes a table descriptor, to be loaded on demand, for every table in the
+ * directory of the catalog
+ */
+static void read_catalog_dir() {
+  char name[CAT_NAME_LEN];
+  int num_blocks = file_num_blocks(catalog_dir_file);
+  for (int b = 0; b < num_blocks; b++) {
+    page_p pg = get_cat_page(catalog_dir_file, b);
+    for (int i = b * CAT_DIR_ENTRIES_PER_BLOCK;
+         i < (b + 1) * CAT_DIR_ENTRIES_PER_BLOCK
+           && cat_dir_pos(i) < page_free_pos(pg);
+         i++) {
+      int pos = cat_dir_pos(i);
+      int status = page_get_int_at(pg, pos);
+      unsigned sum = page_get_int_at(pg, pos + INT_SIZE);
+      page_get_str_at(pg, pos + 2 * INT_SIZE, name, CAT_NAME_LEN);
+      name[CAT_NAME_LEN - 1] = '\0';
+      if (sum != cat_checksum_str(cat_checksum_int(0, status), name)) {
+        put_msg(FATAL, "Catalog directory entry %d is corrupt.\n", i);
+        exit(EXIT_FAILURE);
+      }
+      num_cat_entries = i + 1;
+      if (status == CAT_USED) {
+        tbl_p t = new_schema(name)->tbl;
+        t->cat_idx = i;
+        t->loaded = 0;
+      } else
+        push_free_cat_entry(i);
+    }
+    unpin(pg);
   }
-  fclose(dbfile);
 }
 
 /** @b read_tbl_descs
  * 
- * reads table descriptors into memory
+ * reads table descriptors from the text catalog of earlier versions into
+ * memory. They are saved in the catalog at close_db().
  */
 static void read_tbl_descs() {
   FILE *fp = fopen(tables_desc_file, "r");
   if (!fp) return;
-  char name[30] = "";
+  char name[256] = "";
   schema_p sch;
   field_desc_p fld;
-  int num_flds = 0, fld_type, fld_len;
+  int num_flds = 0, fld_type, fld_len, layout, num_freed, n;
   while (!feof(fp)) {
-    if (fscanf(fp, "%s %d\n", name, &num_flds) < 2) {
-      fclose(fp);
-      return;
-    }
+    n = fscanf(fp, "%255s %d %d %d\n", name, &num_flds, &layout, &num_freed);
+    if (n < 2)
+      break;
     sch = new_schema(name);
+    /* descriptors saved by earlier versions have fewer values */
+    if (n >= 3)
+      sch->tbl->layout = layout;
+    if (n >= 4)
+      sch->tbl->num_freed = num_freed;
     for (size_t i = 0; i < num_flds; i++) {
-      fscanf(fp, "%s %d %d", name, &(fld_type), &(fld_len));
+      fscanf(fp, "%255s %d %d", name, &(fld_type), &(fld_len));
       switch (fld_type) {
       case INT_TYPE:
         fld = new_int_field(name);
@@ -308,28 +808,54 @@ static void read_tbl_descs() {
     }
     fscanf(fp, "%d\n", &(sch->tbl->num_records));
   }
-  db_tables = sch->tbl;
   fclose(fp);
+
+  /* keep the text catalog for manual investigation, but do not read it again */
+  char *tbl_desc_backup = concat_names("__backup", "_", tables_desc_file);
+  rename(tables_desc_file, tbl_desc_backup);
+  free(tbl_desc_backup);
 }
 
 /** @b open_db
  * 
- * initialises pager, and reads the table descriptors into memory
+ * initialises pager, and reads the directory of the catalog into memory
  */
 int open_db(void) {
   pager_terminate(); /* first clean up for a fresh start */
   pager_init();
-  read_tbl_descs();
+  reset_cat_entries();
+  read_catalog_dir();
+  if (num_cat_entries == 0)
+    read_tbl_descs();
   return 1;
 }
 
 /** @b close_db
  * 
- * writes the table descriptors to drive, and terminates pager
+ * writes the changed table descriptors to the catalog, and terminates pager
  */
 void close_db(void) {
-  save_tbl_descs();
+  tbl_p tbl = db_tables, next_tbl = 0;
+  while (tbl) {
+    if (tbl->loaded
+        && (tbl->cat_idx < 0
+            || tbl->num_records != tbl->saved_num_records
+            || tbl->num_freed != tbl->saved_num_freed
+            || num_sorted_fields(tbl->sch) != tbl->saved_num_sorted))
+      save_table(tbl);
+    save_zone_map(tbl);
+    release_zone_map(tbl);
+    save_mem_indexes(tbl);
+    release_schema(tbl->sch);
+    next_tbl = tbl->next;
+    free(tbl);
+    tbl = next_tbl;
+  }
   db_tables = 0;
+  free(tbl_buckets);
+  tbl_buckets = 0;
+  num_tbl_buckets = num_tables = 0;
+  reset_cat_entries();
   pager_terminate();
 }
 
@@ -342,10 +868,27 @@ schema_p new_schema(char const* name) {
   tbl_p tbl = malloc(sizeof (tbl_desc_struct));
   tbl->sch = make_schema(name);
   tbl->sch->tbl = tbl;
+  tbl->layout = ROW_LAYOUT;
   tbl->num_records = 0;
+  tbl->num_freed = 0;
   tbl->current_pg = 0;
+  tbl->current_rec = 0;
+  tbl->is_tmp = 0;
+  tbl->cat_idx = -1;
+  tbl->loaded = 1;
+  tbl->saved_num_records = 0;
+  tbl->saved_num_freed = 0;
+  tbl->saved_num_sorted = 0;
+  tbl->zm_state = ZM_UNLOADED;
+  tbl->zm = 0;
+  tbl->zm_num_blocks = tbl->zm_max_blocks = tbl->zm_dirty_from = 0;
+  tbl->zm_fname = 0;
   tbl->next = db_tables;
+  tbl->prev = 0;
+  if (db_tables)
+    db_tables->prev = tbl;
   db_tables = tbl;
+  index_table(tbl);
   return tbl->sch;
 }
 
@@ -357,10 +900,10 @@ schema_p new_schema(char const* name) {
  * @param name
  */
 tbl_p get_table(char const* name) {
-  for (tbl_p tbl = db_tables; tbl; tbl = tbl->next)
-    if (strcmp(name, tbl->sch->name) == 0)
-      return tbl;
-  return NULL;
+  tbl_p tbl = find_table(name);
+  if (tbl && !tbl->loaded)
+    load_tbl_desc(tbl);
+  return tbl;
 }
 
 /** @b get_schema
@@ -376,26 +919,55 @@ schema_p get_schema(char const* name) {
   else return 0;
 }
 
+schema_p table_schema(tbl_p t) {
+  return t ? t->sch : 0;
+}
+
+/** @b discard_file
+ * 
+ * closes file fname of table t and removes it. The file of a table that
+ * is not an intermediate result is kept as a backup, "__fname".
+ */
+static void discard_file(tbl_p t, char const* fname) {
+  close_file(fname);
+  if (t->is_tmp) {
+    remove(fname);
+    return;
+  }
+  char *backup = concat_names("_", "_", fname);
+  rename(fname, backup);
+  free(backup);
+}
+
 void remove_table(tbl_p t) {
   if (!t) return;
 
-  for (tbl_p tbl = db_tables, prev = 0;
-       tbl;
-       prev = tbl, tbl = tbl->next)
-    if (tbl == t) {
-      if (t == db_tables)
-        db_tables = t->next;
-      else
-        prev->next = t->next;
-
-      close_file(t->sch->name);
-      char *tbl_backup = concat_names("_", "_", t->sch->name);
-      rename(t->sch->name, tbl_backup);
-      free(tbl_backup);
-      release_schema(t->sch);
-      free(t);
-      return;
-    }
+  if (t->prev)
+    t->prev->next = t->next;
+  else
+    db_tables = t->next;
+  if (t->next)
+    t->next->prev = t->prev;
+  unindex_table(t);
+
+  if (t->cat_idx >= 0) {
+    put_cat_dir_entry(t->cat_idx, CAT_FREE, 0);
+    push_free_cat_entry(t->cat_idx);
+  }
+
+  if (t->layout == COL_LAYOUT) {
+    for (field_desc_p f = t->sch->first; f; f = f->next)
+      discard_file(t, col_file(t->sch, f));
+  } else
+    discard_file(t, t->sch->name);
+  discard_file(t, zm_file(t->sch));
+  for (field_desc_p f = t->sch->first; f; f = f->next)
+    for (index_kind kind = BTREE_INDEX; kind <= BLOOM_FILTER; kind++)
+      if (*index_fname(f, kind))
+        discard_file(t, *index_fname(f, kind));
+  release_zone_map(t);
+  release_schema(t->sch);
+  free(t);
 }
 
 void remove_schema(schema_p s) {
@@ -410,13 +982,8 @@ void remove_schema(schema_p s) {
  * @param f source
  */
 static field_desc_p dup_field(field_desc_p f) {
-  field_desc_p res = malloc(sizeof (field_desc_struct));
-  res->name = strdup(f->name);
-  res->type = f->type;
-  res->len = f->len;
-  res->offset = 0;
-  res->next = 0;
-  return res;
+  return is_int_field(f) ?
+    new_int_field(f->name) : new_str_field(f->name, f->len);
 }
 
 /** @b copy_schema
@@ -429,6 +996,9 @@ static field_desc_p dup_field(field_desc_p f) {
 static schema_p copy_schema(schema_p s, char const* dest_name) {
   if (!s) return 0;
   schema_p dest = new_schema(dest_name);
+  /* e.g. the records of a join, which may not fit a page as rows */
+  if (!row_fits(s->row_len, s->len))
+    dest->tbl->layout = PAX_LAYOUT;
   for (field_desc_p f = s->first; f; f = f->next)
     add_field(dest, dup_field(f));
   return dest;
@@ -447,32 +1017,22 @@ static field_desc_p get_field(schema_p s, char const* name) {
   return 0;
 }
 
-/** @b get_field_name_from_offset
- * 
- * returns the name of the field in schema s with the given offset
- * 
- * @param s       schema to search
- * @param offset  offset to search for
- */
-static const char *const get_field_name_from_offset(schema_p s, int offset) {
-  for (field_desc_p f = s->first; f; f = f->next)
-    if (f->offset == offset) return f->name;
-  return NULL;
-}
+static int tmp_schema_id = 0; /**< number of the next temporary name */
 
 /** @b tmp_schema_name
  * 
- * returns a temporary name based on the operation name and the table name
+ * returns a temporary name based on the operation name and the table name.
+ * The names are numbered in the order they are made, so a name is only
+ * taken already if it was left by an earlier session.
  * 
  * @param op_name  operation name
  * @param name     table name
  */
 static char* tmp_schema_name(char const* op_name, char const* name) {
-  char *res = malloc((sizeof op_name) + (sizeof name) + 10);
-  int i = 0;
+  char *res = malloc(strlen(op_name) + strlen(name) + 16);
   do
-    sprintf(res, "%s__%s_%d", op_name, name, i++);
-  while (get_schema(res));
+    sprintf(res, "%s__%s_%d", op_name, name, tmp_schema_id++);
+  while (find_table(res));
 
   return res;
 }
@@ -488,6 +1048,7 @@ static schema_p make_sub_schema(schema_p s, int num_fields, char *fields[]) {
   char *sub_sch_name = tmp_schema_name("project", s->name);
   schema_p res = new_schema(sub_sch_name);
   free(sub_sch_name);
+  res->tbl->is_tmp = 1;
   
   field_desc_p f = 0;
   for (size_t i= 0; i < num_fields; i++) {
@@ -517,6 +1078,15 @@ int add_field(schema_p s, field_desc_p f) {
     put_msg(ERROR,
             "schema already has %d bytes, adding %d will exceed limited %d bytes.\n",
             s->len, f->len, BLOCK_SIZE - PAGE_HEADER_SIZE);
+    release_field_desc(f);
+    return 0;
+  }
+  int row_len = s->row_len + (is_int_field(f) ? INT_SIZE : STR_REF_SIZE);
+  if (s->tbl && s->tbl->layout == ROW_LAYOUT
+      && !row_fits(row_len, s->len + f->len)) {
+    put_msg(ERROR, "adding \"%s\" to \"%s\" makes records too long for a"
+            " page with ROW_LAYOUT.\n", f->name, s->name);
+    release_field_desc(f);
     return 0;
   }
   if (s->num_fields == 0) {
@@ -527,9 +1097,12 @@ int add_field(schema_p s, field_desc_p f) {
     s->last->next = f;
     f->offset = s->len;
   }
+  f->row_offset = s->row_len;
+  f->zm_idx = is_int_field(f) ? s->num_int_fields++ : -1;
   s->last = f;
   s->num_fields++;
   s->len += f->len;
+  s->row_len += is_int_field(f) ? INT_SIZE : STR_REF_SIZE;
   return s->num_fields;
 }
 
@@ -681,1047 +1254,3731 @@ int equal_record(record r1, record r2, schema_p s) {
   }
   return 1;
 }
-/** @b set_tbl_position
+/** @b pax_capacity
  * 
- * sets the current r/w-position to either beginning or end of the table
+ * returns the number of records a block of a PAX table can hold
  * 
- * @param t table to set position of
- * @param pos TBL_BEG for beginning of table, TBL_END for end
+ * @param s schema of the table
  */
-void set_tbl_position(tbl_p t, tbl_position pos) {
-  switch (pos) {
-  case TBL_BEG:
-    {
-      t->current_pg = get_page(t->sch->name, 0);
-      page_set_pos_begin(t-> current_pg);
-    }
-    break;
-  case TBL_END:
-    t->current_pg = get_page_for_append(t->sch->name);
-  }
+static int pax_capacity(schema_p s) {
+  return (BLOCK_SIZE - PAGE_HEADER_SIZE) / s->len;
 }
 
-/** @b eot
- * returns true if the position is at the end of the table
+/** @b fld_pos
+ * 
+ * returns the position in the page of field f of the i-th record.
+ * With ROW_LAYOUT the page is a slotted page, with record i in slot i and
+ * a reference in place of each str value, while with PAX_LAYOUT the block is
+ * divided into one minipage per field, each holding pax_capacity() values.
+ * 
+ * @param s  schema of the table
+ * @param pg page of the record
+ * @param f  field of the schema
+ * @param i  index of the record in the page
  */
-int eot(tbl_p t) {
-  return (peof(t->current_pg));
+static int fld_pos(schema_p s, page_p pg, field_desc_p f, int i) {
+  if (s->tbl->layout == PAX_LAYOUT)
+    return PAGE_HEADER_SIZE + pax_capacity(s) * f->offset + i * f->len;
+  return page_slot_pos(pg, i) + f->row_offset;
 }
 
-/** check if the the current position is valid */
-static int page_valid_pos_for_get_with_schema(page_p p, schema_p s) {
-  return (page_valid_pos_for_get(p, page_current_pos(p))
-          && (page_current_pos(p) - PAGE_HEADER_SIZE) % s->len == 0);
+/** @b rec_freed
+ * 
+ * returns true if the i-th record of the page has been deleted
+ */
+static int rec_freed(schema_p s, page_p pg, int i) {
+  return s->tbl->layout == ROW_LAYOUT && !page_slot_pos(pg, i);
 }
 
-/** check if the the current position is valid */
-static int page_valid_pos_for_put_with_schema(page_p p, schema_p s) {
-  return (page_valid_pos_for_put(p, page_current_pos(p), s->len)
-          && (page_current_pos(p) - PAGE_HEADER_SIZE) % s->len == 0);
+/** @b page_rec_int
+ * 
+ * returns the value of the int field f of the i-th record in the page
+ */
+static int page_rec_int(schema_p s, page_p pg, field_desc_p f, int i) {
+  return page_get_int_at(pg, fld_pos(s, pg, f, i));
 }
-/** @b get_page_for_next_record
+
+/** @b col_file
  * 
- * finds and returns the page containing the next record
+ * returns the name of the file holding field f of a COL_LAYOUT table,
+ * "table.field.col"
  * 
- * @param s
+ * @param s schema of the table
+ * @param f field of the schema
  */
-static page_p get_page_for_next_record(schema_p s) {
-  page_p pg = s->tbl->current_pg;
-  if (peof(pg)) return 0;
-  if (eop(pg)) {
-    unpin(pg);
-    pg = get_next_page(pg);
-    if (!pg) {
-      put_msg(FATAL, "get_page_for_next_record failed at block %d\n",
-              page_block_nr(pg) + 1);
-      exit(EXIT_FAILURE);
-    }
-    page_set_pos_begin(pg);
-    s->tbl->current_pg = pg;
-  }
-  return pg;
+static char const* col_file(schema_p s, field_desc_p f) {
+  if (!f->col_fname)
+    f->col_fname = field_file_name(s, f, "col");
+  return f->col_fname;
 }
-/** @b get_page_record
+
+/** @b col_capacity
  * 
- * fills in r with the record at the current position of the page
+ * returns the number of values of field f a block of a column file can hold
+ */
+static int col_capacity(field_desc_p f) {
+  return (BLOCK_SIZE - PAGE_HEADER_SIZE) / f->len;
+}
+
+/** @b col_pos
  * 
- * @param r to be written to
- * @param s for reference
- * @param p page to read from
+ * returns the position of the value of record i in its column page
  */
-static int get_page_record(page_p p, record r, schema_p s) {
-  if (!p) return 0;
-  if (!page_valid_pos_for_get_with_schema(p, s)) {
-    put_msg(FATAL, "try to get record at invalid position.\n");
+static int col_pos(field_desc_p f, int i) {
+  return PAGE_HEADER_SIZE + (i % col_capacity(f)) * f->len;
+}
+
+/** @b col_page
+ * 
+ * returns the page of the column file of field f holding record i,
+ * pinned until col_done() is called.
+ */
+static page_p col_page(schema_p s, field_desc_p f, int i) {
+  page_p pg = get_page(col_file(s, f), i / col_capacity(f));
+  if (!pg) {
+    put_msg(FATAL, "Failed to get page for \"%s\" block %d.\n",
+            col_file(s, f), i / col_capacity(f));
     exit(EXIT_FAILURE);
   }
-  field_desc_p fld_desc;
-  size_t i = 0;
-  for (fld_desc = s->first; fld_desc;
-       fld_desc = fld_desc->next, i++)
-    if (is_int_field(fld_desc))
-      assign_int_field(r[i], page_get_int(p));
-    else
-      page_get_str(p, r[i], fld_desc->len);
-  return 1;
+  return pg;
 }
 
-/** @b get_record
- * 
- * fully abstracts away pager, read record from current position of schema
+/** @b col_done
  * 
- * @param r record space to write to
- * @param s schema to read from
+ * unpins the page of record i of field f after a value has been read or
+ * written. Reads may jump to any record, as with index lookups and rescans,
+ * so a page is unpinned after every read. As with row appends, a page
+ * being appended to stays pinned until its block is full, so that it is
+ * not written for every value.
  */
-int get_record(record r, schema_p s) {
-  page_p pg = get_page_for_next_record(s);
-  return pg ? get_page_record(pg, r, s) : 0;
+static void col_done(field_desc_p f, page_p pg, int i, int appending) {
+  if (!appending || i % col_capacity(f) == col_capacity(f) - 1)
+    unpin(pg);
 }
 
-static int int_eq(int x, int y) {
-  return x == y;
-}
+/** @brief Zone maps
 
-static int int_l(int x, int y) {
-  return y < x;
-}
+The zone map of a table holds, for every block, the smallest and the
+largest value of each int field in the block, so that a search can skip
+the blocks where no value satisfies the condition. A block of a
+COL_LAYOUT table is a block of its int columns, which all hold the values
+of the same records.
 
-static int int_g(int x, int y) {
-  return y > x;
+A zone map is maintained in memory as records are written, and saved in
+the file "table.zm" by close_db(). It is read the first time it is used.
+Deleting records does not shrink it, it is only a bound of the values.
+*/
+static char const zm_skipped_event[] = "blocks skipped by zone maps";
+
+static char const* zm_file(schema_p s) {
+  if (!s->tbl->zm_fname)
+    s->tbl->zm_fname = concat_names(s->name, ".", "zm");
+  return s->tbl->zm_fname;
 }
 
-static int int_le(int x, int y) {
-  return y <= x;
+/** @b zm_entries_per_block
+ * 
+ * returns the number of zone map entries a block of the zone map file holds
+ */
+static int zm_entries_per_block(schema_p s) {
+  return (BLOCK_SIZE - PAGE_HEADER_SIZE) / (2 * INT_SIZE * s->num_int_fields);
 }
 
-static int int_ge(int x, int y) {
-  return y >= x;
+/** @b zm_block
+ * 
+ * returns the block of record i of a COL_LAYOUT table in its int columns
+ */
+static int zm_block(int i) {
+  return i / ((BLOCK_SIZE - PAGE_HEADER_SIZE) / INT_SIZE);
 }
 
-static int int_neq(int x, int y) {
-  return x != y;
+/** @b zm_data_blocks
+ * 
+ * returns the number of blocks the zone map must cover
+ */
+static int zm_data_blocks(schema_p s) {
+  if (s->tbl->layout != COL_LAYOUT)
+    return file_num_blocks(s->name);
+  for (field_desc_p f = s->first; f; f = f->next)
+    if (is_int_field(f))
+      return file_num_blocks(col_file(s, f));
+  return 0;
 }
 
-static int find_record_int_val(record r, schema_p s, int offset,
+/** @b zm_entry
+ * 
+ * returns the zone map entry of block blk, adding empty entries up to it
+ */
+static int* zm_entry(tbl_p t, int blk) {
+  int entry_len = 2 * t->sch->num_int_fields;
+  if (blk >= t->zm_max_blocks) {
+    int max = t->zm_max_blocks ? t->zm_max_blocks : 16;
+    while (max <= blk) max *= 2;
+    t->zm = realloc(t->zm, max * entry_len * sizeof (int));
+    t->zm_max_blocks = max;
+  }
+  for (; t->zm_num_blocks <= blk; t->zm_num_blocks++)
+    for (int k = 0; k < entry_len; k += 2) {
+      t->zm[t->zm_num_blocks * entry_len + k] = INT_MAX;
+      t->zm[t->zm_num_blocks * entry_len + k + 1] = INT_MIN;
+    }
+  return t->zm + blk * entry_len;
+}
+
+/** @b load_zone_map
+ * 
+ * reads the zone map of the table from its file. The zone map is not
+ * available if the file does not cover all blocks of the table,
+ * e.g. it was made by an earlier version.
+ */
+static void load_zone_map(tbl_p t) {
+  schema_p s = t->sch;
+  t->zm_state = ZM_NONE;
+  if (s->num_int_fields == 0)
+    return;
+  if (t->num_records == 0 && t->num_freed == 0) {
+    /* a new table, its blocks are about to get their first records */
+    t->zm_state = ZM_LOADED;
+    return;
+  }
+  int num_blocks = zm_data_blocks(s);
+
+  int per_block = zm_entries_per_block(s);
+  int zm_blocks = file_num_blocks(zm_file(s));
+  if (zm_blocks == 0)
+    return;
+  for (int b = 0; b < zm_blocks && t->zm_num_blocks < num_blocks; b++) {
+    page_p pg = get_page(zm_file(s), b);
+    if (!pg) return;
+    int pos = PAGE_HEADER_SIZE;
+    for (int e = 0; e < page_num_records(pg); e++) {
+      int *entry = zm_entry(t, b * per_block + e);
+      for (int k = 0; k < 2 * s->num_int_fields; k++, pos += INT_SIZE)
+        entry[k] = page_get_int_at(pg, pos);
+    }
+    unpin(pg);
+  }
+  if (t->zm_num_blocks < num_blocks) {
+    t->zm_num_blocks = 0;
+    return;
+  }
+  t->zm_state = ZM_LOADED;
+  t->zm_dirty_from = t->zm_num_blocks;
+}
+
+/** @b save_zone_map
+ * 
+ * writes the entries of the zone map that changed to its file
+ */
+static void save_zone_map(tbl_p t) {
+  schema_p s = t->sch;
+  if (t->zm_state != ZM_LOADED || t->zm_dirty_from >= t->zm_num_blocks)
+    return;
+  int per_block = zm_entries_per_block(s);
+  int entry_len = 2 * s->num_int_fields;
+  for (int b = t->zm_dirty_from / per_block;
+       b * per_block < t->zm_num_blocks;
+       b++) {
+    page_p pg = get_page(zm_file(s), b);
+    if (!pg) {
+      put_msg(ERROR, "Failed to save the zone map of \"%s\".\n", s->name);
+      return;
+    }
+    int n = t->zm_num_blocks - b * per_block;
+    if (n > per_block) n = per_block;
+    int pos = PAGE_HEADER_SIZE;
+    for (int k = 0; k < n * entry_len; k++, pos += INT_SIZE)
+      page_put_int_at(pg, pos, t->zm[b * per_block * entry_len + k]);
+    page_set_num_records(pg, n);
+    unpin(pg);
+  }
+  t->zm_dirty_from = t->zm_num_blocks;
+}
+
+static void release_zone_map(tbl_p t) {
+  free(t->zm);
+  free(t->zm_fname);
+}
+
+/** @b zm_widen
+ * 
+ * makes the zone map of block blk cover value val of field f
+ */
+static void zm_widen(schema_p s, int blk, field_desc_p f, int val) {
+  tbl_p t = s->tbl;
+  if (t->zm_state == ZM_UNLOADED)
+    load_zone_map(t);
+  if (t->zm_state != ZM_LOADED)
+    return;
+  int *entry = zm_entry(t, blk) + 2 * f->zm_idx;
+  if (val < entry[0] || val > entry[1]) {
+    drop_fence_keys(f);
+    drop_learned_index(f);
+    if (val < entry[0]) entry[0] = val;
+    if (val > entry[1]) entry[1] = val;
+    if (blk < t->zm_dirty_from)
+      t->zm_dirty_from = blk;
+  }
+}
+
+static void zm_widen_record(schema_p s, int blk, record r) {
+  field_desc_p f;
+  size_t j = 0;
+  for (f = s->first; f; f = f->next, j++)
+    if (is_int_field(f))
+      zm_widen(s, blk, f, *(int *)r[j]);
+}
+
+/** @b zm_bounds
+ * 
+ * gets the bounds of field f in block blk.
+ * Returns 0 if the table has no zone map for the block.
+ */
+static int zm_bounds(schema_p s, field_desc_p f, int blk, int *min, int *max) {
+  tbl_p t = s->tbl;
+  if (t->zm_state == ZM_UNLOADED)
+    load_zone_map(t);
+  if (t->zm_state != ZM_LOADED || blk >= t->zm_num_blocks)
+    return 0;
+  int *entry = t->zm + blk * 2 * s->num_int_fields + 2 * f->zm_idx;
+  *min = entry[0];
+  *max = entry[1];
+  return 1;
+}
+
+/** @brief Fence keys
+
+The fence keys of a sorted field are the first values of its blocks, in an
+array that stays in memory while the table is open. They are made from the
+zone map, where the first value of a block of a sorted field is its
+smallest one, the first time the field is searched with binary search, and
+dropped when the zone map of the field changes.
+*/
+static long fence_mem = 0; /**< number of bytes of all fence keys */
+
+static char const fence_saved_event[] = "block reads saved by fence keys";
+
+static void drop_fence_keys(field_desc_p f) {
+  if (f->fences) {
+    fence_mem -= f->num_fences * sizeof (int);
+    free(f->fences);
+    f->fences = 0;
+    f->num_fences = 0;
+  }
+}
+
+/** @b fence_keys
+ * 
+ * returns the fence keys of the sorted field f, NULL if the table has
+ * no zone map to make them from
+ */
+static int* fence_keys(schema_p s, field_desc_p f) {
+  int min, max;
+  if (!f->fences) {
+    if (!zm_bounds(s, f, 0, &min, &max))
+      return 0;
+    f->num_fences = s->tbl->zm_num_blocks;
+    f->fences = malloc(f->num_fences * sizeof (int));
+    for (int b = 0; b < f->num_fences; b++) {
+      zm_bounds(s, f, b, &min, &max);
+      f->fences[b] = min;
+    }
+    fence_mem += f->num_fences * sizeof (int);
+  }
+  return f->fences;
+}
+
+/** @brief Learned index
+
+The learned index of a sorted field predicts the block of a value with a
+piecewise-linear function of the value. It is made from the zone map, like
+the fence keys, such that the block predicted for the smallest value of a
+block is at most PLA_ERROR blocks away from that block. A search then only
+bisects the blocks in a window around the prediction. Where the values are
+spread evenly, a few segments replace the fence keys of many blocks.
+*/
+#define PLA_ERROR 1 /**< max distance of a predicted block, in blocks */
+
+static long pla_mem = 0; /**< number of bytes of all learned indexes */
+
+static char const pla_miss_event[] = "bounds outside the learned index window";
+
+static void drop_learned_index(field_desc_p f) {
+  if (f->pla) {
+    pla_mem -= f->num_pla * sizeof (pla_segment_struct);
+    free(f->pla);
+    f->pla = 0;
+    f->num_pla = 0;
+  }
+}
+
+/** @b learned_index
+ * 
+ * returns the learned index of the sorted field f, NULL if the table has
+ * no zone map to make it from.
+ * 
+ * A segment starts at the smallest value of a block, and takes in the
+ * smallest values of the next blocks as long as some slope predicts all of
+ * them within PLA_ERROR blocks. The slopes that do so narrow down with
+ * every value taken in.
+ */
+static pla_segment_struct* learned_index(schema_p s, field_desc_p f) {
+  int min, max;
+  if (f->pla)
+    return f->pla;
+  if (!zm_bounds(s, f, 0, &min, &max))
+    return 0;
+  int num_blocks = s->tbl->zm_num_blocks;
+  pla_segment_struct *segs = malloc((num_blocks + 1) * sizeof (pla_segment_struct));
+  int n = 0, prev_min = INT_MIN;
+  double slope_low = 0, slope_high = 0;
+  int has_slope = 0;
+  for (int b = 0; b < num_blocks; b++) {
+    zm_bounds(s, f, b, &min, &max);
+    if (min > max || (n > 0 && min == prev_min))
+      continue; /* an empty block, or one the bound may be before */
+    prev_min = min;
+    if (n > 0) {
+      pla_segment_struct *g = segs + n - 1;
+      double dx = (double) min - g->key;
+      double low = (b - PLA_ERROR - g->blk) / dx;
+      double high = (b + PLA_ERROR - g->blk) / dx;
+      if (has_slope) {
+        if (low < slope_low) low = slope_low;
+        if (high > slope_high) high = slope_high;
+      }
+      if (low <= high) {
+        slope_low = low;
+        slope_high = high;
+        has_slope = 1;
+        continue;
+      }
+      g->slope = has_slope ? (slope_low + slope_high) / 2 : 0;
+    }
+    segs[n].key = min;
+    segs[n].blk = b;
+    segs[n].slope = 0;
+    n++;
+    has_slope = 0;
+  }
+  if (n > 0 && has_slope)
+    segs[n - 1].slope = (slope_low + slope_high) / 2;
+  if (n == 0) {
+    /* no records, keep a segment to tell it is made */
+    segs[0].key = INT_MIN;
+    segs[0].blk = 0;
+    segs[0].slope = 0;
+    n = 1;
+  }
+  f->pla = realloc(segs, n * sizeof (pla_segment_struct));
+  f->num_pla = n;
+  pla_mem += n * sizeof (pla_segment_struct);
+  return f->pla;
+}
+
+/** @b pla_predict
+ * 
+ * returns the block the learned index of f predicts for value val
+ */
+static double pla_predict(field_desc_p f, int val) {
+  int low = 0, high = f->num_pla, mid;
+  /* the last segment starting at or before val */
+  while (high - low > 1) {
+    mid = AVG(low, high);
+    if (f->pla[mid].key <= val)
+      low = mid;
+    else
+      high = mid;
+  }
+  pla_segment_struct *g = f->pla + low;
+  if (val <= g->key)
+    return g->blk;
+  return g->blk + g->slope * ((double) val - g->key);
+}
+
+void put_access_info(pmsg_level level) {
+  put_msg(level, "Memory of fence keys: %ld bytes\n", fence_mem);
+  put_msg(level, "Memory of learned indexes: %ld bytes\n", pla_mem);
+  long bm_mem = 0;
+  for (tbl_p t = db_tables; t; t = t->next)
+    for (field_desc_p f = t->loaded ? t->sch->first : 0; f; f = f->next)
+      if (f->bm)
+        bm_mem += bmi_mem(f->bm);
+  put_msg(level, "Memory of bitmap indexes: %ld bytes\n", bm_mem);
+  long bf_mem_sum = 0;
+  for (tbl_p t = db_tables; t; t = t->next)
+    for (field_desc_p f = t->loaded ? t->sch->first : 0; f; f = f->next)
+      if (f->bf)
+        bf_mem_sum += bf_mem(f->bf);
+  put_msg(level, "Memory of Bloom filters: %ld bytes\n", bf_mem_sum);
+}
+
+/** @b get_col_val
+ * 
+ * reads the value of field f of record i of a COL_LAYOUT table into val
+ */
+static void get_col_val(schema_p s, field_desc_p f, int i, void *val) {
+  page_p pg = col_page(s, f, i);
+  if (is_int_field(f))
+    assign_int_field(val, page_get_int_at(pg, col_pos(f, i)));
+  else
+    page_get_str_at(pg, col_pos(f, i), val, f->len);
+  col_done(f, pg, i, 0);
+}
+
+static int get_col_int(schema_p s, field_desc_p f, int i) {
+  int val;
+  get_col_val(s, f, i, &val);
+  return val;
+}
+
+/** @b put_col_val
+ * 
+ * writes val as the value of field f of record i of a COL_LAYOUT table,
+ * either overwriting a value or appending one right after the last one
+ */
+static void put_col_val(schema_p s, field_desc_p f, int i, void *val) {
+  page_p pg = col_page(s, f, i);
+  int ok = is_int_field(f) ?
+    page_put_int_at(pg, col_pos(f, i), *(int *)val) :
+    page_put_str_at(pg, col_pos(f, i), val, f->len);
+  if (!ok) {
+    put_msg(FATAL, "Failed to put value of record %d to \"%s\".\n",
+            i, col_file(s, f));
+    exit(EXIT_FAILURE);
+  }
+  int appending = i % col_capacity(f) >= page_num_records(pg);
+  if (appending)
+    page_set_num_records(pg, i % col_capacity(f) + 1);
+  if (is_int_field(f))
+    zm_widen(s, zm_block(i), f, *(int *)val);
+  col_done(f, pg, i, appending);
+}
+
+/** @b get_col_record
+ * 
+ * fills in r with the current record of a COL_LAYOUT table, reading
+ * only the fields of schema dest (a sub-schema of s, or s itself),
+ * and moves the current position to the next record
+ * 
+ * @param r    record of schema dest
+ * @param dest fields to read
+ * @param s    schema of the table
+ */
+static int get_col_record(record r, schema_p dest, schema_p s) {
+  int i = s->tbl->current_rec;
+  if (i >= s->tbl->num_records) return 0;
+  field_desc_p f;
+  size_t j = 0;
+  for (f = dest->first; f; f = f->next, j++)
+    get_col_val(s, dest == s ? f : get_field(s, f->name), i, r[j]);
+  s->tbl->current_rec++;
+  return 1;
+}
+
+static void put_col_record(record r, schema_p s, int i) {
+  field_desc_p f;
+  size_t j = 0;
+  for (f = s->first; f; f = f->next, j++)
+    put_col_val(s, f, i, r[j]);
+}
+
+/** @b tbl_num_blocks
+ * 
+ * returns the number of blocks of the table, over all its files
+ */
+static int tbl_num_blocks(tbl_p t) {
+  if (t->layout != COL_LAYOUT)
+    return file_num_blocks(t->sch->name);
+  int n = 0;
+  for (field_desc_p f = t->sch->first; f; f = f->next)
+    n += file_num_blocks(col_file(t->sch, f));
+  return n;
+}
+
+static int is_last_page(schema_p s, page_p pg) {
+  return page_block_nr(pg) >= file_num_blocks(s->name) - 1;
+}
+
+/** @b set_tbl_position
+ * 
+ * sets the current r/w-position to either beginning or end of the table
+ * 
+ * @param t table to set position of
+ * @param pos TBL_BEG for beginning of table, TBL_END for end
+ */
+void set_tbl_position(tbl_p t, tbl_position pos) {
+  if (t->layout == COL_LAYOUT) {
+    /* there is no single page, the position is the record number */
+    t->current_pg = 0;
+    t->current_rec = pos == TBL_BEG ? 0 : t->num_records;
+    return;
+  }
+  page_p pg = pos == TBL_BEG ? get_page(t->sch->name, 0)
+    : get_page_for_append(t->sch->name);
+  /* the page of the old position stays pinned otherwise */
+  if (t->current_pg && t->current_pg != pg)
+    unpin(t->current_pg);
+  t->current_pg = pg;
+  t->current_rec = pos == TBL_BEG ? 0 : page_num_records(pg);
+}
+
+/** @b get_page_for_next_record
+ * 
+ * finds and returns the page containing the next record
+ * 
+ * @param s
+ */
+static page_p get_page_for_next_record(schema_p s) {
+  tbl_p t = s->tbl;
+  page_p pg = t->current_pg;
+  for (;;) {
+    for (int n = page_num_records(pg); t->current_rec < n; t->current_rec++)
+      if (!rec_freed(s, pg, t->current_rec))
+        return pg;
+    if (is_last_page(s, pg)) return 0;
+    int blk_nr = page_block_nr(pg) + 1;
+    unpin(pg);
+    pg = get_next_page(pg);
+    if (!pg) {
+      put_msg(FATAL, "get_page_for_next_record failed at block %d\n",
+              blk_nr);
+      exit(EXIT_FAILURE);
+    }
+    t->current_pg = pg;
+    t->current_rec = 0;
+  }
+}
+/** @b eot
+ * returns true if the position is at the end of the table
+ */
+int eot(tbl_p t) {
+  if (t->layout == COL_LAYOUT)
+    return t->current_rec >= t->num_records;
+  /* moves on past deleted records, if any */
+  return !get_page_for_next_record(t->sch);
+}
+
+/** @b get_page_record
+ * 
+ * fills in r with the current record of the page,
+ * and moves the current position to the next record
+ * 
+ * @param r to be written to
+ * @param s for reference
+ * @param p page to read from
+ */
+static int get_page_record(page_p p, record r, schema_p s) {
+  if (!p) return 0;
+  int i = s->tbl->current_rec;
+  if (i < 0 || i >= page_num_records(p)) {
+    put_msg(FATAL, "try to get record at invalid position.\n");
+    exit(EXIT_FAILURE);
+  }
+  field_desc_p fld_desc;
+  size_t j = 0;
+  for (fld_desc = s->first; fld_desc;
+       fld_desc = fld_desc->next, j++)
+    if (is_int_field(fld_desc))
+      assign_int_field(r[j], page_get_int_at(p, fld_pos(s, p, fld_desc, i)));
+    else if (s->tbl->layout == ROW_LAYOUT) {
+      int ref = page_get_int_at(p, fld_pos(s, p, fld_desc, i));
+      int len = STR_REF_LEN(ref) < fld_desc->len ?
+        STR_REF_LEN(ref) : fld_desc->len;
+      page_get_str_at(p, page_slot_pos(p, i) + STR_REF_POS(ref), r[j], len);
+      if (len < fld_desc->len)
+        ((char *)r[j])[len] = '\0';
+    } else
+      page_get_str_at(p, fld_pos(s, p, fld_desc, i), r[j], fld_desc->len);
+  s->tbl->current_rec++;
+  return 1;
+}
+
+/** @b get_record
+ * 
+ * fully abstracts away pager, read record from current position of schema
+ * 
+ * @param r record space to write to
+ * @param s schema to read from
+ */
+int get_record(record r, schema_p s) {
+  if (s->tbl->layout == COL_LAYOUT)
+    return get_col_record(r, s, s);
+  page_p pg = get_page_for_next_record(s);
+  return pg ? get_page_record(pg, r, s) : 0;
+}
+
+static int int_eq(int x, int y) {
+  return x == y;
+}
+
+static int int_l(int x, int y) {
+  return y < x;
+}
+
+static int int_g(int x, int y) {
+  return y > x;
+}
+
+static int int_le(int x, int y) {
+  return y <= x;
+}
+
+static int int_ge(int x, int y) {
+  return y >= x;
+}
+
+static int int_neq(int x, int y) {
+  return x != y;
+}
+
+/** @b zm_may_match
+ * 
+ * returns false if the zone map of block blk shows that no value of field f
+ * in the block satisfies the condition
+ */
+static int zm_may_match(schema_p s, field_desc_p f, int blk,
+                        int (*op) (int, int), int val) {
+  int min, max;
+  if (!zm_bounds(s, f, blk, &min, &max))
+    return 1;
+  if (min > max) /* no records */
+    return 0;
+  if (op == int_eq)  return min <= val && val <= max;
+  if (op == int_l)   return min < val;
+  if (op == int_le)  return min <= val;
+  if (op == int_g)   return max > val;
+  if (op == int_ge)  return max >= val;
+  if (op == int_neq) return min != val || max != val;
+  return 1;
+}
+
+static char const bf_probed_event[] = "blocks probed with Bloom filters";
+static char const bf_skipped_event[] = "blocks skipped by Bloom filters";
+
+/** @b bloom_may_match
+ * 
+ * returns false if the Bloom filter of block blk shows that no value of
+ * field f in the block satisfies the condition, which only = can tell
+ */
+static int bloom_may_match(field_desc_p f, int blk, int (*op) (int, int),
+                           int val) {
+  if (op != int_eq || !f->bf)
+    return 1;
+  pager_profiler_count(bf_probed_event, 1);
+  if (bf_may_contain(f->bf, blk, val))
+    return 1;
+  pager_profiler_count(bf_skipped_event, 1);
+  return 0;
+}
+
+/** @b col_find_record_int_val
+ * 
+ * same as find_record_int_val for a COL_LAYOUT table: only the column of f
+ * is scanned, the other columns are read for the matching record only
+ */
+static int col_find_record_int_val(record r, schema_p s, field_desc_p f,
+                                   int (*op) (int, int), int val) {
+  tbl_p t = s->tbl;
+  int checked_blk = -1; /* the block found to may have a match */
+  for (; t->current_rec < t->num_records; t->current_rec++) {
+    int blk = zm_block(t->current_rec);
+    if (blk != checked_blk) {
+      if (!zm_may_match(s, f, blk, op, val)) {
+        pager_profiler_count(zm_skipped_event, 1);
+        t->current_rec = (blk + 1) * col_capacity(f) - 1;
+        continue;
+      }
+      if (!bloom_may_match(f, blk, op, val)) {
+        t->current_rec = (blk + 1) * col_capacity(f) - 1;
+        continue;
+      }
+      checked_blk = blk;
+    }
+    if ((*op) (val, get_col_int(s, f, t->current_rec)))
+      return get_col_record(r, s, s);
+  }
+  return 0;
+}
+
+static int find_record_int_val(record r, schema_p s, field_desc_p f,
                                int (*op) (int, int), int val) {
+  if (s->tbl->layout == COL_LAYOUT)
+    return col_find_record_int_val(r, s, f, op, val);
+  tbl_p t = s->tbl;
+  page_p pg = t->current_pg;
+  for (;;) {
+    /* with PAX_LAYOUT, the values compared here are contiguous in the page */
+    if (zm_may_match(s, f, page_block_nr(pg), op, val)
+        && bloom_may_match(f, page_block_nr(pg), op, val))
+      for (int n = page_num_records(pg); t->current_rec < n; t->current_rec++)
+        if (!rec_freed(s, pg, t->current_rec)
+            && (*op) (val, page_rec_int(s, pg, f, t->current_rec))) {
+          get_page_record(pg, r, s);
+          return 1;
+        }
+
+    /* move on to the next block that may have a match, without reading
+       the blocks in between. If there is none, the position stays at the
+       end of the current block. */
+    t->current_rec = page_num_records(pg);
+    int blk = page_block_nr(pg) + 1, num_blocks = file_num_blocks(s->name);
+    for (; blk < num_blocks; blk++)
+      if (!zm_may_match(s, f, blk, op, val))
+        pager_profiler_count(zm_skipped_event, 1);
+      else if (bloom_may_match(f, blk, op, val))
+        break;
+    if (blk >= num_blocks)
+      return 0;
+    unpin(pg);
+    pg = get_page(s->name, blk);
+    if (!pg) {
+      put_msg(FATAL, "find_record_int_val failed at block %d\n", blk);
+      exit(EXIT_FAILURE);
+    }
+    t->current_pg = pg;
+    t->current_rec = 0;
+  }
+}
+
+/** @b lfind_record_int_val
+ * 
+ * fetches the record at the current position into r if it satisfies the
+ * condition, which ends a scan of a sorted field from a bound
+ */
+static int lfind_record_int_val(record r, schema_p s, field_desc_p f,
+                                int (*op) (int, int), int val)
+{
+  if (s->tbl->layout == COL_LAYOUT) {
+    if (s->tbl->current_rec >= s->tbl->num_records
+        || !(*op) (val, get_col_int(s, f, s->tbl->current_rec)))
+      return 0;
+    return get_col_record(r, s, s);
+  }
   page_p pg = get_page_for_next_record(s);
   if (!pg) return 0;
-  int pos, rec_val;
-  for (; pg; pg = get_page_for_next_record(s)) {
-    pos = page_current_pos(pg);
-    rec_val = page_get_int_at (pg, pos + offset);
-    if ((*op) (val, rec_val)) {
-      page_set_current_pos(pg, pos);
-      get_page_record(pg, r, s);
-      return 1;
+  if (!(*op) (val, page_rec_int(s, pg, f, s->tbl->current_rec)))
+    return 0;
+  return get_page_record(pg, r, s);
+}
+
+/** @b before_bound
+ * 
+ * returns true if a record with value rec_val of a sorted field comes before
+ * the first record whose value is not below val, or above val if above is set
+ */
+static int before_bound(int rec_val, int val, int above) {
+  return above ? rec_val <= val : rec_val < val;
+}
+
+/** @b page_bound
+ * 
+ * returns the index of the first record of the page, starting at low and
+ * before end, that does not come before the bound, or end if there is none
+ */
+static int page_bound(schema_p s, page_p pg, field_desc_p f,
+                      int low, int end, int val, int above) {
+  int mid;
+  while (low < end) {
+    mid = AVG(low, end);
+    if (before_bound(page_rec_int(s, pg, f, mid), val, above))
+      low = mid + 1;
+    else
+      end = mid;
+  }
+  return low;
+}
+
+/** @b col_bound
+ * 
+ * same as page_bound, for the records low to end of a COL_LAYOUT table
+ */
+static int col_bound(schema_p s, field_desc_p f,
+                     int low, int end, int val, int above) {
+  int mid;
+  while (low < end) {
+    mid = AVG(low, end);
+    if (before_bound(get_col_int(s, f, mid), val, above))
+      low = mid + 1;
+    else
+      end = mid;
+  }
+  return low;
+}
+
+/** @b block_int_range
+ * 
+ * gets the values of field f of the first and the last record in block blk,
+ * which for a COL_LAYOUT table is a block of its int columns.
+ * Returns 0 if the block has no records.
+ */
+static int block_int_range(schema_p s, field_desc_p f, int blk,
+                           int *first, int *last) {
+  tbl_p t = s->tbl;
+  if (t->layout == COL_LAYOUT) {
+    int low = blk * col_capacity(f), end = low + col_capacity(f);
+    if (end > t->num_records) end = t->num_records;
+    if (low >= end)
+      return 0;
+    *first = get_col_int(s, f, low);
+    *last = get_col_int(s, f, end - 1);
+    return 1;
+  }
+  page_p pg = get_page(s->name, blk);
+  if (!pg) return 0;
+  int n = page_num_records(pg);
+  if (n > 0) {
+    *first = page_rec_int(s, pg, f, 0);
+    *last = page_rec_int(s, pg, f, n - 1);
+  }
+  if (pg != t->current_pg)
+    unpin(pg);
+  return n > 0;
+}
+
+/** @b block_last_int
+ * 
+ * returns the value of field f of the last record in block blk,
+ * INT_MAX if the block has no records
+ */
+static int block_last_int(schema_p s, field_desc_p f, int blk) {
+  int first, last;
+  return block_int_range(s, f, blk, &first, &last) ? last : INT_MAX;
+}
+
+/** @b block_bound
+ * 
+ * returns the first of the blocks low to end whose last value does not come
+ * before the bound, or end if there is none, reading one block per step.
+ * Returns -1 if it turns out that the field is not sorted.
+ */
+static int block_bound(schema_p s, field_desc_p f,
+                       int low, int end, int val, int above) {
+  int mid, first, last;
+  while (low < end) {
+    mid = AVG(low, end);
+    if (!block_int_range(s, f, mid, &first, &last)) {
+      end = mid;
+      continue;
+    }
+    if (first > last) {
+      put_msg(DEBUG, "Field %s is not sorted in block %d\n", f->name, mid);
+      return -1;
+    }
+    if (before_bound(last, val, above))
+      low = mid + 1;
+    else
+      end = mid;
+  }
+  return low;
+}
+
+/** @b interp_bound
+ * 
+ * same as bisecting the sorted keys low to end for the first one that does
+ * not come before the bound, but probing where the bound would be if the
+ * keys were spread evenly between the keys known to be on each side of it.
+ * key(s, f, i) gives the i-th key.
+ * 
+ * When a probe did not halve the keys left, for example because the keys
+ * are skewed, the next probe bisects them, so that there are never more
+ * than about twice the probes of bisection.
+ */
+static int interp_bound(schema_p s, field_desc_p f,
+                        int (*key) (schema_p, field_desc_p, int),
+                        int low, int end, int val, int above) {
+  if (low >= end)
+    return low;
+  int low_key = key(s, f, low);
+  if (!before_bound(low_key, val, above))
+    return low;
+  int high = end - 1, high_key = key(s, f, high);
+  if (before_bound(high_key, val, above))
+    return end;
+
+  /* key low comes before the bound and key high does not */
+  int mid, mid_key, width, bisect = 0;
+  while (high - low > 1) {
+    width = high - low;
+    if (bisect || high_key <= low_key)
+      mid = AVG(low, high);
+    else
+      mid = low + (int) (((double) val - low_key) / ((double) high_key - low_key)
+                         * width);
+    if (mid <= low) mid = low + 1;
+    if (mid >= high) mid = high - 1;
+    mid_key = key(s, f, mid);
+    if (before_bound(mid_key, val, above)) {
+      low = mid;
+      low_key = mid_key;
+    } else {
+      high = mid;
+      high_key = mid_key;
+    }
+    bisect = !bisect && 2 * (high - low) > width;
+  }
+  return high;
+}
+
+/** @b seek_bound
+ * 
+ * sets the current position of the table to the bound in block blk,
+ * see bfind_first_int_val(). Returns 0 if blk is not before end.
+ */
+static int seek_bound(schema_p s, field_desc_p f, int blk, int end,
+                      int val, int above) {
+  tbl_p t = s->tbl;
+  if (blk >= end)
+    return 0;
+
+  if (t->layout == COL_LAYOUT) {
+    int last = (blk + 1) * col_capacity(f);
+    if (last > t->num_records) last = t->num_records;
+    t->current_rec = col_bound(s, f, blk * col_capacity(f), last, val, above);
+    return 1;
+  }
+
+  page_p pg = get_page(s->name, blk);
+  if (!pg) return 0;
+  if (t->current_pg && t->current_pg != pg)
+    unpin(t->current_pg);
+  t->current_pg = pg;
+  t->current_rec = page_bound(s, pg, f, 0, page_num_records(pg), val, above);
+  return 1;
+}
+
+/** @b fence_bfind_first_int_val
+ * 
+ * same as bfind_first_int_val, but with the fence keys, which give the
+ * block of the bound without reading any block but that one.
+ * 
+ * Returns -1 if the field has no fence keys.
+ */
+static int fence_bfind_first_int_val(schema_p s, field_desc_p f, int val, int above)
+{
+  int *fences = fence_keys(s, f);
+  if (!fences)
+    return -1;
+
+  /* the first block whose first value does not come before the bound */
+  int low = 0, high = f->num_fences, mid;
+  while (low < high) {
+    mid = AVG(low, high);
+    if (before_bound(fences[mid], val, above))
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  /* the bound is in the block before it, unless all the values of that block
+     come before the bound */
+  int min, max;
+  if (low > 0 && zm_bounds(s, f, low - 1, &min, &max)
+      && !before_bound(max, val, above))
+    low--;
+
+  /* bisecting the blocks would have read one block per step */
+  int steps = 0;
+  for (int n = f->num_fences; n > 1; n = (n + 1) / 2)
+    steps++;
+  pager_profiler_count(fence_saved_event, steps);
+
+  return seek_bound(s, f, low, f->num_fences, val, above);
+}
+
+/** @b learned_bfind_first_int_val
+ * 
+ * same as bfind_first_int_val, but with the learned index, bisecting only
+ * the blocks within the error window around the predicted block.
+ * The zone map tells if the bound is outside the window after all, which
+ * happens when it is in a run of equal values across blocks.
+ * 
+ * Returns -1 if the field has no learned index, or if it turns out that the
+ * field is not sorted.
+ */
+static int learned_bfind_first_int_val(schema_p s, field_desc_p f,
+                                       int val, int above)
+{
+  if (!learned_index(s, f))
+    return -1;
+
+  int num_blocks = s->tbl->zm_num_blocks;
+  double pred = pla_predict(f, val);
+  if (pred < 0) pred = 0;
+  if (pred > num_blocks) pred = num_blocks;
+  /* values between the smallest values of two blocks are predicted
+     between them, and their bound may also be in the block before */
+  int low = (int) pred - PLA_ERROR - 1, end = (int) pred + PLA_ERROR + 2;
+  if (low < 0) low = 0;
+  if (end > num_blocks) end = num_blocks;
+
+  int blk = block_bound(s, f, low, end, val, above);
+  int min, max;
+  if (blk == low && low > 0 && zm_bounds(s, f, low - 1, &min, &max)
+      && !before_bound(max, val, above)) {
+    pager_profiler_count(pla_miss_event, 1);
+    blk = block_bound(s, f, 0, low, val, above);
+  } else if (blk == end && end < num_blocks && zm_bounds(s, f, end, &min, &max)
+             && before_bound(max, val, above)) {
+    pager_profiler_count(pla_miss_event, 1);
+    blk = block_bound(s, f, end + 1, num_blocks, val, above);
+  }
+  if (blk < 0)
+    return -1;
+  return seek_bound(s, f, blk, num_blocks, val, above);
+}
+
+static search_method srch_method = SEARCH_AUTO;
+
+/** @b bfind_first_int_val
+ * 
+ * Sets the current position of the table to the first record where the value
+ * of the sorted field f is not below val, or is above val if @em above is set.
+ * That is, to the lower or the upper bound of val, from where the records
+ * satisfying =, >= or > can be scanned.
+ * 
+ * The block of the bound is found as the @ref search_method says. The blocks
+ * are bisected if there is no zone map to make the fence keys or the learned
+ * index from.
+ * 
+ * Returns 0 if there is no such record, 1 upon success, and -1 if it turns
+ * out that the field is not sorted.
+ * 
+ * @param s       schema of table to search
+ * @param f       field to compare
+ * @param val     reference value
+ * @param above   whether to find the upper bound
+ */
+static int bfind_first_int_val(schema_p s, field_desc_p f, int val, int above)
+{
+  int res = -1;
+  if (srch_method == SEARCH_LEARNED)
+    res = learned_bfind_first_int_val(s, f, val, above);
+  else if (srch_method == SEARCH_AUTO)
+    res = fence_bfind_first_int_val(s, f, val, above);
+  if (res >= 0)
+    return res;
+
+  int num_blocks = zm_data_blocks(s), blk;
+  if (srch_method == SEARCH_INTERPOLATION)
+    blk = interp_bound(s, f, block_last_int, 0, num_blocks, val, above);
+  else
+    blk = block_bound(s, f, 0, num_blocks, val, above);
+  if (blk < 0)
+    return -1;
+  return seek_bound(s, f, blk, num_blocks, val, above);
+}
+
+/** @b pack_row
+ * 
+ * writes the provided record (of format in schema) into buf
+ * as it is stored with ROW_LAYOUT: the fields, with a reference
+ * in place of each str value, followed by the str values
+ * 
+ * returns the length of the stored record
+ * 
+ * @param r   record to be packed
+ * @param s   format schema
+ * @param buf destination, at least s->row_len + s->len bytes
+ */
+static int pack_row(record r, schema_p s, char *buf) {
+  int pos = s->row_len;
+  field_desc_p f;
+  size_t j = 0;
+  for (f = s->first; f; f = f->next, j++)
+    if (is_int_field(f))
+      memcpy(buf + f->row_offset, r[j], INT_SIZE);
+    else {
+      int len = strnlen((char *)r[j], f->len);
+      int ref = STR_REF(pos, len);
+      memcpy(buf + f->row_offset, &ref, STR_REF_SIZE);
+      memcpy(buf + pos, r[j], len);
+      pos += len;
+    }
+  return pos;
+}
+
+/** @b write_page_record
+ * 
+ * write the provided record (of format in schema)
+ * as the i-th record of the page
+ * 
+ * returns 0 if there is no space left in the page for a longer record
+ * 
+ * @param p  destination page
+ * @param r  record to be written
+ * @param s  format schema
+ * @param i  index of the record in the page
+ */
+static int write_page_record(page_p p, record r, schema_p s, int i) {
+  if (s->tbl->layout == ROW_LAYOUT) {
+    char buf[s->row_len + s->len];
+    if (!page_resize_slot(p, i, buf, pack_row(r, s, buf)))
+      return 0;
+    zm_widen_record(s, page_block_nr(p), r);
+    return 1;
+  }
+  zm_widen_record(s, page_block_nr(p), r);
+  field_desc_p fld_desc;
+  size_t j = 0;
+  for (fld_desc = s->first;
+       fld_desc;
+       fld_desc = fld_desc->next, j++)
+    if (is_int_field(fld_desc))
+      page_put_int_at(p, fld_pos(s, p, fld_desc, i), *(int *)r[j]);
+    else
+      page_put_str_at(p, fld_pos(s, p, fld_desc, i), (char *)r[j], fld_desc->len);
+  return 1;
+}
+
+/** @b put_page_record
+ * 
+ * add the provided record (of format in schema)
+ * after the last record of page
+ * 
+ * returns 0 if there is no space left in the page
+ * 
+ * @param p  destination page
+ * @param r  record to be written
+ * @param s  format schema
+ */
+static int put_page_record(page_p p, record r, schema_p s) {
+  if (s->tbl->layout == ROW_LAYOUT) {
+    char buf[s->row_len + s->len];
+    if (page_add_slot(p, buf, pack_row(r, s, buf)) < 0)
+      return 0;
+    zm_widen_record(s, page_block_nr(p), r);
+    return 1;
+  }
+
+  int n = page_num_records(p);
+  if (n >= pax_capacity(s))
+    return 0;
+  if (n == 0) /* divide the block into one minipage per field */
+    page_set_free_pos(p, PAGE_HEADER_SIZE + pax_capacity(s) * s->len);
+
+  write_page_record(p, r, s, n);
+  page_set_num_records(p, n + 1);
+  return 1;
+}
+
+/** @brief Indexes
+
+A field may have a B+-tree index, a hash index and a bitmap index, made by
+create_index() and kept in the files "table.field.bt", "table.field.hash"
+and "table.field.bm". Their entries lead from the values of the field to the
+records, each identified by its block and slot, or for a COL_LAYOUT table
+by block 0 and the number of the record. The entries are added and removed
+as records are written and deleted.
+
+A bitmap index is kept in memory, like a zone map, and saved by close_db().
+It is read with the descriptor of the table, and made anew from the table
+if it was not saved after its last change.
+*/
+
+/** @b current_rid
+ * 
+ * gets the block and the slot of the record before the current position,
+ * that is, of the record just fetched or written
+ */
+static void current_rid(tbl_p t, int *blk, int *slot) {
+  *blk = t->layout == COL_LAYOUT ? 0 : page_block_nr(t->current_pg);
+  *slot = t->current_rec - 1;
+}
+
+static int is_indexed(field_desc_p f) {
+  return f->bt_fname || f->hash_fname || f->bm_fname || f->bf_fname;
+}
+
+/** @b bm_pos
+ * 
+ * returns the position in a bitmap of the record in slot slot of block blk.
+ * A record takes at least a byte of its block, so a block has fewer than
+ * BLOCK_SIZE slots. In a COL_LAYOUT table, where blk is 0, this is the
+ * number of the record.
+ */
+static int bm_pos(int blk, int slot) {
+  return blk * BLOCK_SIZE + slot;
+}
+
+/** @b build_bitmaps
+ * 
+ * makes the bitmap index of the j-th field from the records
+ */
+static bm_index* build_bitmaps(schema_p s, int j) {
+  bm_index *bi = bmi_new();
+  record rec = new_record(s);
+  int blk, slot;
+  set_tbl_position(s->tbl, TBL_BEG);
+  while (get_record(rec, s)) {
+    current_rid(s->tbl, &blk, &slot);
+    bm_set(bmi_bitmap(bi, *(int *)rec[j], 1), bm_pos(blk, slot));
+  }
+  release_record(rec, s);
+  return bi;
+}
+
+/** @b bf_block
+ * 
+ * returns the block whose Bloom filter holds the value of the record in
+ * slot slot of block blk: the block of the record in the int columns of a
+ * COL_LAYOUT table, where blk is 0, and otherwise blk
+ */
+static int bf_block(schema_p s, int blk, int slot) {
+  return s->tbl->layout == COL_LAYOUT ? zm_block(slot) : blk;
+}
+
+static double bloom_fpr = 0.01;
+
+void set_bloom_fpr(double fpr) {
+  if (fpr <= 0 || fpr >= 1)
+    put_msg(ERROR, "The false positive rate %g is not between 0 and 1.\n", fpr);
+  else
+    bloom_fpr = fpr;
+}
+
+/** @b build_bloom_filters
+ * 
+ * makes the Bloom filters of field f, the j-th field, from the records,
+ * sized for the number of values of f in a block
+ */
+static bloom_filters* build_bloom_filters(schema_p s, field_desc_p f, int j) {
+  bloom_filters *bf = bf_new(bloom_fpr, s->tbl->layout == COL_LAYOUT ?
+                             col_capacity(f) : pax_capacity(s));
+  record rec = new_record(s);
+  int blk, slot;
+  set_tbl_position(s->tbl, TBL_BEG);
+  while (get_record(rec, s)) {
+    current_rid(s->tbl, &blk, &slot);
+    bf_add(bf, bf_block(s, blk, slot), *(int *)rec[j]);
+  }
+  release_record(rec, s);
+  return bf;
+}
+
+/** @b load_mem_indexes
+ * 
+ * reads the indexes of the table that are kept in memory, rebuilding those
+ * that were not saved after their last change
+ */
+static void load_mem_indexes(tbl_p t) {
+  field_desc_p f;
+  int j = 0;
+  for (f = t->sch->first; f; f = f->next, j++) {
+    if (f->bm_fname && !f->bm && !(f->bm = bmi_load(f->bm_fname))) {
+      put_msg(INFO, "Rebuilding the bitmap index of \"%s\" of \"%s\".\n",
+              f->name, t->sch->name);
+      f->bm = build_bitmaps(t->sch, j);
+    }
+    if (f->bf_fname && !f->bf && !(f->bf = bf_load(f->bf_fname))) {
+      put_msg(INFO, "Rebuilding the Bloom filters of \"%s\" of \"%s\".\n",
+              f->name, t->sch->name);
+      f->bf = build_bloom_filters(t->sch, f, j);
+    }
+  }
+}
+
+static void save_mem_indexes(tbl_p t) {
+  for (field_desc_p f = t->sch->first; f; f = f->next) {
+    if (f->bm)
+      bmi_save(f->bm, f->bm_fname);
+    if (f->bf)
+      bf_save(f->bf, f->bf_fname);
+  }
+}
+
+/** @b index_field
+ * 
+ * adds (add = 1) or removes (add = 0) the entries of value val of field f,
+ * for the record in slot slot of block blk, in the indexes of f.
+ * A Bloom filter cannot remove a value, which then only makes it
+ * less selective.
+ */
+static void index_field(schema_p s, field_desc_p f, int val,
+                        int blk, int slot, int add) {
+  if (f->bt_fname) {
+    if (add)
+      bt_insert(f->bt_fname, val, blk, slot);
+    else
+      bt_delete(f->bt_fname, val, blk, slot);
+  }
+  if (f->hash_fname) {
+    if (add)
+      hash_insert(f->hash_fname, val, blk, slot);
+    else
+      hash_delete(f->hash_fname, val, blk, slot);
+  }
+  if (f->bm) {
+    bmi_changed(f->bm, f->bm_fname);
+    rl_bitmap *b = bmi_bitmap(f->bm, val, add);
+    if (add)
+      bm_set(b, bm_pos(blk, slot));
+    else if (b)
+      bm_clear(b, bm_pos(blk, slot));
+  }
+  if (f->bf && add) {
+    bf_changed(f->bf, f->bf_fname);
+    bf_add(f->bf, bf_block(s, blk, slot), val);
+  }
+}
+
+/** @b index_record
+ * 
+ * adds (add = 1) or removes (add = 0) the index entries of record r,
+ * which is in slot slot of block blk
+ */
+static void index_record(schema_p s, record r, int blk, int slot, int add) {
+  field_desc_p f;
+  size_t j = 0;
+  for (f = s->first; f; f = f->next, j++)
+    if (is_indexed(f))
+      index_field(s, f, *(int *)r[j], blk, slot, add);
+}
+
+/** @b reindex_field
+ * 
+ * moves the index entry of the record in slot slot of block blk
+ * from value old_val of field f to new_val
+ */
+static void reindex_field(schema_p s, field_desc_p f, int old_val,
+                          int new_val, int blk, int slot) {
+  if (old_val != new_val) {
+    index_field(s, f, old_val, blk, slot, 0);
+    index_field(s, f, new_val, blk, slot, 1);
+  }
+}
+
+/** @b peek_indexed_record
+ * 
+ * returns a copy of the record at the current position, which is about to
+ * be overwritten, or NULL if the table has no index to update
+ */
+static record peek_indexed_record(schema_p s) {
+  tbl_p t = s->tbl;
+  if (num_indexes(s) == 0)
+    return 0;
+  record r = new_record(s);
+  int i = t->current_rec;
+  if (t->layout == COL_LAYOUT)
+    get_col_record(r, s, s);
+  else
+    get_page_record(t->current_pg, r, s);
+  t->current_rec = i;
+  return r;
+}
+
+/** @b index_written_record
+ * 
+ * updates the indexes for record r, just written before the current
+ * position, in place of record old, or as a new record if old is NULL.
+ * old is released.
+ */
+static void index_written_record(schema_p s, record old, record r) {
+  int blk, slot;
+  if (num_indexes(s) == 0)
+    return;
+  current_rid(s->tbl, &blk, &slot);
+  if (!old) {
+    index_record(s, r, blk, slot, 1);
+    return;
+  }
+  field_desc_p f;
+  size_t j = 0;
+  for (f = s->first; f; f = f->next, j++)
+    if (is_indexed(f))
+      reindex_field(s, f, *(int *)old[j], *(int *)r[j], blk, slot);
+  release_record(old, s);
+}
+
+/** @b free_current_record
+ * 
+ * deletes record r, just fetched from a ROW_LAYOUT table.
+ * Its slot remains, so that the other records keep their slots.
+ */
+static void free_current_record(schema_p s, record r) {
+  tbl_p t = s->tbl;
+  int blk, slot;
+  current_rid(t, &blk, &slot);
+  index_record(s, r, blk, slot, 0);
+  page_free_slot(t->current_pg, slot);
+  t->num_records--;
+  t->num_freed++;
+}
+
+/** @b track_sorted
+ * 
+ * keeps track of whether the int fields stay sorted,
+ * as record r is appended to the table
+ */
+static void track_sorted(record r, schema_p s) {
+  field_desc_p f;
+  size_t j = 0;
+  for (f = s->first; f; f = f->next, j++)
+    if (is_int_field(f)) {
+      if (*(int *)r[j] < f->last_val)
+        f->sorted = 0;
+      f->last_val = *(int *)r[j];
+    }
+}
+
+static void forget_sorted(schema_p s) {
+  for (field_desc_p f = s->first; f; f = f->next)
+    f->sorted = 0;
+}
+
+/** @b put_record
+ * 
+ * writes the provided record to the current position of the schema,
+ * overwriting the record there if there is one
+ * 
+ * @param r  record to be written
+ * @param s  target schema
+ */
+int put_record(record r, schema_p s) {
+  tbl_p t = s->tbl;
+  record old = 0; /* the record overwritten */
+  if (t->layout == COL_LAYOUT) {
+    if (t->current_rec > t->num_records)
+      return 0;
+    if (t->current_rec == t->num_records)
+      track_sorted(r, s);
+    else {
+      forget_sorted(s);
+      old = peek_indexed_record(s);
+    }
+    put_col_record(r, s, t->current_rec);
+    if (t->current_rec++ == t->num_records)
+      t->num_records++;
+    index_written_record(s, old, r);
+    return 1;
+  }
+  page_p p = t->current_pg;
+  int n = page_num_records(p);
+
+  if (t->current_rec < n) {
+    old = peek_indexed_record(s);
+    if (!write_page_record(p, r, s, t->current_rec)) {
+      if (old) release_record(old, s);
+      return 0;
+    }
+    forget_sorted(s);
+  } else if (t->current_rec == n && put_page_record(p, r, s)) {
+    /* the end of a block is the end of the table in the last block only */
+    if (is_last_page(s, p))
+      track_sorted(r, s);
+    else
+      forget_sorted(s);
+    t->num_records++;
+  } else
+    return 0;
+  t->current_rec++;
+  index_written_record(s, old, r);
+  return 1;
+}
+
+/** @b append_record
+ * 
+ * writes the provided record to the end of the schema
+ * 
+ * @param r  record to be written
+ * @param s  target schema
+ */
+void append_record(record r, schema_p s) {
+  tbl_p tbl = s->tbl;
+  track_sorted(r, s);
+  if (tbl->layout == COL_LAYOUT) {
+    put_col_record(r, s, tbl->num_records);
+    tbl->current_rec = ++tbl->num_records;
+    index_written_record(s, 0, r);
+    return;
+  }
+  page_p pg = get_page_for_append(s->name);
+  if (!pg) {
+    put_msg(FATAL, "Failed to get page for appending to \"%s\".\n",
+            s->name);
+    exit(EXIT_FAILURE);
+  }
+  if (!put_page_record(pg, r, s)) {
+    /* not enough space in the current page */
+    unpin(pg);
+    pg = get_next_page(pg);
+    if (!pg) {
+      put_msg(FATAL, "Failed to get page for \"%s\" block %d.\n",
+              s->name, page_block_nr(pg) + 1);
+      exit(EXIT_FAILURE);
+    }
+    if (!put_page_record(pg, r, s)) {
+      put_msg(FATAL, "Failed to put record to page for \"%s\" block %d.\n",
+              s->name, page_block_nr(pg) + 1);
+      exit(EXIT_FAILURE);
     }
-    else
-      page_set_current_pos(pg, pos + s->len);
   }
-  return 0;
+  tbl->current_pg = pg;
+  tbl->current_rec = page_num_records(pg);
+  tbl->num_records++;
+  index_written_record(s, 0, r);
 }
 
-static int lfind_record_int_val(record r, schema_p s, int offset, int val)
-{
-  page_p pg = get_page_for_next_record(s);
-  if (!pg) return 0;
-  int pos, rec_val;
-  for (; pg; pg = get_page_for_next_record(s)) {
-    pos = page_current_pos(pg);
-    rec_val = page_get_int_at (pg, pos + offset);
-    if (rec_val == val) {
-      page_set_current_pos(pg, pos);
-      get_page_record(pg, r, s);
-      return 1;
-    }
+static void display_header(schema_p s) {
+  for (field_desc_p f = s->first; f; f = f->next)
+    put_msg(FORCE, "%20s", f->name);
+  put_msg(FORCE, "\n");
+  for (field_desc_p f = s->first; f; f = f->next) {
+    for (size_t i = 0; i < 20 - strlen(f->name); i++)
+      put_msg(FORCE, " ");
+    for (size_t i = 0; i < strlen(f->name); i++)
+      put_msg(FORCE, "-");
+  }
+  put_msg(FORCE, "\n");
+}
+
+static void display_record(record r, schema_p s) {
+  field_desc_p f = s->first;
+  for (size_t i = 0; f; f = f->next, i++) {
+    if (is_int_field(f))
+      put_msg(FORCE, "%20d", *(int *)r[i]);
     else
-      return 0;
+      put_msg(FORCE, "%20s", (char *)r[i]);
   }
-  return 0;
+  put_msg(FORCE, "\n");
 }
 
-// this is a shorthand for taking the average index of two records,
-// with their positions as arguments
-#define I(pos)      (pos-PAGE_HEADER_SIZE)/s->len // < index given position
-#define P(ind)      ind*s->len+PAGE_HEADER_SIZE   // < position given index
-#define AVG(x1,x2)  (x1+x2)/2                     // < geometric mean of two numbers
-#define pAVG(p1,p2) P(AVG(I(p1),I(p2)))           // < the position of the index mean of two other positions
+void table_display(tbl_p t) {
+  if (!t) {
+    put_msg(INFO,  "Trying to display non-existant table.\n");
+    return;
+  }
+  display_header(t->sch);
+
+  schema_p s = t->sch;
+  record rec = new_record(s);
+  set_tbl_position(t, TBL_BEG);
+  while (get_record(rec, s)) {
+    display_record(rec, s);
+  }
+  put_msg(FORCE, "\n");
 
-/** @b bfind_page_first_int_val
- * 
- * Searches for the first occurence of value val within the page, at the given offset.
- * 
- * returns the position if found, else -1
- * 
- * @param s       schema for reference
- * @param pg      page to search
- * @param offset  offset of value within record
- * @param val     reference value
- */
-static int bfind_page_first_int_val(schema_p s, page_p pg, int offset, int val)
+  release_record(rec, s);
+}
+
+static void *interpret_op (const char * const op)
 {
-  int rec_val, pos=0;
+  switch (op[0])
+  {
+  case '=':
 
-  int low  = page_seek(pg, P_BEG, 0),
-      high = page_seek(pg, P_END, -s->len);
+    if (op[1] == '\0')
+      return int_eq;
 
-  int lowest = low;
+  break;
+  case '!':
+  
+    if (op[1] == '=')
+      if (!op[2])
+        return int_neq;
 
-  while (high != low) { // at first iteration will never be true, since parent function covers the case of only one record
-    pos = pAVG(low,high);
-    if (pos == low)
-      break;
-    rec_val = page_get_int_at(pg, pos+offset);
+  break;
+  case '<':
+
+    switch (op[1])
+    {
+    case '\0':
     
-    if (rec_val == val) {
-      if (pos > lowest) {
-        rec_val = page_get_int_at(pg, pos - s->len + offset);
-        if (rec_val != val)
-          return pos;
-        else {
-          high = pos;
-          continue;
-        }
-      } else 
-        return pos;
-    } else if (rec_val < val) {
-      low = pos;
-      continue;
-    } else if (rec_val > val) {
-      high = pos;
-      continue;
+      return int_l;
+    
+    case '=':
+    
+      if (!op[2])
+        return int_le;
+    
+    }
+    
+  break;
+  case '>':
+
+    switch (op[1])
+    {
+    case '\0':
+    
+      return int_g;
+    
+    break;
+    case '=':
+    
+      if (!op[2])
+        return int_ge;
+    
+    break;
     }
+  
+  break;
   }
 
-  return -1;
+  return NULL;
 }
 
-typedef enum {
-  WITHIN = 0,
-  FIRST,
-  LAST,
-  BELOW,
-  ABOVE,
-} check_res;
-
-/** @b val_in_page_range
- * Checks where the reference value would reside as compared to the
- * extremities of the page.
+/** @b where_field
  * 
- * @returns:
- *  - FIRST:  value is found at the beginning of the page
- *  - LAST:   value is found uniquely at the end of the page
- *  - WITHIN: value is either between the first and last record values of the page,
- *            or the value is found at the end of the page, but not uniquely
- *  - BELOW:  value is less than the first record value
- *  - ABOVE:  value is greater than the last record value
+ * returns the int field attr of schema s, and sets cmp_op to the
+ * comparison of op, or returns NULL if they are not valid for a search
  */
-static check_res val_in_page_range(schema_p s, page_p pg, int offset, int val)
-{
-  int first = page_seek(pg, P_BEG, offset),
-      last;
-  int rec_val = page_get_int(pg);
+static field_desc_p where_field(schema_p s, char const* attr, char const* op,
+                                int (**cmp_op)()) {
+  *cmp_op = interpret_op(op);
 
-  if (val < rec_val) {
-    return BELOW; // case value is below range
-  } else
-  if (val == rec_val) {
-    return FIRST; // case value is first in range
+  if (!*cmp_op) {
+    put_msg(ERROR, "unknown comparison operator \"%s\".\n", op);
+    return 0;
   }
 
-  last = page_seek(pg, P_END, -s->len+offset);
-  if (last == first) {
-    return ABOVE; // case only one value
+  field_desc_p f = get_field(s, attr);
+  if (!f) {
+    put_msg(ERROR, "\"%s\" has no \"%s\" field\n", s->name, attr);
+    return 0;
   }
+  if (f->type != INT_TYPE) {
+    put_msg(ERROR, "\"%s\" is not an integer field.\n", attr);
+    return 0;
+  }
+  return f;
+}
 
-  rec_val = page_get_int(pg);
-
-  if (val > rec_val) {
-    return ABOVE; // case value is above range
-  } else
-  if (val == rec_val) {
-    if (val != page_get_int_at(pg, last - s->len))
-      return LAST; // case value is last in range
+/** @b get_record_at
+ * 
+ * fetches the record in slot slot of block blk into r, see current_rid().
+ * Returns 0 if there is no such record.
+ */
+static int get_record_at(record r, schema_p s, int blk, int slot) {
+  tbl_p t = s->tbl;
+  if (t->layout == COL_LAYOUT) {
+    t->current_rec = slot;
+    return get_col_record(r, s, s);
   }
+  page_p pg = get_page(s->name, blk);
+  if (!pg) return 0;
+  if (t->current_pg && t->current_pg != pg)
+    unpin(t->current_pg);
+  t->current_pg = pg;
+  if (slot >= page_num_records(pg) || rec_freed(s, pg, slot))
+    return 0;
+  t->current_rec = slot;
+  return get_page_record(pg, r, s);
+}
 
-  return WITHIN; // otherwise is within range
+static int cmp_rid(void const* x, void const* y) {
+  int const *a = x, *b = y;
+  return a[0] != b[0] ? (a[0] > b[0]) - (a[0] < b[0])
+                      : (a[1] > b[1]) - (a[1] < b[1]);
+}
 
+static int *add_rid(int *rids, int *n, int *max, int blk, int slot) {
+  if (*n == *max) {
+    *max = *max ? 2 * *max : 64;
+    rids = realloc(rids, 2 * *max * sizeof (int));
+  }
+  rids[2 * *n] = blk;
+  rids[2 * *n + 1] = slot;
+  (*n)++;
+  return rids;
 }
 
-/** @b bfind_first_int_val
+/** @b matching_bitmap
  * 
- * Sets the current position of the table to the first record where the field at the
- * given offset matches value val.
- * If the value is not found, the page position remains unchanged.
- * 
- * Returns 0 upon failure, 1 upon success.
- * 
- * @param s       schema of table to search
- * @param offset  offset field 
- * @param val     reference value
+ * makes res the positions of the records where the condition on field f
+ * holds, the union of the bitmaps of the values that satisfy it
  */
-static int bfind_first_int_val(schema_p s, int offset, int val)
-{
-
-  int pos, high, low, mid;
-  page_p pg, cpg;
+static void matching_bitmap(field_desc_p f, int (*op) (int, int), int val,
+                            rl_bitmap *res) {
+  rl_bitmap tmp;
+  bm_init(res);
+  for (int i = 0; i < f->bm->num_vals; i++)
+    if ((*op) (val, f->bm->vals[i])) {
+      bm_or(&tmp, res, f->bm->maps + i);
+      bm_release(res);
+      *res = tmp;
+    }
+}
 
-  const char *const field_name = get_field_name_from_offset(s, offset);
-  if (!field_name){
-    put_msg(ERROR, "bfind_first_int_val: Passed invalid offset: %d", offset);
-    exit(EXIT_FAILURE);
+/** @b index_rids
+ * 
+ * returns the record ids (block and slot) of the records where the condition
+ * on field f holds, and sets num_rids to their number. They are found with
+ * the bitmap index of f for = and !=, or the hash index of f for =, if f has
+ * one, and otherwise with the B+-tree of f. The ids are sorted, so that the
+ * records are read in the order of the table and a block holding several of
+ * them is read only once.
+ */
+static int *index_rids(schema_p s, field_desc_p f, int (*op) (int, int),
+                       int val, int *num_rids) {
+  int key, blk, slot, n = 0, max = 0;
+  int *rids = 0;
+  if ((op == int_eq || op == int_neq) && f->bm) {
+    rl_bitmap b;
+    int col = s->tbl->layout == COL_LAYOUT;
+    matching_bitmap(f, op, val, &b);
+    for (int i = 0; i < b.num_runs; i++)
+      for (int p = b.runs[2 * i]; p < b.runs[2 * i] + b.runs[2 * i + 1]; p++)
+        rids = add_rid(rids, &n, &max, col ? 0 : p / BLOCK_SIZE,
+                       col ? p : p % BLOCK_SIZE);
+    bm_release(&b);
+  } else if (op == int_eq && f->hash_fname) {
+    hash_cursor hc;
+    hash_seek(&hc, f->hash_fname, val);
+    while (hash_next(&hc, &blk, &slot))
+      rids = add_rid(rids, &n, &max, blk, slot);
+  } else {
+    bt_cursor c;
+    if (op == int_l || op == int_le)
+      bt_seek(&c, f->bt_fname, INT_MIN, 0);
+    else
+      bt_seek(&c, f->bt_fname, val, op == int_g);
+    /* the entries are in the order of the keys, so the first one that does
+       not satisfy the condition ends the search */
+    while (bt_next(&c, &key, &blk, &slot) && (*op) (val, key))
+      rids = add_rid(rids, &n, &max, blk, slot);
   }
+  if (n > 1)
+    qsort(rids, n, 2 * sizeof (int), cmp_rid);
+  *num_rids = n;
+  return rids;
+}
 
-  // first check first page
-  pg = get_page(s->name, 0);
-  if (!pg)
-    goto not;
+/** @b find_next_record
+ * 
+ * fetches the next record satisfying the condition into r,
+ * or just the next record if there is no condition (f is NULL)
+ */
+static int find_next_record(record r, schema_p s, field_desc_p f,
+                            int (*op) (int, int), int val) {
+  return f ? find_record_int_val(r, s, f, op, val) : get_record(r, s);
+}
 
+void set_search_method(search_method method) {
+  srch_method = method;
+}
 
-  switch (val_in_page_range(s, pg, offset, val))
-  {
-  case FIRST:
-    
-    goto first;
-  
-  break;
-  case LAST:
+/* how a scan finds its records */
+#define SCAN_FILTER 0 /**< by the condition, if any, skipping the blocks that
+                           the zone map or the Bloom filters rule out */
+#define SCAN_BOUND  1 /**< from a bound of a sorted field, until a record
+                           does not satisfy the condition */
+#define SCAN_RIDS   2 /**< at the record ids found with an index */
+#define SCAN_NONE   3 /**< no more records */
+
+/** @brief Node of a query plan
+
+    A node produces the records of its schema one at a time, pulling the
+    records it needs from its inputs, so that no intermediate result is
+    written to a table. */
+typedef struct plan_struct {
+  schema_p sch;      /**< schema of the records produced */
+  int own_sch;       /**< whether sch is made for the node and released with it */
+  plan_p left;       /**< the input, or the left input of a join, NULL for a scan */
+  plan_p right;      /**< the right input of a join, NULL for the others */
+  int (*open) (plan_p p);              /**< starts producing records */
+  int (*next) (plan_p p, record r);    /**< produces the next record into r */
+  void (*close) (plan_p p);            /**< stops producing records */
+  void (*release) (plan_p p);          /**< releases the state, or NULL */
+  void *state;       /**< what the kind of node keeps between two records */
+} plan_struct;
+
+/** @brief State of a scan */
+typedef struct scan_state_struct {
+  tbl_p t;           /**< the table */
+  field_desc_p f;    /**< field of the condition, NULL for all records */
+  int (*op) (int, int); /**< comparison of the condition */
+  int val;           /**< value of the condition */
+  int linear;        /**< whether to scan with SCAN_FILTER, whatever the field has */
+  int by_join;       /**< whether the condition is set by a join, anew for
+                          every record of its left input */
+  schema_p cols;     /**< the fields to read of a COL_LAYOUT table scanned
+                          without condition, NULL for all */
+  int path;          /**< how the records are found, see @ref SCAN_FILTER */
+  int *rids;         /**< record ids found with an index, or NULL */
+  int num_rids;      /**< number of rids */
+  int next_rid;      /**< index of the next one in rids */
+} scan_state;
+
+static plan_p new_plan(schema_p sch, int own_sch, plan_p left, plan_p right,
+                       void *state) {
+  plan_p p = malloc(sizeof (plan_struct));
+  p->sch = sch;
+  p->own_sch = own_sch;
+  p->left = left;
+  p->right = right;
+  p->open = 0;
+  p->next = 0;
+  p->close = 0;
+  p->release = 0;
+  p->state = state;
+  return p;
+}
 
-    goto last;
+/** @b scan_open
+ * 
+ * chooses how the scan finds its records and moves to the first one
+ */
+static int scan_open(plan_p p) {
+  scan_state *st = p->state;
+  tbl_p t = st->t;
+  schema_p s = t->sch;
+  field_desc_p f = st->f;
+  int (*op) (int, int) = st->op;
+  int indexed = srch_method != SEARCH_LINEAR && !st->linear;
 
-  break;
-  case WITHIN:
+  free(st->rids);
+  st->rids = 0;
+  st->path = SCAN_FILTER;
+  set_tbl_position(t, TBL_BEG);
+  if (!f)
+    return 1;
+  /* A bitmap index tells where the records are without reading any block,
+     and an equality lookup with a hash index reads a bucket or so. */
+  if (indexed && (((op == int_eq || op == int_neq) && f->bm)
+                  || (op == int_eq && f->hash_fname))) {
+    st->rids = index_rids(s, f, op, st->val, &st->num_rids);
+    st->next_rid = 0;
+    st->path = SCAN_RIDS;
+    return 1;
+  }
+  /* On a sorted field, the records satisfying < and <= are at the beginning,
+     and the others start at a bound found by binary search. The scan stops
+     at the first record that does not satisfy the condition.
+     The binary search does not know about the slots of deleted records. */
+  if (indexed && op != int_neq && f->sorted && t->num_freed == 0) {
+    int found = 1;
+    if (op != int_l && op != int_le)
+      found = bfind_first_int_val(s, f, st->val, op == int_g);
+    if (found >= 0) {
+      st->path = found ? SCAN_BOUND : SCAN_NONE;
+      return 1;
+    }
+    f->sorted = 0;
+    set_tbl_position(t, TBL_BEG);
+  }
+  if (indexed && op != int_neq && f->bt_fname) {
+    st->rids = index_rids(s, f, op, st->val, &st->num_rids);
+    st->next_rid = 0;
+    st->path = SCAN_RIDS;
+  }
+  return 1;
+}
 
-    pos = bfind_page_first_int_val(s, pg, offset, val);
-    if (pos < 0)
-      goto not;
+static int scan_next(plan_p p, record r) {
+  scan_state *st = p->state;
+  schema_p s = st->t->sch;
+  int found = 0;
+  switch (st->path) {
+  case SCAN_RIDS:
+    while (!found && st->next_rid < st->num_rids) {
+      int *rid = st->rids + 2 * st->next_rid++;
+      found = get_record_at(r, s, rid[0], rid[1]);
+    }
+    break;
+  case SCAN_BOUND:
+    found = lfind_record_int_val(r, s, st->f, st->op, st->val);
+    break;
+  case SCAN_FILTER:
+    if (st->cols && !st->f)
+      found = get_col_record(r, st->cols, s);
     else
-      goto found;
-
-  break;
-  case BELOW: // below lowest value of table
-
-    goto not;
-
-  break;
-  case ABOVE:
-
-    // do nothing
-  
-  break;
+      found = find_next_record(r, s, st->f, st->op, st->val);
+    break;
   }
+  if (!found)
+    st->path = SCAN_NONE;
+  return found > 0;
+}
 
-  low = page_block_nr(pg);
-  unpin(pg); // release page, is no longer necessary
-
-  // second check last page
-  pg = get_page(s->name, -1); // get last page
-  high = page_block_nr(pg);
-  if (high == low) // only one page
-    goto not;
-
-
-  switch (val_in_page_range(s, pg, offset, val)) {
-  case FIRST: // first value of last page, could mean a lot of things
+static void scan_close(plan_p p) {
+  scan_state *st = p->state;
+  free(st->rids);
+  st->rids = 0;
+  st->path = SCAN_NONE;
+}
 
-    if (high-1 == low){
-      page_seek(pg, P_BEG, 0);
-      s->tbl->current_pg = pg;
-      return 1;
-    }
+static void scan_release(plan_p p) {
+  scan_close(p);
+  free(p->state);
+}
 
-    cpg = get_page(s->name, high-1);
+plan_p plan_scan(tbl_p t, char const* attr, char const* op, int val) {
+  if (!t) return 0;
+  int (*cmp_op)() = NULL;
+  field_desc_p f = 0;
+  if (attr && !(f = where_field(t->sch, attr, op, &cmp_op)))
+    return 0;
+  scan_state *st = malloc(sizeof (scan_state));
+  st->t = t;
+  st->f = f;
+  st->op = cmp_op;
+  st->val = val;
+  st->linear = 0;
+  st->by_join = 0;
+  st->cols = 0;
+  st->path = SCAN_NONE;
+  st->rids = 0;
+  plan_p p = new_plan(t->sch, 0, 0, 0, st);
+  p->open = scan_open;
+  p->next = scan_next;
+  p->close = scan_close;
+  p->release = scan_release;
+  return p;
+}
 
-    switch (val_in_page_range(s, cpg, offset, val))
-    {
-    case FIRST:
+schema_p plan_schema(plan_p p) {
+  return p ? p->sch : 0;
+}
 
-      unpin(pg);
-      pg = cpg;
-      high--;
+int plan_open(plan_p p) {
+  return p->open(p);
+}
 
-    break;
-    case LAST:
-      
-      unpin(pg);
-      pg = cpg;
-      goto last;
-      
-    break;
-    case WITHIN:
+int plan_next(plan_p p, record r) {
+  return p->next(p, r);
+}
 
-      unpin(pg);
-      pg = cpg;
+void plan_close(plan_p p) {
+  p->close(p);
+}
 
-      pos = bfind_page_first_int_val(s, pg, offset, val);
-      if (pos < 0)
-        goto not;
-      else
-        goto found;
+void plan_release(plan_p p) {
+  if (!p) return;
+  /* the state may hold records of the inputs */
+  if (p->release)
+    p->release(p);
+  plan_release(p->left);
+  plan_release(p->right);
+  if (p->own_sch)
+    release_schema(p->sch);
+  free(p);
+}
 
-    break;
-    case ABOVE:
+/* We restrict ourselves to search on an int attribute */
+tbl_p table_search(tbl_p t, char const* attr, char const* op, int val) {
+  if (!t) return 0;
 
-      unpin(cpg);
-      goto first;
-    
-    break;
-    case BELOW:
-
-      // this point should never be reached
-      put_msg(ERROR, "Field %s is not properly sorted, found %d before %d\n",
-                      field_name,
-                      page_get_int_at(cpg, page_seek(cpg, P_BEG, offset)),
-                      page_get_int_at(cpg, page_seek(pg, P_BEG, offset))
-              );
-      put_msg(ERROR, "Checking blocks:");
-      put_page_info(ERROR, cpg);
-      put_page_info(ERROR, pg);
-      put_schema_info(ERROR, s);
-      exit(EXIT_FAILURE);
+  schema_p s = t->sch;
+  plan_p p = plan_scan(t, attr, op, val);
+  if (!p) return 0;
 
-    break;
-    }
+  char *tmp_name = tmp_schema_name("select", s->name);
+  schema_p res_sch = copy_schema(s, tmp_name);
+  free(tmp_name);
+  res_sch->tbl->is_tmp = 1;
 
-  break;
-  case LAST:
+  record rec = new_record(s);
+  plan_open(p);
+  while (plan_next(p, rec))
+    append_record(rec, res_sch);
+  plan_close(p);
+  plan_release(p);
 
-    page_seek(pg, P_END, -s->len);
-    s->tbl->current_pg = pg;
-    return 1;
+  put_db_info(DEBUG);
+  release_record(rec, s);
 
-  break;
-  case WITHIN:
+  return res_sch->tbl;
+}
 
-    pos = bfind_page_first_int_val(s, pg, offset, val);
-    if (pos < 0)
-      goto not;
-    else
-      goto found;
+int table_count(tbl_p t, char const* attr, char const* op, int val) {
+  if (!t) return -1;
+  if (!attr) return t->num_records;
 
-  break;
-  case ABOVE:
+  int (*cmp_op)() = NULL;
+  field_desc_p f = where_field(t->sch, attr, op, &cmp_op);
+  if (!f) return -1;
+
+  int n = 0;
+  if (srch_method != SEARCH_LINEAR && f->bm) {
+    /* the values that satisfy the condition have disjoint bitmaps */
+    for (int i = 0; i < f->bm->num_vals; i++)
+      if ((*cmp_op) (val, f->bm->vals[i]))
+        n += bm_count(f->bm->maps + i);
+    return n;
+  }
+  plan_p p = plan_scan(t, attr, op, val);
+  n = plan_count(p);
+  plan_release(p);
+  return n;
+}
 
-    goto not;
+/** @b update_current_record
+ * 
+ * writes field f (the j-th field) of the record just fetched from
+ * the table back to where it is stored
+ */
+static int update_current_record(record r, schema_p s, field_desc_p f, int j) {
+  tbl_p t = s->tbl;
+  if (t->layout == COL_LAYOUT) {
+    put_col_val(s, f, t->current_rec - 1, r[j]);
+    return 1;
+  }
+  return write_page_record(t->current_pg, r, s, t->current_rec - 1);
+}
 
-  break;
-  case BELOW:
+int table_update(tbl_p t, char const* set_attr, char const* set_val,
+                 char const* attr, char const* op, int val) {
+  if (!t) return -1;
 
-    // do nothing
+  schema_p s = t->sch;
+  int (*cmp_op)() = NULL;
+  field_desc_p f = 0;
+  if (attr && !(f = where_field(s, attr, op, &cmp_op)))
+    return -1;
 
-  break;
+  field_desc_p set_f;
+  size_t j = 0;
+  for (set_f = s->first; set_f; set_f = set_f->next, j++)
+    if (strcmp(set_f->name, set_attr) == 0) break;
+  if (!set_f) {
+    put_msg(ERROR, "\"%s\" has no \"%s\" field\n", s->name, set_attr);
+    return -1;
   }
 
-  while (high != low){
-    unpin(pg);
-    mid = (high+low)/2;
-    pg = get_page(s->name, mid);
+  int int_val = 0;
+  if (is_int_field(set_f)) {
+    char *p;
+    int_val = strtol(set_val, &p, 10);
+    if (p == set_val || *p != '\0') {
+      put_msg(ERROR, "\"%s\" is not an integer value.\n", set_val);
+      return -1;
+    }
+  } else if (strlen(set_val) >= set_f->len) {
+    put_msg(ERROR, "\"%s\" is too long for \"%s\".\n", set_val, set_attr);
+    return -1;
+  }
 
-    switch (val_in_page_range(s, pg, offset, val))
-    {
-    case FIRST:
-    
-      cpg = get_page(s->name, mid-1);
+  record rec = new_record(s);
+  int num_updated = 0;
+  schema_p moved = 0; /* records that no longer fit in their block */
+  if (is_int_field(set_f))
+    set_f->sorted = 0;
 
-      switch (val_in_page_range(s, cpg, offset, val))
-      {
-      case FIRST:
+  set_tbl_position(t, TBL_BEG);
+  while (find_next_record(rec, s, f, cmp_op, val)) {
+    int old_val = is_int_field(set_f) ? *(int *)rec[j] : 0;
+    if (is_int_field(set_f))
+      assign_int_field(rec[j], int_val);
+    else
+      assign_str_field(rec[j], set_val);
+    if (update_current_record(rec, s, set_f, j)) {
+      int blk, slot;
+      current_rid(t, &blk, &slot);
+      if (is_int_field(set_f))
+        reindex_field(s, set_f, old_val, int_val, blk, slot);
+    } else {
+      /* the longer record is moved to the end of the table after the scan,
+         so that the scan does not meet it again */
+      if (!moved) {
+        char *tmp_name = tmp_schema_name("update", s->name);
+        moved = copy_schema(s, tmp_name);
+        free(tmp_name);
+        moved->tbl->is_tmp = 1;
+      }
+      append_record(rec, moved);
+      free_current_record(s, rec);
+    }
+    num_updated++;
+  }
 
-        high = mid;
+  if (moved) {
+    set_tbl_position(moved->tbl, TBL_BEG);
+    while (get_record(rec, moved))
+      append_record(rec, s);
+    remove_schema(moved);
+  }
 
-      break;
-      case LAST:
+  release_record(rec, s);
+  return num_updated;
+}
 
-        unpin(pg);
-        pg = cpg;
-        goto last;
+int table_delete(tbl_p t, char const* attr, char const* op, int val) {
+  if (!t) return -1;
 
-      break;
-      case WITHIN:
+  schema_p s = t->sch;
+  if (t->layout != ROW_LAYOUT) {
+    put_msg(ERROR, "delete from %s: only tables with row layout support delete.\n",
+            s->name);
+    return -1;
+  }
 
-        unpin(pg);
-        pg = cpg;
-        pos = bfind_page_first_int_val(s, pg, offset, val);
-        if (pos < 0)
-          goto not;
-        else
-          goto found;
+  int (*cmp_op)() = NULL;
+  field_desc_p f = 0;
+  if (attr && !(f = where_field(s, attr, op, &cmp_op)))
+    return -1;
 
-      break;
-      case ABOVE:
+  record rec = new_record(s);
+  int num_deleted = 0;
 
-        unpin(cpg);
-        goto first;
+  set_tbl_position(t, TBL_BEG);
+  while (find_next_record(rec, s, f, cmp_op, val)) {
+    free_current_record(s, rec);
+    num_deleted++;
+  }
 
-      break;
-      case BELOW:
-
-      // this point should never be reached
-      put_msg(ERROR, "Field %s is not properly sorted, found %d before %d\n",
-                      field_name,
-                      page_get_int_at(cpg, page_seek(cpg, P_BEG, offset)),
-                      page_get_int_at(cpg, page_seek(pg, P_BEG, offset))
-              );
-      put_msg(ERROR, "Checking blocks:");
-      put_page_info(ERROR, cpg);
-      put_page_info(ERROR, pg);
-      put_schema_info(ERROR, s);
-      exit(EXIT_FAILURE);
-      break;
-      }
-    
-    break;
-    case LAST:
+  release_record(rec, s);
+  return num_deleted;
+}
 
-      goto last;
+int create_index(tbl_p t, char const* attr, index_kind kind) {
+  if (!t) return 0;
 
-    break;
-    case WITHIN:
+  schema_p s = t->sch;
+  field_desc_p f;
+  size_t j = 0;
+  for (f = s->first; f; f = f->next, j++)
+    if (strcmp(f->name, attr) == 0) break;
+  if (!f) {
+    put_msg(ERROR, "\"%s\" has no \"%s\" field\n", s->name, attr);
+    return 0;
+  }
+  if (!is_int_field(f)) {
+    put_msg(ERROR, "create index: \"%s\" is not an int field.\n", attr);
+    return 0;
+  }
+  char **fname_p = index_fname(f, kind);
+  if (*fname_p) {
+    put_msg(ERROR, "create index: \"%s\" of \"%s\" already has a %s index.\n",
+            attr, s->name, index_names[kind]);
+    return 0;
+  }
 
-      pos = bfind_page_first_int_val(s, pg, offset, val);
-      if (pos < 0)
-        goto not;
+  char *fname = field_file_name(s, f, index_exts[kind]);
+  remove(fname); /* left behind by an earlier table of the same name */
+  if (kind == BITMAP_INDEX) {
+    f->bm = build_bitmaps(s, j);
+    bmi_save(f->bm, fname);
+  } else if (kind == BLOOM_FILTER) {
+    f->bf = build_bloom_filters(s, f, j);
+    bf_save(f->bf, fname);
+  } else {
+    record rec = new_record(s);
+    int blk, slot;
+    set_tbl_position(t, TBL_BEG);
+    while (get_record(rec, s)) {
+      current_rid(t, &blk, &slot);
+      if (kind == HASH_INDEX)
+        hash_insert(fname, *(int *)rec[j], blk, slot);
       else
-        goto found;
+        bt_insert(fname, *(int *)rec[j], blk, slot);
+    }
+    release_record(rec, s);
+  }
+  *fname_p = fname;
+  return save_table(t);
+}
 
-    case ABOVE:
+tbl_p table_project(tbl_p t, int num_fields, char* fields[]) {
+  schema_p s = t->sch;
+  schema_p dest = make_sub_schema(s, num_fields, fields);
+  if (!dest) return 0;
 
-      if (low == mid)
-        goto not;
-      low = mid;
+  record rec = new_record(s), rec_dest = new_record(dest);
 
-    break;
-    case BELOW:
+  set_tbl_position(t, TBL_BEG);
+  if (t->layout == COL_LAYOUT) {
+    /* read the projected columns only */
+    while (get_col_record(rec_dest, dest, s))
+      append_record(rec_dest, dest);
+  } else
+  while (get_record(rec, s)) {
+    fill_sub_record(rec_dest, dest, rec, s);
+    put_record_info(DEBUG, rec_dest, dest);
+    append_record(rec_dest, dest);
+  }
 
-      high = mid;
+  release_record(rec, s);
+  release_record(rec_dest, dest);
 
-    break;
-    }
-  }
+  return dest->tbl;
+}
 
-found:
+tbl_p table_natural_join(tbl_p left, tbl_p right) {
+  if (!(left && right)) {
+    put_msg(ERROR, "no table found!\n");
+    return 0;
+  }
 
-  page_set_current_pos(pg, pos);
+  plan_p p = plan_natural_join(plan_scan(left, 0, 0, 0),
+                               plan_scan(right, 0, 0, 0));
+  if (!p) return 0;
 
-goto success;
-first:
+  schema_p s = plan_schema(p);
+  char *tmp_name = tmp_schema_name("join", s->name);
+  schema_p res_sch = copy_schema(s, tmp_name);
+  free(tmp_name);
+  res_sch->tbl->is_tmp = 1;
 
-  page_seek(pg, P_BEG, 0);
+  record rec = new_record(s);
+  plan_open(p);
+  while (plan_next(p, rec))
+    append_record(rec, res_sch);
+  plan_close(p);
+  release_record(rec, s);
+  plan_release(p);
 
-goto success;
-last:
+  return res_sch->tbl;
+}
 
-  page_seek(pg, P_END, -s->len);
+/** @brief State of a filter */
+typedef struct filter_state_struct {
+  int fld_nr;        /**< number of the field of the condition in the records */
+  int (*op) (int, int); /**< comparison of the condition */
+  int val;           /**< value of the condition */
+} filter_state;
 
-goto success;
-success:
+static int open_input(plan_p p) {
+  return plan_open(p->left);
+}
 
-  s->tbl->current_pg = pg;
-  return 1;
+static void close_input(plan_p p) {
+  plan_close(p->left);
+}
 
-not:
+static void release_state(plan_p p) {
+  free(p->state);
+}
 
+static int filter_next(plan_p p, record r) {
+  filter_state *st = p->state;
+  while (plan_next(p->left, r))
+    if ((*st->op) (st->val, *(int *)r[st->fld_nr]))
+      return 1;
   return 0;
-
 }
 
-/** @b put_page_record
+/** @b field_nr
  * 
- * write the provided record (of format in schema)
- * to current position of page
- * 
- * @param p  destination page
- * @param r  record to be written
- * @param s  format schema
+ * returns the number of field f in the records of schema s
  */
-static int put_page_record(page_p p, record r, schema_p s) {
-  if (!page_valid_pos_for_put_with_schema(p, s))
-    return 0;
+static int field_nr(schema_p s, field_desc_p f) {
+  int j = 0;
+  for (field_desc_p g = s->first; g != f; g = g->next)
+    j++;
+  return j;
+}
 
-  field_desc_p fld_desc;
-  size_t i = 0;
-  for (fld_desc = s->first;
-       fld_desc;
-       fld_desc = fld_desc->next, i++)
-    if (is_int_field(fld_desc))
-      page_put_int(p, *(int *)r[i]);
-    else
-      page_put_str(p, (char *)r[i], fld_desc->len);
-  return 1;
+/** @brief State of a join
+
+    The state of every kind of join starts with it. */
+typedef struct join_state_struct {
+  int num_keys;      /**< number of shared fields */
+  field_desc_p *r_flds; /**< the shared fields in the right input */
+  int *l_nrs;        /**< numbers of the shared fields in the left records */
+  int *r_nrs;        /**< numbers of the shared fields in the right records */
+  int *key_lens;     /**< bytes of every shared field in a packed key, the
+                          longer of the two for a str field */
+  int key_len;       /**< bytes of a packed key */
+  int int_key;       /**< the shared int field a nested loop looks up, -1
+                          if none */
+  char *l_key;       /**< the packed key of l_rec */
+  char *r_key;       /**< a packed key of a right record */
+  record l_rec;      /**< the current record of the left input */
+  record r_rec;      /**< record of the right input */
+  int has_left;      /**< whether l_rec is joined with the right input now */
+  int by_index;      /**< whether a nested loop finds the right records of
+                          l_rec with the index of the right scan */
+} join_state;
+
+static plan_p new_filter(plan_p in, field_desc_p f, int (*op) (int, int),
+                         int val) {
+  filter_state *st = malloc(sizeof (filter_state));
+  st->fld_nr = field_nr(in->sch, f);
+  st->op = op;
+  st->val = val;
+  plan_p p = new_plan(in->sch, 0, in, 0, st);
+  p->open = open_input;
+  p->next = filter_next;
+  p->close = close_input;
+  p->release = release_state;
+  return p;
 }
 
-/** @b put_page_record
- * 
- * writes the provided record to the current position of the schema
+static int join_next(plan_p p, record r);
+
+static int is_join_key(join_state *st, char const* name) {
+  for (int k = 0; k < st->num_keys; k++)
+    if (strcmp(st->r_flds[k]->name, name) == 0)
+      return 1;
+  return 0;
+}
+
+/** @b hash_key
  * 
- * @param r  record to be written
- * @param s  target schema
+ * returns the hash of a packed key of n bytes
  */
-int put_record(record r, schema_p s) {
-  page_p p = s->tbl->current_pg;
-
-  if (!page_valid_pos_for_put_with_schema(p, s))
-    return 0;
+static unsigned hash_key(char const* key, int n) {
+  unsigned h = 2166136261u;
+  for (int i = 0; i < n; i++)
+    h = (h ^ (unsigned char) key[i]) * 16777619u;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
 
-  field_desc_p fld_desc;
-  size_t i = 0;
-  for (fld_desc = s->first; fld_desc;
-       fld_desc = fld_desc->next, i++)
-    if (is_int_field(fld_desc))
-      page_put_int(p, *(int *)r[i]);
+/** @b pack_key
+ * 
+ * writes the shared fields of record r, of the left input if left is set
+ * and of the right one otherwise, one after another into key, and returns
+ * the hash of the key. A str value is padded with zeros, so that equal
+ * values of fields of different lengths have the same bytes.
+ */
+static unsigned pack_key(join_state *st, record r, int left, char *key) {
+  int *nrs = left ? st->l_nrs : st->r_nrs;
+  char *k = key;
+  for (int i = 0; i < st->num_keys; i++) {
+    if (is_int_field(st->r_flds[i]))
+      memcpy(k, r[nrs[i]], INT_SIZE);
     else
-      page_put_str(p, (char *)r[i], fld_desc->len);
-  return 1;
+      strncpy(k, r[nrs[i]], st->key_lens[i]);
+    k += st->key_lens[i];
+  }
+  return hash_key(key, st->key_len);
 }
 
-/** @b append_record
- * 
- * writes the provided record to the end of the schema
+/** @b push_filter
  * 
- * @param r  record to be written
- * @param s  target schema
+ * adds the condition on field f of the records of node in as far down the
+ * plan as it goes, and returns the node that takes the place of in.
+ * A scan without condition takes it as its own, to find the records with
+ * the access structures of the field. A join passes it on to the input
+ * that has f, or to both inputs if f is the shared field, so that only
+ * the records that satisfy it are joined.
  */
-void append_record(record r, schema_p s) {
-  tbl_p tbl = s->tbl;
-  page_p pg = get_page_for_append(s->name);
-  if (!pg) {
-    put_msg(FATAL, "Failed to get page for appending to \"%s\".\n",
-            s->name);
-    exit(EXIT_FAILURE);
-  }
-  if (!put_page_record(pg, r, s)) {
-    /* not enough space in the current page */
-    unpin(pg);
-    pg = get_next_page(pg);
-    if (!pg) {
-      put_msg(FATAL, "Failed to get page for \"%s\" block %d.\n",
-              s->name, page_block_nr(pg) + 1);
-      exit(EXIT_FAILURE);
+static plan_p push_filter(plan_p in, field_desc_p f, int (*op) (int, int),
+                          int val) {
+  if (in->open == scan_open) {
+    scan_state *scan = in->state;
+    if (!scan->f) {
+      scan->f = f;
+      scan->op = op;
+      scan->val = val;
+      return in;
     }
-    if (!put_page_record(pg, r, s)) {
-      put_msg(FATAL, "Failed to put record to page for \"%s\" block %d.\n",
-              s->name, page_block_nr(pg) + 1);
-      exit(EXIT_FAILURE);
+  } else if (in->right) {
+    join_state *st = in->state;
+    field_desc_p lf = get_field(in->left->sch, f->name);
+    if (lf)
+      in->left = push_filter(in->left, lf, op, val);
+    if (!lf || is_join_key(st, f->name)) {
+      field_desc_p rf = get_field(in->right->sch, f->name);
+      /* the scan of the right input of a nested loop is set anew for
+         every left record, so the condition stays on top of it */
+      if (in->next == join_next)
+        in->right = new_filter(in->right, rf, op, val);
+      else
+        in->right = push_filter(in->right, rf, op, val);
     }
+    return in;
   }
-  tbl->current_pg = pg;
-  tbl->num_records++;
+  return new_filter(in, f, op, val);
 }
 
-static void display_tbl_header(tbl_p t) {
-  if (!t) {
-    put_msg(INFO,  "Trying to display non-existant table.\n");
-    return;
-  }
-  schema_p s = t->sch;
-  for (field_desc_p f = s->first; f; f = f->next)
-    put_msg(FORCE, "%20s", f->name);
-  put_msg(FORCE, "\n");
-  for (field_desc_p f = s->first; f; f = f->next) {
-    for (size_t i = 0; i < 20 - strlen(f->name); i++)
-      put_msg(FORCE, " ");
-    for (size_t i = 0; i < strlen(f->name); i++)
-      put_msg(FORCE, "-");
+plan_p plan_filter(plan_p in, char const* attr, char const* op, int val) {
+  if (!in) return 0;
+  int (*cmp_op)() = NULL;
+  field_desc_p f = where_field(in->sch, attr, op, &cmp_op);
+  if (!f) {
+    plan_release(in);
+    return 0;
   }
-  put_msg(FORCE, "\n");
+  return push_filter(in, f, cmp_op, val);
 }
 
-static void display_record(record r, schema_p s) {
-  field_desc_p f = s->first;
-  for (size_t i = 0; f; f = f->next, i++) {
-    if (is_int_field(f))
-      put_msg(FORCE, "%20d", *(int *)r[i]);
-    else
-      put_msg(FORCE, "%20s", (char *)r[i]);
-  }
-  put_msg(FORCE, "\n");
+/** @brief State of a projection */
+typedef struct project_state_struct {
+  record in_rec;     /**< record of the input */
+  int pushed;        /**< whether the input scan reads the projected fields only */
+} project_state;
+
+static int project_next(plan_p p, record r) {
+  project_state *st = p->state;
+  if (st->pushed)
+    return plan_next(p->left, r);
+  if (!plan_next(p->left, st->in_rec))
+    return 0;
+  fill_sub_record(r, p->sch, st->in_rec, p->left->sch);
+  return 1;
 }
 
-void table_display(tbl_p t) {
-  if (!t) return;
-  display_tbl_header(t);
+static void project_release(plan_p p) {
+  project_state *st = p->state;
+  release_record(st->in_rec, p->left->sch);
+  free(st);
+}
 
-  schema_p s = t->sch;
-  record rec = new_record(s);
-  set_tbl_position(t, TBL_BEG);
-  while (get_record(rec, s)) {
-    display_record(rec, s);
+plan_p plan_project(plan_p in, int num_fields, char* fields[]) {
+  if (!in) return 0;
+  schema_p dest = make_schema(in->sch->name);
+  for (int i = 0; i < num_fields; i++) {
+    field_desc_p f = get_field(in->sch, fields[i]);
+    if (!f) {
+      put_msg(ERROR, "\"%s\" has no \"%s\" field\n", in->sch->name, fields[i]);
+      release_schema(dest);
+      plan_release(in);
+      return 0;
+    }
+    add_field(dest, dup_field(f));
   }
-  put_msg(FORCE, "\n");
-
-  release_record(rec, s);
+  project_state *st = malloc(sizeof (project_state));
+  st->in_rec = new_record(in->sch);
+  /* a scan of a COL_LAYOUT table without condition reads the projected
+     columns only */
+  st->pushed = 0;
+  if (in->open == scan_open) {
+    scan_state *scan = in->state;
+    if (!scan->f && scan->t->layout == COL_LAYOUT) {
+      scan->cols = dest;
+      st->pushed = 1;
+    }
+  }
+  plan_p p = new_plan(dest, 1, in, 0, st);
+  p->open = open_input;
+  p->next = project_next;
+  p->close = close_input;
+  p->release = project_release;
+  return p;
 }
 
-static void *interpret_op (const char * const op)
-{
-  switch (op[0])
-  {
-  case '=':
-
-    if (op[1] == '\0')
-      return int_eq;
-
-  break;
-  case '!':
-  
-    if (op[1] == '=')
-      if (!op[2])
-        return int_neq;
-
-  break;
-  case '<':
-
-    switch (op[1])
-    {
-    case '\0':
-    
-      return int_l;
-    
-    case '=':
-    
-      if (!op[2])
-        return int_le;
-    
+/** @b join_record
+ * 
+ * fills in r, a record of the joined plan p, with the fields of left
+ * record l and of right record rr, but for the shared fields of rr
+ */
+static void join_record(record r, plan_p p, record l, record rr) {
+  join_state *st = p->state;
+  field_desc_p f = p->sch->first, g;
+  int i = 0, j;
+  for (j = 0, g = p->left->sch->first; g; j++, g = g->next, f = f->next)
+    memcpy(r[i++], l[j], f->len);
+  for (j = 0, g = p->right->sch->first; g; j++, g = g->next) {
+    int k = 0;
+    while (k < st->num_keys && st->r_nrs[k] != j)
+      k++;
+    if (k == st->num_keys) {
+      memcpy(r[i++], rr[j], f->len);
+      f = f->next;
     }
-    
-  break;
-  case '>':
+  }
+}
 
-    switch (op[1])
-    {
-    case '\0':
-    
-      return int_g;
-    
-    break;
-    case '=':
-    
-      if (!op[2])
-        return int_ge;
-    
-    break;
+/** @b rescan_right
+ * 
+ * starts the right input over for the current left record. A scan of the
+ * right table without condition looks for the value of a shared int field
+ * with the zone map and the Bloom filters, like a search.
+ */
+static void rescan_right(plan_p p) {
+  join_state *st = p->state;
+  plan_p right = p->right, base = right;
+  plan_close(right);
+  /* the scan under the conditions pushed down to the right input */
+  while (base->next == filter_next)
+    base = base->left;
+  if (base->open == scan_open && st->int_key >= 0) {
+    scan_state *scan = base->state;
+    if (!scan->f || scan->by_join) {
+      scan->f = st->r_flds[st->int_key];
+      scan->op = int_eq;
+      scan->val = *(int *)st->l_rec[st->l_nrs[st->int_key]];
+      scan->linear = !st->by_index;
+      scan->by_join = 1;
     }
-  
-  break;
   }
+  plan_open(right);
+}
 
-  return NULL;
+static int join_open(plan_p p) {
+  join_state *st = p->state;
+  st->has_left = 0;
+  return plan_open(p->left);
 }
 
-/* We restrict ourselves to equality search on an int attribute */
-tbl_p table_search(tbl_p t, char const* attr, char const* op, int val, int b_search) {
-  if (!t) return 0;
+static int join_next(plan_p p, record r) {
+  join_state *st = p->state;
+  for (;;) {
+    if (!st->has_left) {
+      if (!plan_next(p->left, st->l_rec))
+        return 0;
+      pack_key(st, st->l_rec, 1, st->l_key);
+      rescan_right(p);
+      st->has_left = 1;
+    }
+    while (plan_next(p->right, st->r_rec)) {
+      pack_key(st, st->r_rec, 0, st->r_key);
+      if (memcmp(st->l_key, st->r_key, st->key_len) == 0) {
+        join_record(r, p, st->l_rec, st->r_rec);
+        return 1;
+      }
+    }
+    st->has_left = 0;
+  }
+}
 
-  int (*cmp_op)() = NULL;
+static void join_close(plan_p p) {
+  plan_close(p->left);
+  plan_close(p->right);
+}
 
-  cmp_op = interpret_op(op);
+static void join_release(plan_p p) {
+  join_state *st = p->state;
+  release_record(st->l_rec, p->left->sch);
+  release_record(st->r_rec, p->right->sch);
+  free(st->r_flds);
+  free(st->l_nrs);
+  free(st->r_nrs);
+  free(st->key_lens);
+  free(st->l_key);
+  free(st->r_key);
+  free(st);
+}
 
-  if (!cmp_op) {
-    put_msg(ERROR, "unknown comparison operator \"%s\".\n", op);
-    return 0;
+/** @b zm_selectivity
+ * 
+ * returns an estimate of the fraction of the records of table t where
+ * int field f op val holds, from the bounds of the field in the zone map,
+ * taking the values of a block to be spread evenly between them.
+ * Returns -1 if the table has no zone map.
+ */
+static double zm_selectivity(tbl_p t, field_desc_p f, int (*op) (int, int),
+                             int val) {
+  int min, max, num_blocks = 0;
+  double sum = 0;
+  for (int blk = 0; zm_bounds(t->sch, f, blk, &min, &max); blk++)
+    if (min <= max)
+      num_blocks++;
+  if (!num_blocks)
+    return -1;
+  double per_block = (double) t->num_records / num_blocks;
+  for (int blk = 0; zm_bounds(t->sch, f, blk, &min, &max); blk++) {
+    if (min > max)
+      continue;
+    double width = (double) max - min + 1, part;
+    double eq = min <= val && val <= max
+      ? 1 / (width < per_block ? width : per_block) : 0;
+    if (op == int_eq)       part = eq;
+    else if (op == int_neq) part = 1 - eq;
+    else if (op == int_l)   part = ((double) val - min) / width;
+    else if (op == int_le)  part = ((double) val - min + 1) / width;
+    else if (op == int_g)   part = ((double) max - val) / width;
+    else                    part = ((double) max - val + 1) / width;
+    sum += part < 0 ? 0 : part > 1 ? 1 : part;
   }
+  return sum / num_blocks;
+}
 
+/** @b field_selectivity
+ * 
+ * returns an estimate of the fraction of the records of table t where
+ * int field f op val holds: exact from the bitmap index of the field for
+ * = and !=, from the zone map otherwise. Returns -1 if there are no
+ * statistics of the field.
+ */
+static double field_selectivity(tbl_p t, field_desc_p f,
+                                int (*op) (int, int), int val) {
+  if (t->num_records == 0)
+    return -1;
+  if (f->bm && (op == int_eq || op == int_neq)) {
+    rl_bitmap *b = bmi_bitmap(f->bm, val, 0);
+    double eq = b ? (double) bm_count(b) / t->num_records : 0;
+    return op == int_eq ? eq : 1 - eq;
+  }
+  return zm_selectivity(t, f, op, val);
+}
 
-  schema_p s = t->sch;
-  field_desc_p f;
-  size_t i = 0;
-  for (f = s->first; f; f = f->next, i++)
-    if (strcmp(f->name, attr) == 0) {
-      if (f->type != INT_TYPE) {
-        put_msg(ERROR, "\"%s\" is not an integer field.\n", attr);
-        return 0;
-      }
-      break;
+/** @b field_distinct
+ * 
+ * returns an estimate of the number of distinct values of field f of
+ * table t: those of its bitmap index, or the width of the bounds of the
+ * field in the zone map, at most the number of records
+ */
+static double field_distinct(tbl_p t, field_desc_p f) {
+  double n = t->num_records > 0 ? t->num_records : 1;
+  if (f->bm)
+    return f->bm->num_vals > 0 ? f->bm->num_vals : 1;
+  if (!is_int_field(f))
+    return n;
+  int lo = INT_MAX, hi = INT_MIN, min, max;
+  for (int blk = 0; zm_bounds(t->sch, f, blk, &min, &max); blk++)
+    if (min <= max) {
+      if (min < lo) lo = min;
+      if (max > hi) hi = max;
     }
-  if (!f) return 0;
-
-  char *tmp_name = tmp_schema_name("select", s->name);
-  schema_p res_sch = copy_schema(s, tmp_name);
-  free(tmp_name);
-
-  record rec = new_record(s);
+  if (lo > hi)
+    return n;
+  double width = (double) hi - lo + 1;
+  return width < n ? width : n;
+}
 
-  set_tbl_position(t, TBL_BEG);
-  if (b_search && cmp_op == int_eq){
-    if (bfind_first_int_val(s, f->offset, val))
-    while (lfind_record_int_val(rec, s, f->offset, val)) {
-      append_record(rec, res_sch);
+/** @b plan_card
+ * 
+ * returns a rough estimate of the number of records of a plan, from the
+ * number of records of the tables and the statistics of the field of a
+ * condition on a scan, or a fixed selectivity per comparison otherwise
+ */
+static double plan_card(plan_p p) {
+  field_desc_p f = 0;
+  int (*op) (int, int) = 0;
+  double n;
+  if (p->open == scan_open) {
+    scan_state *scan = p->state;
+    n = scan->t->num_records;
+    if (!scan->by_join) {
+      f = scan->f;
+      op = scan->op;
     }
+    double sel = f ? field_selectivity(scan->t, f, op, scan->val) : -1;
+    if (sel >= 0)
+      return n * sel;
+  } else if (p->right) {
+    double l = plan_card(p->left), r = plan_card(p->right);
+    n = l > r ? l : r;
   } else {
-    while (find_record_int_val(rec, s, f->offset, cmp_op, val)) {
-      append_record(rec, res_sch);
+    n = plan_card(p->left);
+    if (p->next == filter_next) {
+      f = (field_desc_p) 1;
+      op = ((filter_state *) p->state)->op;
     }
   }
+  if (!f)
+    return n;
+  if (op == int_eq)
+    return n / 10 + 1;
+  if (op == int_neq)
+    return n * 0.9;
+  return n / 3 + 1;
+}
 
-  put_db_info(DEBUG);
-  release_record(rec, s);
+/** @brief Chunk of a memory arena */
+typedef struct arena_chunk_struct {
+  struct arena_chunk_struct *next; /**< the chunk allocated before */
+  size_t used;       /**< number of bytes handed out */
+  size_t size;       /**< number of bytes of data */
+  char data[];       /**< the memory handed out */
+} arena_chunk;
+
+/** @brief Memory handed out piece by piece and released all at once */
+typedef struct mem_arena_struct {
+  arena_chunk *chunks; /**< the last chunk allocated, NULL if none */
+  size_t used;         /**< number of bytes handed out */
+} mem_arena;
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+static void *arena_alloc(mem_arena *a, size_t n) {
+  n = (n + 7) & ~(size_t) 7;
+  arena_chunk *c = a->chunks;
+  if (!c || c->used + n > c->size) {
+    size_t size = n > ARENA_CHUNK_SIZE ? n : ARENA_CHUNK_SIZE;
+    c = malloc(sizeof (arena_chunk) + size);
+    c->next = a->chunks;
+    c->used = 0;
+    c->size = size;
+    a->chunks = c;
+  }
+  void *res = c->data + c->used;
+  c->used += n;
+  a->used += n;
+  return res;
+}
 
-  return res_sch->tbl;
+static void arena_release(mem_arena *a) {
+  while (a->chunks) {
+    arena_chunk *c = a->chunks;
+    a->chunks = c->next;
+    free(c);
+  }
+  a->used = 0;
 }
 
-tbl_p table_project(tbl_p t, int num_fields, char* fields[]) {
-  schema_p s = t->sch;
-  schema_p dest = make_sub_schema(s, num_fields, fields);
-  if (!dest) return 0;
+/** @b arena_reset
+ * 
+ * takes back all the memory handed out, keeping the last chunk for reuse
+ */
+static void arena_reset(mem_arena *a) {
+  arena_chunk *c = a->chunks;
+  if (!c)
+    return;
+  a->chunks = c->next;
+  arena_release(a);
+  c->next = 0;
+  c->used = 0;
+  a->chunks = c;
+}
 
-  record rec = new_record(s), rec_dest = new_record(dest);
+/** @brief Record of the build input of a hash join */
+typedef struct hj_entry_struct {
+  struct hj_entry_struct *next; /**< the next record with the same key */
+  char vals[];       /**< the values of the fields, at their offsets, and
+                          the packed key after them */
+} hj_entry;
+
+/** @brief Slot of the hash table of a hash join */
+typedef struct hj_slot_struct {
+  unsigned hash;     /**< the hash of the key */
+  hj_entry *first;   /**< the records with the key, NULL for a free slot */
+  hj_entry *last;    /**< the record with the key added last */
+} hj_slot;
+
+/** @brief Records of both inputs of a hash join with the same hash bits */
+typedef struct hj_partition_struct {
+  tbl_p build;       /**< the records of the build input */
+  tbl_p probe;       /**< the records of the other input */
+  int level;         /**< number of times the records were partitioned */
+} hj_partition;
+
+/** @brief State of a hash join */
+typedef struct hash_join_state_struct {
+  join_state join;   /**< the shared fields and the records of the inputs */
+  int build_left;    /**< whether the hash table holds the left input */
+  int key_off;       /**< offset of the packed key in an entry */
+  hj_slot *slots;    /**< the hash table, with open addressing */
+  int num_slots;     /**< number of slots, a power of 2 */
+  int num_keys;      /**< number of slots taken */
+  mem_arena arena;   /**< memory of the records of the build input */
+  hj_entry *match;   /**< the next build record to join with the probe
+                          record, NULL if none */
+  plan_p probe;      /**< the records that look up the hash table, NULL if
+                          none */
+  tbl_p probe_tbl;   /**< the partition read by probe, NULL for an input */
+  hj_partition *parts; /**< the partitions still to join */
+  int num_parts;     /**< number of partitions still to join */
+  int max_parts;     /**< number of partitions allocated */
+} hash_join_state;
+
+/** number of partitions the records of a hash join are split into at once.
+    Every partition keeps a buffer page pinned while it is written, so they
+    have to leave pages to the inputs. */
+#define HJ_NUM_PARTS 4
+/** number of hash bits that pick the partition */
+#define HJ_PART_BITS 2
+/** max number of times the records are partitioned, the records of a key
+    stay together however many they are */
+#define HJ_MAX_LEVEL 8
+
+static long jn_mem_budget = 1L << 20;
+
+void set_join_mem_budget(long bytes) {
+  jn_mem_budget = bytes;
+}
 
-  set_tbl_position(t, TBL_BEG);
-  while (get_record(rec, s)) {
-    fill_sub_record(rec_dest, dest, rec, s);
-    put_record_info(DEBUG, rec_dest, dest);
-    append_record(rec_dest, dest);
-  }
+static char const hj_spilled_event[] = "records spilled to hash join partitions";
 
-  release_record(rec, s);
-  release_record(rec_dest, dest);
+/** @b hj_slot_of
+ * 
+ * returns the slot of the packed key with hash h, or the free slot where
+ * it goes. Linear probing: the slots after the hash are tried in turn.
+ */
+static hj_slot *hj_slot_of(hash_join_state *st, unsigned h, char const* key) {
+  unsigned i = h & (st->num_slots - 1);
+  while (st->slots[i].first
+         && (st->slots[i].hash != h
+             || memcmp(st->slots[i].first->vals + st->key_off, key,
+                       st->join.key_len)))
+    i = (i + 1) & (st->num_slots - 1);
+  return st->slots + i;
+}
 
-  return dest->tbl;
+static void hj_grow(hash_join_state *st) {
+  hj_slot *old = st->slots;
+  int num_old = st->num_slots;
+  st->num_slots = num_old ? 2 * num_old : 64;
+  st->slots = calloc(st->num_slots, sizeof (hj_slot));
+  for (int i = 0; i < num_old; i++)
+    if (old[i].first) {
+      unsigned j = old[i].hash & (st->num_slots - 1);
+      while (st->slots[j].first)
+        j = (j + 1) & (st->num_slots - 1);
+      st->slots[j] = old[i];
+    }
+  free(old);
 }
 
-char *join_schemas(schema_p *dest, tbl_p left, tbl_p right)
-{
-  char *joined_name, *new_name, *shared;
+/** @b hj_insert
+ * 
+ * adds record r of schema s to the hash table. The records of a key are
+ * kept in the order they come in.
+ */
+static void hj_insert(hash_join_state *st, record r, schema_p s) {
+  join_state *js = &st->join;
+  if (2 * (st->num_keys + 1) > st->num_slots)
+    hj_grow(st);
+  hj_entry *e = arena_alloc(&st->arena,
+                            sizeof (hj_entry) + s->len + js->key_len);
+  field_desc_p f;
+  int j = 0;
+  for (f = s->first; f; f = f->next, j++)
+    memcpy(e->vals + f->offset, r[j], f->len);
+  e->next = 0;
+  unsigned h = pack_key(js, r, st->build_left, e->vals + s->len);
+  hj_slot *slot = hj_slot_of(st, h, e->vals + s->len);
+  if (!slot->first) {
+    slot->hash = h;
+    slot->first = e;
+    st->num_keys++;
+  } else
+    slot->last->next = e;
+  slot->last = e;
+}
 
-  joined_name = concat_names(left->sch->name, "_and_", right->sch->name);
-  if (!joined_name) {
-    goto MemErr;
-  }
+static void hj_entry_record(hj_entry *e, record r, schema_p s) {
+  field_desc_p f;
+  int j = 0;
+  for (f = s->first; f; f = f->next, j++)
+    memcpy(r[j], e->vals + f->offset, f->len);
+}
 
-  new_name = tmp_schema_name("join", joined_name);
+static void hj_clear(hash_join_state *st) {
+  free(st->slots);
+  st->slots = 0;
+  st->num_slots = st->num_keys = 0;
+  arena_release(&st->arena);
+  st->match = 0;
+}
 
-  free(joined_name);
-  if (!new_name) {
-    goto MemErr;
-  }
+static long hj_mem(hash_join_state *st) {
+  return st->arena.used + (long) st->num_slots * sizeof (hj_slot);
+}
 
-  *dest = copy_schema(left->sch, new_name);
+/** @b hj_part_of
+ * 
+ * returns the partition of a key with hash h among those made at the
+ * level. The high bits of the hash pick the partition, the low ones the
+ * slot.
+ */
+static int hj_part_of(unsigned h, int level) {
+  return h >> (32 - HJ_PART_BITS * (level + 1)) & (HJ_NUM_PARTS - 1);
+}
 
-  free(new_name);
-  if (!(*dest)) {
-    goto MemErr;
-  }
+static tbl_p new_partition(schema_p s) {
+  char *name = tmp_schema_name("partition", s->name);
+  schema_p res = copy_schema(s, name);
+  free(name);
+  res->tbl->is_tmp = 1;
+  return res->tbl;
+}
 
-  shared = NULL;
-  for (field_desc_p
-    rfield = right->sch->first;
-    rfield;
-    rfield = field_desc_next(rfield)
-    ) {
+/** @b end_partition
+ * 
+ * unpins the page the records of partition t were appended to
+ */
+static void end_partition(tbl_p t) {
+  if (t->current_pg)
+    unpin(t->current_pg);
+  t->current_pg = 0;
+}
 
-    if (!shared) { // shared field not found yet
-      for (field_desc_p 
-        lfield = left->sch->first;
-        lfield;
-        lfield = field_desc_next(lfield)
-        ) {
-        if (strcmp(lfield->name, rfield->name) == 0) {
-          shared = rfield->name;
-          break;
-        }
-      }
-      if (shared) // at this point we don't want to add the field, since there can be no duplicate names
-        continue;
+/** @b hj_spill
+ * 
+ * moves the records of the hash table, the rest of build and all of probe
+ * to new partitions in temporary tables, and adds the pairs of partitions
+ * that may join to the ones still to join. build is left open, for its
+ * caller to close.
+ */
+static void hj_spill(hash_join_state *st, plan_p build, plan_p probe,
+                     int level) {
+  join_state *js = &st->join;
+  record b_rec = st->build_left ? js->l_rec : js->r_rec;
+  record p_rec = st->build_left ? js->r_rec : js->l_rec;
+  char *b_key = st->build_left ? js->l_key : js->r_key;
+  char *p_key = st->build_left ? js->r_key : js->l_key;
+  tbl_p b_parts[HJ_NUM_PARTS], p_parts[HJ_NUM_PARTS];
+  for (int i = 0; i < HJ_NUM_PARTS; i++)
+    b_parts[i] = new_partition(build->sch);
+
+  int n = 0;
+  for (int i = 0; i < st->num_slots; i++)
+    for (hj_entry *e = st->slots[i].first; e; e = e->next, n++) {
+      hj_entry_record(e, b_rec, build->sch);
+      append_record(b_rec, b_parts[hj_part_of(st->slots[i].hash, level)]->sch);
     }
-    add_field(*dest, dup_field(rfield));
+  hj_clear(st);
+  for (; plan_next(build, b_rec); n++) {
+    unsigned h = pack_key(js, b_rec, st->build_left, b_key);
+    append_record(b_rec, b_parts[hj_part_of(h, level)]->sch);
   }
-
-  if (!shared) {
-    put_msg(ERROR, "No common attribute found");
-    release_schema(*dest);
+  for (int i = 0; i < HJ_NUM_PARTS; i++) {
+    end_partition(b_parts[i]);
+    p_parts[i] = new_partition(probe->sch);
+  }
+  if (plan_open(probe)) {
+    for (; plan_next(probe, p_rec); n++) {
+      unsigned h = pack_key(js, p_rec, !st->build_left, p_key);
+      append_record(p_rec, p_parts[hj_part_of(h, level)]->sch);
+    }
+    plan_close(probe);
   }
+  pager_profiler_count(hj_spilled_event, n);
 
-  return shared;
+  for (int i = 0; i < HJ_NUM_PARTS; i++) {
+    end_partition(p_parts[i]);
+    if (!b_parts[i]->num_records || !p_parts[i]->num_records) {
+      remove_table(b_parts[i]);
+      remove_table(p_parts[i]);
+      continue;
+    }
+    if (st->num_parts == st->max_parts) {
+      st->max_parts = st->max_parts ? 2 * st->max_parts : HJ_NUM_PARTS;
+      st->parts = realloc(st->parts, st->max_parts * sizeof (hj_partition));
+    }
+    st->parts[st->num_parts++] = (hj_partition) {b_parts[i], p_parts[i],
+                                                 level + 1};
+  }
+}
 
-MemErr:
-  put_msg(FATAL, "No more memory in join_schemas");
-  exit(EXIT_FAILURE);
+/** @b hj_join_pair
+ * 
+ * reads build into the hash table and opens probe to look it up, unless
+ * the table grows beyond the memory budget. Then both are partitioned by
+ * the hash bits of the level instead, and 0 is returned.
+ */
+static int hj_join_pair(hash_join_state *st, plan_p build, plan_p probe,
+                        int level) {
+  join_state *js = &st->join;
+  record rec = st->build_left ? js->l_rec : js->r_rec;
+  hj_clear(st);
+  if (!plan_open(build))
+    return 0;
+  while (plan_next(build, rec)) {
+    hj_insert(st, rec, build->sch);
+    if (level < HJ_MAX_LEVEL && hj_mem(st) > jn_mem_budget) {
+      hj_spill(st, build, probe, level);
+      plan_close(build);
+      return 0;
+    }
+  }
+  plan_close(build);
+  if (!plan_open(probe))
+    return 0;
+  st->probe = probe;
+  return 1;
+}
 
+/** @b hj_end_probe
+ * 
+ * closes the records that look up the hash table, and removes them if
+ * they are a partition
+ */
+static void hj_end_probe(hash_join_state *st) {
+  if (!st->probe)
+    return;
+  plan_close(st->probe);
+  if (st->probe_tbl) {
+    plan_release(st->probe);
+    remove_table(st->probe_tbl);
+  }
+  st->probe = 0;
+  st->probe_tbl = 0;
 }
 
-typedef struct find_and_merge_mem {
-  int first_time;
-  record l_record;
-  int l_offset;
-  int l_val;
-  record r_record;
-  int r_offset;
-} fm_mem_t;
+/** @b hj_next_partition
+ * 
+ * joins the last pair of partitions still to join, or partitions it again
+ */
+static void hj_next_partition(hash_join_state *st) {
+  hj_partition part = st->parts[--st->num_parts];
+  plan_p build = plan_scan(part.build, 0, 0, 0);
+  plan_p probe = plan_scan(part.probe, 0, 0, 0);
+  if (hj_join_pair(st, build, probe, part.level))
+    st->probe_tbl = part.probe;
+  else {
+    plan_release(probe);
+    remove_table(part.probe);
+  }
+  plan_release(build);
+  remove_table(part.build);
+}
 
+/** @b hash_join_open
+ * 
+ * reads the smaller input into the hash table, by the estimates of the
+ * numbers of records, and starts the other one. If the table does not fit
+ * in the memory budget, both inputs are partitioned by hash and the
+ * partitions are joined in turn (Grace hash join).
+ */
+static int hash_join_open(plan_p p) {
+  hash_join_state *st = p->state;
+  st->build_left = plan_card(p->left) < plan_card(p->right);
+  st->key_off = st->build_left ? p->left->sch->len : p->right->sch->len;
+  st->probe = 0;
+  st->probe_tbl = 0;
+  st->num_parts = 0;
+  hj_join_pair(st, st->build_left ? p->left : p->right,
+               st->build_left ? p->right : p->left, 0);
+  return 1;
+}
 
-typedef struct merging_schemas {
-  schema_p left;
-  schema_p right;
-  schema_p dest;
-} msch_t;
+static int hash_join_next(plan_p p, record r) {
+  hash_join_state *st = p->state;
+  join_state *js = &st->join;
+  schema_p b_sch = st->build_left ? p->left->sch : p->right->sch;
+  record b_rec = st->build_left ? js->l_rec : js->r_rec;
+  record p_rec = st->build_left ? js->r_rec : js->l_rec;
+  char *p_key = st->build_left ? js->r_key : js->l_key;
+  while (!st->match) {
+    if (st->probe && plan_next(st->probe, p_rec)) {
+      if (st->num_slots) {
+        unsigned h = pack_key(js, p_rec, !st->build_left, p_key);
+        st->match = hj_slot_of(st, h, p_key)->first;
+      }
+      continue;
+    }
+    hj_end_probe(st);
+    if (!st->num_parts)
+      return 0;
+    hj_next_partition(st);
+  }
+  hj_entry_record(st->match, b_rec, b_sch);
+  st->match = st->match->next;
+  join_record(r, p, js->l_rec, js->r_rec);
+  return 1;
+}
 
-typedef struct find_and_merge_args {
-  msch_t schemas;
-  const char *const fldname;
-  fm_mem_t *memory;
-} fm_args_t;
+static void hash_join_close(plan_p p) {
+  hash_join_state *st = p->state;
+  hj_end_probe(st);
+  while (st->num_parts) {
+    st->num_parts--;
+    remove_table(st->parts[st->num_parts].build);
+    remove_table(st->parts[st->num_parts].probe);
+  }
+  hj_clear(st);
+}
 
-void *memdup (const void *const __src, size_t __n)
-{
-  void *out = malloc(__n);
-  if (!out) return out;
-  return memcpy(out, __src, __n);
+static void hash_join_release(plan_p p) {
+  hash_join_state *st = p->state;
+  hj_clear(st);
+  free(st->parts);
+  join_release(p);
 }
 
-static void *get_record_val (record r, int o, schema_p s)
-{
-  int i;
-  field_desc_p f;
-  for (
-    i = 0, f = s->first;
-    f && f->offset < o;
-    i++, f = field_desc_next(f)
-  );
-  return r[i];
+/** @brief State of a merge join */
+typedef struct merge_join_state_struct {
+  join_state join;   /**< the shared fields and the records of the inputs */
+  int has_left;      /**< whether l_rec holds a record of the left input */
+  int has_right;     /**< whether ahead holds a record of the right input */
+  record ahead;      /**< the next record of the right input */
+  int group_key;     /**< the key of the records of group */
+  hj_entry *group;   /**< the right records with the same key, NULL if none */
+  hj_entry *match;   /**< the next record of group to join with l_rec,
+                          NULL if none */
+  mem_arena arena;   /**< memory of the records of group */
+} merge_join_state;
+
+static int merge_join_open(plan_p p) {
+  merge_join_state *st = p->state;
+  join_state *js = &st->join;
+  st->group = st->match = 0;
+  arena_reset(&st->arena);
+  if (!plan_open(p->left) || !plan_open(p->right))
+    return 0;
+  st->has_left = plan_next(p->left, js->l_rec);
+  st->has_right = plan_next(p->right, st->ahead);
+  return 1;
 }
 
-static record merge (record lrecord, record rrecord, int r_offset, msch_t schemas)
-{
-  if (!(lrecord && rrecord)) {
-    put_msg(ERROR, "no records found!\n");
-    return NULL;
+/** @b merge_join_next
+ * 
+ * moves on in the input with the smaller key until the keys are equal.
+ * The right records of a key are kept, to join with every left record of
+ * the key in turn. The inputs share a single int field.
+ */
+static int merge_join_next(plan_p p, record r) {
+  merge_join_state *st = p->state;
+  join_state *js = &st->join;
+  for (;;) {
+    if (st->match) {
+      hj_entry_record(st->match, js->r_rec, p->right->sch);
+      st->match = st->match->next;
+      join_record(r, p, js->l_rec, js->r_rec);
+      if (!st->match)
+        st->has_left = plan_next(p->left, js->l_rec);
+      return 1;
+    }
+    if (!st->has_left)
+      return 0;
+    int l_key = *(int *)js->l_rec[js->l_nrs[0]];
+    if (st->group && l_key == st->group_key) {
+      st->match = st->group;
+      continue;
+    }
+    if (!st->has_right)
+      return 0;
+    int r_key = *(int *)st->ahead[js->r_nrs[0]];
+    if (l_key < r_key)
+      st->has_left = plan_next(p->left, js->l_rec);
+    else if (l_key > r_key)
+      st->has_right = plan_next(p->right, st->ahead);
+    else {
+      hj_entry **last = &st->group;
+      arena_reset(&st->arena);
+      st->group_key = r_key;
+      while (st->has_right && *(int *)st->ahead[js->r_nrs[0]] == r_key) {
+        hj_entry *e = arena_alloc(&st->arena,
+                                  sizeof (hj_entry) + p->right->sch->len);
+        field_desc_p f;
+        int j = 0;
+        for (f = p->right->sch->first; f; f = f->next, j++)
+          memcpy(e->vals + f->offset, st->ahead[j], f->len);
+        e->next = 0;
+        *last = e;
+        last = &e->next;
+        st->has_right = plan_next(p->right, st->ahead);
+      }
+    }
   }
+}
 
-  void *p;
-  int i=0, j=0, op=0;
-  field_desc_p lf, rf;
-  record drecord;
+static void merge_join_close(plan_p p) {
+  merge_join_state *st = p->state;
+  plan_close(p->left);
+  plan_close(p->right);
+  st->group = st->match = 0;
+  arena_release(&st->arena);
+}
 
-  drecord = calloc(schemas.left->num_fields + schemas.right->num_fields-1, sizeof(void *));
-  if (!drecord) {
-    goto MemErr;
-  }
+static void merge_join_release(plan_p p) {
+  merge_join_state *st = p->state;
+  arena_release(&st->arena);
+  release_record(st->ahead, p->right->sch);
+  join_release(p);
+}
 
-  for (
-      i = 0,
-      lf = schemas.left->first;
-      i < schemas.left->num_fields;
-      i++,
-      lf = field_desc_next(lf)
-    ) {
-    p = memdup(lrecord[i], lf->len);
-    if (!p) goto MemErr;
+/** @brief State of a block nested loop join */
+typedef struct bnl_join_state_struct {
+  join_state join;   /**< the shared fields and the records of the inputs */
+  int max_chunk;     /**< max number of left records in a chunk */
+  int num_chunk;     /**< number of left records in the chunk */
+  char *chunk;       /**< the values of the left records of the chunk, one
+                          record after another */
+  char *keys;        /**< the packed keys of the left records of the
+                          chunk */
+  int pos;           /**< the next record of the chunk to compare with
+                          r_rec */
+  int has_right;     /**< whether r_rec holds a record of the right input */
+  int left_done;     /**< whether the left input has no more records */
+} bnl_join_state;
+
+/** pages of the buffer a chunk of a block nested loop may take, the others
+    are left to the right input */
+#define BNL_CHUNK_PAGES (NUM_PAGES - 2)
+
+static int bnl_join_open(plan_p p) {
+  bnl_join_state *st = p->state;
+  st->num_chunk = st->pos = 0;
+  st->has_right = st->left_done = 0;
+  return plan_open(p->left);
+}
 
-    drecord[i] = p;
-  }
-  for (
-      j = 0,
-      rf = schemas.right->first;
-      j < schemas.right->num_fields-1;
-      j++,
-      rf = field_desc_next(rf)
-    ) {
-    if (rf->offset == r_offset) {
-      rf = field_desc_next(rf);
-      op = 1;
+/** @b bnl_next_chunk
+ * 
+ * reads the next chunk of left records and starts the right input anew.
+ * Returns 0 when the left input has no more records.
+ */
+static int bnl_next_chunk(plan_p p) {
+  bnl_join_state *st = p->state;
+  join_state *js = &st->join;
+  schema_p ls = p->left->sch;
+  st->num_chunk = 0;
+  while (!st->left_done && st->num_chunk < st->max_chunk) {
+    if (!plan_next(p->left, js->l_rec)) {
+      st->left_done = 1;
+      break;
     }
-
-    p = memdup(rrecord[j+op], rf->len);
-    if (!p) goto MemErr;
-
-    drecord[i+j] = p;
+    char *vals = st->chunk + (long) st->num_chunk * ls->len;
+    field_desc_p f;
+    int j = 0;
+    for (f = ls->first; f; f = f->next, j++)
+      memcpy(vals + f->offset, js->l_rec[j], f->len);
+    pack_key(js, js->l_rec, 1, st->keys + (long) st->num_chunk * js->key_len);
+    st->num_chunk++;
   }
+  if (!st->num_chunk || !plan_open(p->right))
+    return 0;
+  st->has_right = plan_next(p->right, js->r_rec);
+  st->pos = 0;
+  if (!st->has_right)
+    plan_close(p->right); /* nothing to join with */
+  return st->has_right;
+}
 
-  return drecord;
-
-MemErr:
-  if (drecord) {
-    for (int __q = 0; __q < i + j; __q++) {
-      if (drecord[__q])
-        free(drecord[__q]);
-      else
-        break;  
+/** @b bnl_join_next
+ * 
+ * compares every record of the right input with all the left records of
+ * the chunk, then moves on to the next chunk
+ */
+static int bnl_join_next(plan_p p, record r) {
+  bnl_join_state *st = p->state;
+  join_state *js = &st->join;
+  schema_p ls = p->left->sch;
+  for (;;) {
+    if (st->has_right) {
+      if (st->pos == 0)
+        pack_key(js, js->r_rec, 0, js->r_key);
+      while (st->pos < st->num_chunk) {
+        int i = st->pos++;
+        if (memcmp(st->keys + (long) i * js->key_len, js->r_key,
+                   js->key_len) == 0) {
+          char *vals = st->chunk + (long) i * ls->len;
+          field_desc_p f;
+          int j = 0;
+          for (f = ls->first; f; f = f->next, j++)
+            memcpy(js->l_rec[j], vals + f->offset, f->len);
+          join_record(r, p, js->l_rec, js->r_rec);
+          return 1;
+        }
       }
-    free(drecord);
+      st->has_right = plan_next(p->right, js->r_rec);
+      st->pos = 0;
+      if (st->has_right)
+        continue;
+      plan_close(p->right);
+    }
+    if (!bnl_next_chunk(p))
+      return 0;
   }
+}
 
-  put_msg(FATAL, "merge: No more memory!\n");
-  exit(EXIT_FAILURE);
+static void bnl_join_close(plan_p p) {
+  bnl_join_state *st = p->state;
+  if (st->has_right)
+    plan_close(p->right);
+  st->has_right = 0;
+  plan_close(p->left);
+}
 
+static void bnl_join_release(plan_p p) {
+  bnl_join_state *st = p->state;
+  free(st->chunk);
+  free(st->keys);
+  join_release(p);
 }
 
-void fm_setup (fm_args_t args)
-{
-  field_desc_p f;
-  f = get_field(args.schemas.left, args.fldname);
+/** @b plan_sorted
+ * 
+ * returns true if the records of the plan come in ascending order of the
+ * named int field
+ */
+static int plan_sorted(plan_p p, char const* name) {
+  if (p->open == scan_open) {
+    /* every access path reads the records in the order of the table */
+    field_desc_p f = get_field(((scan_state *) p->state)->t->sch, name);
+    return f && is_int_field(f) && f->sorted;
+  }
+  if (p->next == hash_join_next || p->next == bnl_join_next)
+    return 0;
+  if (p->next == merge_join_next)
+    return strcmp(((join_state *) p->state)->r_flds[0]->name, name) == 0;
+  /* the others keep the order of their (left) input */
+  return get_field(p->left->sch, name) && plan_sorted(p->left, name);
+}
+
+/** @b right_indexed
+ * 
+ * returns true if the right input is a scan, under conditions pushed down
+ * or not, that can look up the records with a value of field f with an
+ * index or a binary search
+ */
+static int right_indexed(plan_p right, field_desc_p f) {
+  while (right->next == filter_next)
+    right = right->left;
+  if (right->open != scan_open || ((scan_state *) right->state)->f)
+    return 0;
+  f = get_field(((scan_state *) right->state)->t->sch, f->name);
+  return srch_method != SEARCH_LINEAR
+    && (f->hash_fname || f->bt_fname || f->bm
+        || (f->sorted && ((scan_state *) right->state)->t->num_freed == 0));
+}
 
-  *args.memory = (fm_mem_t){
-  .first_time = -1,
+/** @b tbl_blocks
+ * 
+ * returns the block reads of a scan of all records of table t, as the
+ * pager profiler counts them
+ */
+static double tbl_blocks(tbl_p t) {
+  return (double) t->num_records / pax_capacity(t->sch) + 1;
+}
 
-  .l_offset = f->offset,
-  .l_record = new_record(args.schemas.left),
+/** block reads of a lookup of an index nested loop: a bucket or a few
+    B+-tree nodes, and the block of the record */
+#define INL_LOOKUP_READS 3
 
-  .r_offset = f->offset,
-  .r_record = new_record(args.schemas.right)
-  };
+/** @b inl_reads
+ * 
+ * returns the block reads of looking up the records of table t with a
+ * value of field f: those of the index, and a block for every record with
+ * the value, as many as the distinct values of the field leave. A record
+ * of a COL_LAYOUT table is read from a block of every field.
+ */
+static double inl_reads(tbl_p t, field_desc_p f) {
+  double matches = t->num_records / field_distinct(t, f);
+  double rec_reads = t->layout == COL_LAYOUT ? t->sch->num_fields : 1;
+  return INL_LOOKUP_READS - 1 + (matches > 1 ? matches : 1) * rec_reads;
+}
 
-  if (!get_record(args.memory->l_record, args.schemas.left))
-    return;
-  args.memory->l_val = *(int*)get_record_val(args.memory->l_record, args.memory->l_offset, args.schemas.left);
+/** @b inl_cheaper
+ * 
+ * returns true if looking up the right records of every left record on
+ * field f costs fewer block reads than reading the right input once, as a
+ * hash join does
+ */
+static int inl_cheaper(plan_p left, plan_p right, field_desc_p f) {
+  while (right->next == filter_next)
+    right = right->left;
+  tbl_p t = ((scan_state *) right->state)->t;
+  return plan_card(left) * inl_reads(t, get_field(t->sch, f->name))
+    < tbl_blocks(t);
 }
 
-record find_and_merge (fm_args_t args)
-{ 
-  record drecord;
+static join_method jn_method = JOIN_AUTO;
 
-  if (args.memory->first_time == 0)
-    fm_setup(args);
+void set_join_method(join_method method) {
+  jn_method = method;
+}
 
-  while (1){
-    if (find_record_int_val(args.memory->r_record, args.schemas.right, args.memory->r_offset, int_eq, args.memory->l_val)) {
-      drecord = merge(args.memory->l_record, args.memory->r_record, args.memory->r_offset, args.schemas);
-      break;
-    } else if (get_record(args.memory->l_record, args.schemas.left)) {
-        args.memory->l_val = *(int*)get_record_val(args.memory->l_record, args.memory->l_offset, args.schemas.left);
-        set_tbl_position(args.schemas.right->tbl, TBL_BEG);
-    } else {
-      release_record(args.memory->r_record, args.schemas.right);
-      release_record(args.memory->l_record, args.schemas.left);
-      return NULL;
+plan_p plan_natural_join(plan_p left, plan_p right) {
+  if (!(left && right)) {
+    plan_release(left);
+    plan_release(right);
+    return 0;
+  }
+  schema_p ls = left->sch, rs = right->sch;
+  /* the fields of the right input that the left one has too */
+  int num_keys = 0;
+  field_desc_p lf, rf;
+  for (rf = rs->first; rf; rf = rf->next) {
+    if (!(lf = get_field(ls, rf->name)))
+      continue;
+    if (is_int_field(lf) != is_int_field(rf)) {
+      put_msg(ERROR, "natural join: \"%s\" is int in one of \"%s\" and "
+              "\"%s\" and str in the other.\n", rf->name, ls->name, rs->name);
+      plan_release(left);
+      plan_release(right);
+      return 0;
     }
+    num_keys++;
+  }
+  if (!num_keys) {
+    put_msg(ERROR, "natural join: \"%s\" and \"%s\" have no common field.\n",
+            ls->name, rs->name);
+    plan_release(left);
+    plan_release(right);
+    return 0;
+  }
+  field_desc_p *r_flds = malloc(num_keys * sizeof (field_desc_p));
+  int *l_nrs = malloc(num_keys * sizeof (int));
+  int *r_nrs = malloc(num_keys * sizeof (int));
+  int *key_lens = malloc(num_keys * sizeof (int));
+  int key_len = 0, int_key = -1, k = 0;
+  for (rf = rs->first; rf; rf = rf->next) {
+    if (!(lf = get_field(ls, rf->name)))
+      continue;
+    r_flds[k] = rf;
+    l_nrs[k] = field_nr(ls, lf);
+    r_nrs[k] = field_nr(rs, rf);
+    key_lens[k] = lf->len > rf->len ? lf->len : rf->len;
+    key_len += key_lens[k];
+    if (int_key < 0 && is_int_field(rf))
+      int_key = k;
+    k++;
+  }
+  char *name = concat_names(ls->name, "_and_", rs->name);
+  schema_p dest = make_schema(name);
+  free(name);
+  int fits = 1;
+  for (field_desc_p f = ls->first; f && fits; f = f->next)
+    fits = add_field(dest, dup_field(f));
+  for (field_desc_p f = rs->first; f && fits; f = f->next)
+    if (!get_field(ls, f->name))
+      fits = add_field(dest, dup_field(f));
+  if (!fits) {
+    release_schema(dest);
+    free(r_flds);
+    free(l_nrs);
+    free(r_nrs);
+    free(key_lens);
+    plan_release(left);
+    plan_release(right);
+    return 0;
   }
 
-  return drecord;
+  join_method method = jn_method;
+  if (method == JOIN_AUTO && int_key >= 0
+      && right_indexed(right, r_flds[int_key])
+      && inl_cheaper(left, right, r_flds[int_key]))
+    method = JOIN_INDEX_NESTED_LOOP;
+  if (method == JOIN_AUTO || method == JOIN_MERGE)
+    method = num_keys == 1 && int_key == 0
+      && plan_sorted(left, r_flds[0]->name)
+      && plan_sorted(right, r_flds[0]->name) ? JOIN_MERGE : JOIN_HASH;
+
+  join_state *st;
+  if (method == JOIN_NESTED_LOOP || method == JOIN_INDEX_NESTED_LOOP)
+    st = malloc(sizeof (join_state));
+  else if (method == JOIN_MERGE) {
+    merge_join_state *mj = malloc(sizeof (merge_join_state));
+    mj->has_left = mj->has_right = 0;
+    mj->ahead = new_record(rs);
+    mj->group = mj->match = 0;
+    mj->arena = (mem_arena) {0, 0};
+    st = &mj->join;
+  } else if (method == JOIN_BLOCK_NESTED_LOOP) {
+    bnl_join_state *bj = malloc(sizeof (bnl_join_state));
+    long bytes = (long) BNL_CHUNK_PAGES * (BLOCK_SIZE - PAGE_HEADER_SIZE);
+    if (bytes > jn_mem_budget)
+      bytes = jn_mem_budget;
+    bj->max_chunk = bytes / ls->len > 0 ? bytes / ls->len : 1;
+    bj->chunk = malloc((long) bj->max_chunk * ls->len);
+    bj->keys = malloc((long) bj->max_chunk * key_len);
+    bj->num_chunk = bj->pos = 0;
+    bj->has_right = bj->left_done = 0;
+    st = &bj->join;
+  } else {
+    hash_join_state *hj = malloc(sizeof (hash_join_state));
+    hj->build_left = 0;
+    hj->slots = 0;
+    hj->num_slots = hj->num_keys = 0;
+    hj->arena = (mem_arena) {0, 0};
+    hj->match = 0;
+    hj->probe = 0;
+    hj->probe_tbl = 0;
+    hj->parts = 0;
+    hj->num_parts = hj->max_parts = 0;
+    st = &hj->join;
+  }
+  st->num_keys = num_keys;
+  st->r_flds = r_flds;
+  st->l_nrs = l_nrs;
+  st->r_nrs = r_nrs;
+  st->key_lens = key_lens;
+  st->key_len = key_len;
+  st->int_key = int_key;
+  st->l_key = malloc(key_len);
+  st->r_key = malloc(key_len);
+  st->l_rec = new_record(ls);
+  st->r_rec = new_record(rs);
+  st->has_left = 0;
+  st->by_index = method == JOIN_INDEX_NESTED_LOOP;
+  plan_p p = new_plan(dest, 1, left, right, st);
+  if (method == JOIN_NESTED_LOOP || method == JOIN_INDEX_NESTED_LOOP) {
+    p->open = join_open;
+    p->next = join_next;
+    p->close = join_close;
+    p->release = join_release;
+  } else if (method == JOIN_MERGE) {
+    p->open = merge_join_open;
+    p->next = merge_join_next;
+    p->close = merge_join_close;
+    p->release = merge_join_release;
+  } else if (method == JOIN_BLOCK_NESTED_LOOP) {
+    p->open = bnl_join_open;
+    p->next = bnl_join_next;
+    p->close = bnl_join_close;
+    p->release = bnl_join_release;
+  } else {
+    p->open = hash_join_open;
+    p->next = hash_join_next;
+    p->close = hash_join_close;
+    p->release = hash_join_release;
+  }
+  return p;
 }
 
-tbl_p table_natural_join (tbl_p left, tbl_p right) {
-  if (!(left && right)) {
-    put_msg(ERROR, "no table found!\n");
-    return 0;
+/** @brief Cheapest order found to join a set of tables */
+typedef struct join_order_struct {
+  double card;       /**< estimated number of records of the join */
+  double cost;       /**< estimated block reads of the join */
+  double len;        /**< bytes of a record of the join */
+  int last;          /**< the table joined last, -1 if no order is found */
+} join_order;
+
+/** @b set_distinct
+ * 
+ * returns the least estimate of the number of distinct values of the named
+ * field among the tables of set, a bit per table, that have the field,
+ * or 0 if none has it
+ */
+static double set_distinct(tbl_p tbls[], int set, char const* name) {
+  double res = 0;
+  for (int i = 0; set >> i; i++) {
+    field_desc_p f = set >> i & 1 ? get_field(tbls[i]->sch, name) : 0;
+    if (f) {
+      double d = field_distinct(tbls[i], f);
+      if (!res || d < res)
+        res = d;
+    }
   }
+  return res;
+}
 
-  tbl_p res = NULL;
-  schema_p NJ_sch;
-  record c_product;
-  char *const key = join_schemas(&NJ_sch, left, right);
-  if (!key)
-    return NULL;
+/** @b join_step
+ * 
+ * estimates the join of the tables of set, joined in the order of o, with
+ * table j into res. The number of records is divided, for every shared
+ * field, by the larger number of distinct values of the two sides. The
+ * cost adds the block reads of the right input by the join method, those
+ * of a hash join counting the partitions written and read again.
+ * Returns 0 if the table shares no field with the set.
+ */
+static int join_step(tbl_p tbls[], int set, join_order *o, int j,
+                     join_order *right, int cond_j, join_order *res) {
+  double div = 1;
+  field_desc_p int_key = 0;
+  int shared = 0;
+  for (field_desc_p f = tbls[j]->sch->first; f; f = f->next) {
+    double dl = set_distinct(tbls, set, f->name);
+    if (!dl)
+      continue;
+    shared = 1;
+    if (!int_key && is_int_field(f))
+      int_key = f;
+    double dr = field_distinct(tbls[j], f);
+    if (dl > o->card) dl = o->card;
+    if (dr > right->card) dr = right->card;
+    div *= dl > dr ? (dl > 1 ? dl : 1) : (dr > 1 ? dr : 1);
+  }
+  if (!shared)
+    return 0;
 
-  fm_mem_t memory = {};
+  double blocks = tbl_blocks(tbls[j]), reads;
+  double page = BLOCK_SIZE - PAGE_HEADER_SIZE;
+  int indexed = int_key && !cond_j && srch_method != SEARCH_LINEAR
+    && (int_key->hash_fname || int_key->bt_fname || int_key->bm
+        || (int_key->sorted && tbls[j]->num_freed == 0));
+  if (jn_method == JOIN_NESTED_LOOP
+      || (jn_method == JOIN_INDEX_NESTED_LOOP && !indexed))
+    reads = o->card * blocks;
+  else if (jn_method == JOIN_INDEX_NESTED_LOOP)
+    reads = o->card * inl_reads(tbls[j], int_key);
+  else if (jn_method == JOIN_BLOCK_NESTED_LOOP) {
+    double chunk = BNL_CHUNK_PAGES * page;
+    if (chunk > jn_mem_budget)
+      chunk = jn_mem_budget;
+    reads = ((long) (o->card * o->len / chunk) + 1) * blocks;
+  } else {
+    double l_bytes = o->card * o->len, r_bytes = right->card * right->len;
+    reads = blocks;
+    if ((l_bytes < r_bytes ? l_bytes : r_bytes) > jn_mem_budget)
+      reads += 2 * (l_bytes + r_bytes) / page;
+    if (jn_method == JOIN_AUTO && indexed
+        && o->card * inl_reads(tbls[j], int_key) < reads)
+      reads = o->card * inl_reads(tbls[j], int_key);
+  }
+  res->card = o->card * right->card / div;
+  res->cost = o->cost + reads;
+  res->len = o->len + right->len;
+  res->last = j;
+  return 1;
+}
 
-  fm_args_t args = {
-    .schemas = {
-      .dest = NJ_sch,
-      .left = left->sch,
-      .right = right->sch
-    },
-    .fldname = key,
-    .memory = &memory
-  };
+plan_p plan_natural_joins(int num_tbls, tbl_p tbls[], char const* attr,
+                          char const* op, int val) {
+  if (num_tbls < 1 || num_tbls > MAX_JOIN_TBLS) {
+    put_msg(ERROR, "natural join of %d tables is not supported.\n",
+            num_tbls);
+    return 0;
+  }
+  int all = (1 << num_tbls) - 1;
+  join_order *best = malloc((all + 1) * sizeof (join_order));
+  int *cond = malloc(num_tbls * sizeof (int));
+  for (int set = 0; set <= all; set++)
+    best[set].last = -1;
+  for (int i = 0; i < num_tbls; i++) {
+    /* the condition goes down to the scans of the tables with its field */
+    field_desc_p f = attr ? get_field(tbls[i]->sch, attr) : 0;
+    cond[i] = f && is_int_field(f) && interpret_op(op);
+    plan_p scan = plan_scan(tbls[i], cond[i] ? attr : 0, op, val);
+    best[1 << i] = (join_order) {scan ? plan_card(scan) : 0,
+                                 tbl_blocks(tbls[i]), tbls[i]->sch->len, i};
+    plan_release(scan);
+  }
 
-  set_tbl_position(left, TBL_BEG);
-  set_tbl_position(right, TBL_BEG);
+  /* the cheapest order of every set is the cheapest order of a set with
+     one table less, then that table. Sets are planned before the larger
+     ones, and on equal costs the order as written is kept. */
+  for (int set = 1; set < all; set++) {
+    if (best[set].last < 0)
+      continue;
+    for (int j = 0; j < num_tbls; j++) {
+      join_order o;
+      int to = set | 1 << j;
+      if (to != set
+          && join_step(tbls, set, best + set, j, best + (1 << j), cond[j], &o)
+          && (best[to].last < 0 || o.cost < best[to].cost))
+        best[to] = o;
+    }
+  }
+  if (best[all].last < 0) {
+    put_msg(ERROR, "natural join: every table must share a field with the"
+            " ones before it in some order.\n");
+    free(best);
+    free(cond);
+    return 0;
+  }
 
-  while (NULL != (c_product = find_and_merge(args))){
-    append_record(c_product, NJ_sch);
-    release_record(c_product, NJ_sch);
+  int order[MAX_JOIN_TBLS], in_order = 1;
+  for (int set = all, k = num_tbls - 1; k >= 0; k--) {
+    order[k] = best[set].last;
+    in_order = in_order && order[k] == k;
+    set &= ~(1 << order[k]);
   }
-  res = NJ_sch->tbl;
+  put_msg(DEBUG, "natural joins: %.0f records by %.0f block reads\n",
+          best[all].card, best[all].cost);
+  free(best);
+  free(cond);
+
+  plan_p plan = plan_scan(tbls[order[0]], 0, 0, 0);
+  for (int k = 1; k < num_tbls; k++)
+    plan = plan_natural_join(plan, plan_scan(tbls[order[k]], 0, 0, 0));
+  if (attr)
+    plan = plan_filter(plan, attr, op, val);
+  if (!plan || in_order)
+    return plan;
+
+  /* the fields come in the order of the tables as written */
+  int num_fields = 0;
+  for (int i = 0; i < num_tbls; i++)
+    num_fields += tbls[i]->sch->num_fields;
+  char **names = malloc(num_fields * sizeof (char *));
+  num_fields = 0;
+  for (int i = 0; i < num_tbls; i++)
+    for (field_desc_p f = tbls[i]->sch->first; f; f = f->next) {
+      int k = 0;
+      while (k < num_fields && strcmp(names[k], f->name) != 0)
+        k++;
+      if (k == num_fields)
+        names[num_fields++] = f->name;
+    }
+  plan = plan_project(plan, num_fields, names);
+  free(names);
+  return plan;
+}
 
-  return res;
+int plan_display(plan_p p) {
+  if (!p) return -1;
+  schema_p s = p->sch;
+  record rec = new_record(s);
+  int n = 0;
+  display_header(s);
+  plan_open(p);
+  for (; plan_next(p, rec); n++)
+    display_record(rec, s);
+  plan_close(p);
+  put_msg(FORCE, "\n");
+  release_record(rec, s);
+  return n;
+}
+
+int plan_count(plan_p p) {
+  if (!p) return -1;
+  record rec = new_record(p->sch);
+  int n = 0;
+  plan_open(p);
+  while (plan_next(p, rec))
+    n++;
+  plan_close(p);
+  release_record(rec, p->sch);
+  return n;
 }
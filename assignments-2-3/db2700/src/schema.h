@@ -36,6 +36,18 @@
  * "equal_record()".  Access the record at the current position of a
  * page with @ref get_record "get_record()" and @ref put_record
  * "put_record()".
+ *
+ * A table is stored with one of the @ref tbl_layout "layouts".
+ * With @ref ROW_LAYOUT, the records of a block are stored one after another,
+ * and a str value takes only the bytes of its actual length,
+ * stored at the end of the block.
+ * With @ref PAX_LAYOUT, a block is divided into one minipage per field,
+ * so that the values of a field are stored contiguously in the block.
+ * With @ref COL_LAYOUT, each field is stored in a file of its own,
+ * and the record number is given by the position of the value in that file,
+ * so that a query reads only the files of the fields it references.
+ * Choose the layout with @ref set_schema_layout "set_schema_layout()"
+ * before any record is added to the table.
  */
 
 #ifndef _SCHEMA_H_
@@ -45,13 +57,22 @@
 #include <stdarg.h>
 
 #define MAX_STR_LEN 100
+/** max number of tables plan_natural_joins() joins */
+#define MAX_JOIN_TBLS 8
 
 typedef enum {INT_TYPE, STR_TYPE} field_type;
 typedef enum {TBL_BEG, TBL_END} tbl_position;
+/** Storage layout of the records in a table file */
+typedef enum {
+  ROW_LAYOUT, /**< whole records stored one after another (default) */
+  PAX_LAYOUT, /**< values grouped per field within each block */
+  COL_LAYOUT  /**< one file per field, records identified by position */
+} tbl_layout;
 
 typedef struct field_desc_struct * field_desc_p;
 typedef struct schema_struct * schema_p;
 typedef struct tbl_desc_struct * tbl_p;
+typedef struct plan_struct * plan_p;
 
 /** @brief Data record
 
@@ -71,6 +92,8 @@ extern void put_record_info(pmsg_level level, record const r, schema_p s);
 extern void put_schema_info(pmsg_level level, schema_p s);
 extern void put_tbl_info(pmsg_level level, tbl_p t);
 extern void put_db_info(pmsg_level level);
+/** Print the memory used by the access structures kept in memory. */
+extern void put_access_info(pmsg_level level);
 
 /* table API */
 
@@ -78,8 +101,12 @@ extern void put_db_info(pmsg_level level);
     The database and tables are stored at @ref sys_dir.
     Return 0 upon failure. */
 extern int open_db(void);
-/** Close a database */
+/** Close a database.
+    The descriptors of the tables that have changed are saved. */
 extern void close_db(void);
+/** Save the descriptor of the table in the catalog right away,
+    for example after creating the table. Returns 0 upon failure. */
+extern int save_table(tbl_p t);
 
 /** Make a new schema and add it to the current database */
 extern schema_p new_schema(char const* name);
@@ -97,6 +124,12 @@ extern field_desc_p schema_last_fld_desc(schema_p sch);
 extern int schema_num_flds(schema_p sch);
 /** Return length of schema in number of bytes. */
 extern int schema_len(schema_p sch);
+/** Return the storage layout of the table of the schema. */
+extern tbl_layout schema_layout(schema_p sch);
+/** Set the storage layout of the table of the schema.
+    Returns 0 if the table already has records, or if its records would
+    not fit in a page with @ref ROW_LAYOUT. */
+extern int set_schema_layout(schema_p sch, tbl_layout layout);
 
 /** Make an int field with name @em name. */
 extern field_desc_p new_int_field(char const* name);
@@ -109,7 +142,9 @@ extern int is_int_field(field_desc_p f);
 /** Returns the next field_desc */
 extern field_desc_p field_desc_next(field_desc_p f);
 
-/** Add a field to the schema */
+/** Add a field to the schema. Returns 0, and releases the field, if the
+    records would not fit in a page, as rows unless the table has another
+    layout. */
 extern int add_field(schema_p s, field_desc_p f);
 /** Creates a new record of schema @em s.
     It is the responsibility of the using program to free the memory
@@ -154,15 +189,138 @@ extern void append_record(record const r, schema_p s);
 
 /** Return an existing table desc, NULL if the table does not exist. */
 extern tbl_p get_table(char const* name);
+/** Return the schema of the table. */
+extern schema_p table_schema(tbl_p t);
 /** Remove a table from the current database */
 extern void remove_table(tbl_p t);
 /** Print all rows of a table. */
 extern void table_display(tbl_p s);
-/** Make a new table as the result of a search. */
-extern tbl_p table_search(tbl_p t, char const* attr,
-                          char const* op, int val, int b_search);
+/** How table_search() finds the records */
+typedef enum {
+  SEARCH_AUTO,          /**< binary search when the field is known to be sorted,
+                             with the fence keys (default) */
+  SEARCH_INTERPOLATION, /**< interpolation search when the field is sorted */
+  SEARCH_LEARNED,       /**< search with a learned index when the field is sorted */
+  SEARCH_LINEAR         /**< always scan the table, e.g. to compare with the others */
+} search_method;
+/** Set how table_search() finds the records. */
+extern void set_search_method(search_method method);
+/** Make a new table as the result of a search.
+    A search with = or != uses the bitmap index of the field if it has one,
+    and a search with = the hash index.
+    Otherwise binary search is used if the field is sorted, see
+    @ref search_method, and otherwise the B+-tree of the field if it has one. */
+extern tbl_p table_search(tbl_p t, char const* attr, char const* op, int val);
+/** Count the records where @em attr @em op @em val holds, or all records if
+    @em attr is NULL. With a bitmap index, no block of the table is read.
+    Returns -1 upon failure. */
+extern int table_count(tbl_p t, char const* attr, char const* op, int val);
+/** Set field @em set_attr to @em set_val in the records where
+    @em attr @em op @em val holds, or in all records if @em attr is NULL.
+    Returns the number of updated records, -1 upon failure. */
+extern int table_update(tbl_p t, char const* set_attr, char const* set_val,
+                        char const* attr, char const* op, int val);
+/** Delete the records where @em attr @em op @em val holds,
+    or all records if @em attr is NULL.
+    Only tables with @ref ROW_LAYOUT support delete.
+    Returns the number of deleted records, -1 upon failure. */
+extern int table_delete(tbl_p t, char const* attr, char const* op, int val);
+/** Kind of index made by create_index() */
+typedef enum {
+  BTREE_INDEX, /**< B+-tree, for all comparisons but != (default) */
+  HASH_INDEX,  /**< extendible hashing, for = only */
+  BITMAP_INDEX, /**< a bitmap per value, for = and != on fields with
+                     few distinct values, kept in memory */
+  BLOOM_FILTER  /**< a Bloom filter per block, which lets scans with =
+                     skip the blocks without the value, kept in memory */
+} index_kind;
+/** Set the false positive rate of the Bloom filters made afterwards
+    (default 0.01). */
+extern void set_bloom_fpr(double fpr);
+/** Make an index of the given kind on the int field @em attr of the table,
+    which table_search() then uses. A field may have one index of each kind.
+    Returns 0 upon failure. */
+extern int create_index(tbl_p t, char const* attr, index_kind kind);
 /** Make a new table as a result of project. */
 extern tbl_p table_project(tbl_p t, int num_fields, char* fields[]);
-/** Join two tables and return the joined table. */
+/** Join two tables on all their shared fields and return the joined
+    table, see plan_natural_join(). */
 extern tbl_p table_natural_join(tbl_p left, tbl_p right);
+
+/* query plans
+
+   A query plan is a tree of nodes that pass records on one at a time,
+   from the scans of the tables at the leaves up to the root, without
+   writing intermediate results to tables. The functions that make a node
+   return NULL upon failure, after releasing the input nodes, so that a plan
+   can be made in one go. */
+
+/** Make a scan of the records of table @em t where @em attr @em op @em val
+    holds, or of all records if @em attr is NULL. The records are found the
+    same way as by table_search(). */
+extern plan_p plan_scan(tbl_p t, char const* attr, char const* op, int val);
+/** Make a node passing on the records of @em in where the int field
+    @em attr @em op @em val holds. The condition is pushed down the plan:
+    a scan without condition searches with it, and a join passes it on
+    to the input that has the field, or to both for a shared field. */
+extern plan_p plan_filter(plan_p in, char const* attr, char const* op, int val);
+/** Make a node passing on the given fields of the records of @em in. */
+extern plan_p plan_project(plan_p in, int num_fields, char* fields[]);
+/** How plan_natural_join() joins the records */
+typedef enum {
+  JOIN_AUTO,        /**< an index nested loop for a few left records and a
+                         right table with an index on a shared int field, a
+                         merge join if both inputs come in ascending order
+                         of their only shared field, a hash join otherwise
+                         (default) */
+  JOIN_NESTED_LOOP, /**< the right input is scanned anew for every left record */
+  JOIN_HASH,        /**< the smaller input is read into a hash table in
+                         memory, which the records of the other one look up */
+  JOIN_MERGE,       /**< both inputs are read once, side by side, in ascending
+                         order of the shared field. A hash join is made
+                         instead unless both come in that order of a single
+                         shared int field. */
+  JOIN_BLOCK_NESTED_LOOP, /**< the right input is scanned anew for every chunk
+                         of left records that fits in the buffer pages */
+  JOIN_INDEX_NESTED_LOOP /**< the right records of every left record are
+                         looked up with the index of the right table, as a
+                         search of the table does */
+} join_method;
+/** Set how plan_natural_join() joins the records. */
+extern void set_join_method(join_method method);
+/** Set the memory of the hash table of a hash join, 1 MB by default.
+    Inputs that need more are partitioned into temporary tables by hash of
+    the key, and the partitions are joined one pair at a time.
+    A chunk of a block nested loop is kept within it too. */
+extern void set_join_mem_budget(long bytes);
+/** Make a natural join of the records of the two inputs on all the fields
+    that both have, int or str fields of the same type on both sides. A
+    shared field appears once, in the place it has in @em left.
+    The records come in the order of the left input, except for a hash join
+    that builds its hash table on the left input or partitions the inputs,
+    and for a block nested loop. */
+extern plan_p plan_natural_join(plan_p left, plan_p right);
+/** Make the natural joins of the @em num_tbls tables, where @em attr
+    @em op @em val holds if @em attr is not NULL. The tables are joined one
+    after another, in the order of the fewest block reads estimated from
+    their numbers of records and the statistics of their fields: the zone
+    map, and the bitmap indexes. The records stream through the joins, and
+    their fields come in the order of the tables as given. */
+extern plan_p plan_natural_joins(int num_tbls, tbl_p tbls[],
+                                 char const* attr, char const* op, int val);
+/** Return the schema of the records a node produces. */
+extern schema_p plan_schema(plan_p p);
+/** Start producing the records of the plan. Returns 0 upon failure. */
+extern int plan_open(plan_p p);
+/** Produce the next record of the plan into @em r, a record of
+    plan_schema(). Returns 0 when there are no more records. */
+extern int plan_next(plan_p p, record r);
+/** Stop producing records. The plan may be opened again. */
+extern void plan_close(plan_p p);
+/** Release a plan with all its nodes. */
+extern void plan_release(plan_p p);
+/** Print all records of a plan. Returns their number, -1 upon failure. */
+extern int plan_display(plan_p p);
+/** Count the records of a plan. Returns -1 upon failure. */
+extern int plan_count(plan_p p);
 #endif
@@ -1,4 +1,5 @@
 #include "test_data_gen.h"
+#include "testpager.h"
 #include "testschema.h"
 #include "pmsg.h"
 #include <ctype.h>
@@ -66,11 +67,26 @@ int main(int argc, char* argv[]) {
   test_page_read_with_offset("testpage_w_offset");
   */
 
+  test_page_slots("testpage_slots");
+
   char my_tbl[] = "Me";
   test_tbl_write(my_tbl);
   test_tbl_read(my_tbl);
 
   test_tbl_natural_join(my_tbl, "You");
 
+  char pax_tbl[] = "Pax";
+  test_tbl_write_pax(pax_tbl);
+  test_tbl_read(pax_tbl);
+
+  char col_tbl[] = "Col";
+  test_tbl_write_columnar(col_tbl);
+  test_tbl_read(col_tbl);
+
+  test_tbl_update_delete("Upd");
+  test_tbl_search("Srch", ROW_LAYOUT);
+  test_tbl_search("SrchPax", PAX_LAYOUT);
+  test_tbl_search("SrchCol", COL_LAYOUT);
+
   return (0);
 }
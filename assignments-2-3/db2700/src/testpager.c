@@ -180,3 +180,74 @@ void test_page_read_with_offset(char const* fname) {
   /* put_pager_info(DEBUG, "After pager_terminate"); */
   put_msg(INFO, "test_page_read_with_offset() succeeds.\n");
 }
+
+static void check_slot(page_p pg, int slot, char const* str) {
+  char str_out[BLOCK_SIZE];
+  int len = page_slot_len(pg, slot);
+  if (len != strlen(str) + 1) {
+    put_msg(FATAL, "test_page_slots fails: slot %d has length %d, should be %d\n",
+            slot, len, strlen(str) + 1);
+    exit(EXIT_FAILURE);
+  }
+  page_get_str_at(pg, page_slot_pos(pg, slot), str_out, len);
+  if (strcmp(str_out, str) != 0) {
+    put_msg(FATAL,
+            "test_page_slots fails: (read: \"%s\", should be \"%s\")\n",
+            str_out, str);
+    put_pager_info(FATAL, "After page_get_str_at");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void test_page_slots(char const* fname) {
+  put_msg(INFO, "test_page_slots() ...\n");
+  remove(fname); /* start with an empty page */
+  pager_init();
+
+  page_p pg = get_page(fname, 0);
+  if (!pg) {
+    put_msg(FATAL, "get_page 0 fails\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* fill the page */
+  int num_slots = 0;
+  while (page_add_slot(pg, strs_in[num_slots % NUM_RECORDS_IN_BLOCK],
+                       strlen(strs_in[num_slots % NUM_RECORDS_IN_BLOCK]) + 1) >= 0)
+    num_slots++;
+
+  /* free every other slot, then the space is reused after compaction,
+     and the remaining records keep their slots */
+  for (int i = 0; i < num_slots; i += 2)
+    page_free_slot(pg, i);
+  if (page_slot_pos(pg, 0) != 0) {
+    put_msg(FATAL, "test_page_slots fails: slot 0 not freed\n");
+    exit(EXIT_FAILURE);
+  }
+  char const* longer = "a considerably longer char string";
+  if (!page_resize_slot(pg, 1, longer, strlen(longer) + 1)) {
+    put_msg(FATAL, "test_page_slots fails: cannot resize slot 1\n");
+    exit(EXIT_FAILURE);
+  }
+  int slot = page_add_slot(pg, strs_in[0], strlen(strs_in[0]) + 1);
+  if (slot != num_slots) {
+    put_msg(FATAL, "test_page_slots fails: new slot %d, should be %d\n",
+            slot, num_slots);
+    exit(EXIT_FAILURE);
+  }
+  unpin(pg);
+  pager_terminate();
+
+  /* read back from disk */
+  pager_init();
+  pg = get_page(fname, 0);
+  check_slot(pg, 1, longer);
+  for (int i = 3; i < num_slots; i += 2)
+    check_slot(pg, i, strs_in[i % NUM_RECORDS_IN_BLOCK]);
+  check_slot(pg, num_slots, strs_in[0]);
+  unpin(pg);
+
+  put_pager_profiler_info(INFO);
+  pager_terminate();
+  put_msg(INFO, "test_page_slots() succeeds.\n");
+}
@@ -7,5 +7,6 @@ extern void test_page_write(char const* fname);
 extern void test_page_read(char const* fname);
 extern void test_page_write_with_offset(char const* fname);
 extern void test_page_read_with_offset(char const* fname);
+extern void test_page_slots(char const* fname);
 
 #endif
@@ -10,8 +10,7 @@
 record in_recs[NUM_RECORDS];
 
 
-void test_tbl_write(char const* tbl_name) {
-  put_msg(INFO, "test_tbl_write (\"%s\") ...\n", tbl_name);
+static void write_tbl(char const* tbl_name, tbl_layout layout) {
 
   open_db();
   /* put_pager_info(DEBUG, "After open_db"); */
@@ -20,6 +19,7 @@ void test_tbl_write(char const* tbl_name) {
   char *attrs[] = {strcat(id_attr, tbl_name), strcat(str_attr,tbl_name), "Int"};
   int attr_types[] = {INT_TYPE, STR_TYPE, INT_TYPE};
   schema_p sch = create_test_schema(tbl_name, 3, attrs, attr_types);
+  set_schema_layout(sch, layout);
 
   test_data_gen(sch, in_recs, NUM_RECORDS);
 
@@ -35,9 +35,26 @@ void test_tbl_write(char const* tbl_name) {
   /* put_pager_info(DEBUG, "After close_db"); */
 
   put_pager_profiler_info(INFO);
+}
+
+void test_tbl_write(char const* tbl_name) {
+  put_msg(INFO, "test_tbl_write (\"%s\") ...\n", tbl_name);
+  write_tbl(tbl_name, ROW_LAYOUT);
   put_msg(INFO,  "test_tbl_write() done.\n\n");
 }
 
+void test_tbl_write_pax(char const* tbl_name) {
+  put_msg(INFO, "test_tbl_write_pax (\"%s\") ...\n", tbl_name);
+  write_tbl(tbl_name, PAX_LAYOUT);
+  put_msg(INFO,  "test_tbl_write_pax() done.\n\n");
+}
+
+void test_tbl_write_columnar(char const* tbl_name) {
+  put_msg(INFO, "test_tbl_write_columnar (\"%s\") ...\n", tbl_name);
+  write_tbl(tbl_name, COL_LAYOUT);
+  put_msg(INFO,  "test_tbl_write_columnar() done.\n\n");
+}
+
 void test_tbl_read(char const* tbl_name) {
   put_msg(INFO,  "test_tbl_read (\"%s\") ...\n", tbl_name);
 
@@ -77,6 +94,115 @@ void test_tbl_read(char const* tbl_name) {
 
 }
 
+#define NUM_SEARCH_RECORDS 300
+
+/* whether x op val holds, for the comparison operators of table_search() */
+static int cmp_holds(char const* op, int x, int val) {
+  if (strcmp(op, "=") == 0)  return x == val;
+  if (strcmp(op, "<") == 0)  return x < val;
+  if (strcmp(op, "<=") == 0) return x <= val;
+  if (strcmp(op, ">") == 0)  return x > val;
+  if (strcmp(op, ">=") == 0) return x >= val;
+  return x != val;
+}
+
+void test_tbl_search(char const* tbl_name, tbl_layout layout) {
+  put_msg(INFO, "test_tbl_search (\"%s\") ...\n", tbl_name);
+
+  open_db();
+
+  char id_attr[11] = "Id", str_attr[11] = "Str";
+  char *attrs[] = {strcat(id_attr, tbl_name), strcat(str_attr,tbl_name), "Int"};
+  int attr_types[] = {INT_TYPE, STR_TYPE, INT_TYPE};
+  schema_p sch = create_test_schema(tbl_name, 3, attrs, attr_types);
+  set_schema_layout(sch, layout);
+
+  record recs[NUM_SEARCH_RECORDS];
+  test_data_gen(sch, recs, NUM_SEARCH_RECORDS);
+  for (size_t rec_n = 0; rec_n < NUM_SEARCH_RECORDS; rec_n++)
+    append_record(recs[rec_n], sch);
+  /* the random int is searched with its indexes, = with the hash index,
+     and = and != on the id with its bitmap index. A linear search
+     with = skips blocks by the Bloom filters of the random int. */
+  create_index(get_table(tbl_name), "Int", BTREE_INDEX);
+  create_index(get_table(tbl_name), "Int", HASH_INDEX);
+  create_index(get_table(tbl_name), attrs[0], BITMAP_INDEX);
+  create_index(get_table(tbl_name), "Int", BLOOM_FILTER);
+  close_db();
+
+  /* search the table as it is read back, with its access structures */
+  open_db();
+  sch = get_schema(tbl_name);
+  tbl_p tbl = get_table(tbl_name);
+
+  char const* ops[] = {"=", "<", "<=", ">", ">=", "!="};
+  int vals[] = {-1, 0, 37, NUM_SEARCH_RECORDS / 2, NUM_SEARCH_RECORDS - 1,
+                NUM_SEARCH_RECORDS};
+  int flds[] = {0, 2}; /* the sorted id and the random int */
+  record out_rec = new_record(sch);
+  for (size_t j = 0; j < 2; j++)
+    for (size_t k = 0; k < 6; k++)
+      for (size_t v = 0; v < 6; v++) {
+        int expected = 0;
+        for (size_t rec_n = 0; rec_n < NUM_SEARCH_RECORDS; rec_n++)
+          expected += cmp_holds(ops[k], *(int *)recs[rec_n][flds[j]], vals[v]);
+
+        for (search_method m = SEARCH_AUTO; m <= SEARCH_LINEAR; m++) {
+          set_search_method(m);
+          tbl_p res = table_search(tbl, attrs[flds[j]], ops[k], vals[v]);
+          int rec_n = 0;
+          set_tbl_position(res, TBL_BEG);
+          while (get_record(out_rec, table_schema(res))) {
+            if (!cmp_holds(ops[k], *(int *)out_rec[flds[j]], vals[v]))
+              break;
+            rec_n++;
+          }
+          remove_table(res);
+          if (rec_n != expected) {
+            put_msg(FATAL, "test_tbl_search: %s %s %d found %d records, should be %d"
+                    " (search method %d)\n",
+                    attrs[flds[j]], ops[k], vals[v], rec_n, expected, m);
+            exit(EXIT_FAILURE);
+          }
+        }
+      }
+  set_search_method(SEARCH_AUTO);
+  release_record(out_rec, sch);
+
+  /* ten str[49] fields fit in a page as columns, but not as rows with
+     their references */
+  for (tbl_layout layout = ROW_LAYOUT; layout <= PAX_LAYOUT; layout++) {
+    schema_p wide = new_schema(layout == ROW_LAYOUT ? "WideRow" : "WidePax");
+    set_schema_layout(wide, layout);
+    char wide_str[49], wide_name[8];
+    int num_fields = 0;
+    for (int i = 0; i < 10; i++) {
+      sprintf(wide_name, "W%d", i);
+      if (add_field(wide, new_str_field(wide_name, sizeof wide_str)))
+        num_fields++;
+    }
+    if (num_fields != (layout == ROW_LAYOUT ? 9 : 10)) {
+      put_msg(FATAL, "test_tbl_search: layout %d takes %d str[49] fields\n",
+              layout, num_fields);
+      exit(EXIT_FAILURE);
+    }
+    memset(wide_str, 'w', sizeof wide_str - 1);
+    wide_str[sizeof wide_str - 1] = '\0';
+    record wide_rec = new_record(wide);
+    for (int i = 0; i < num_fields; i++)
+      assign_str_field(wide_rec[i], wide_str);
+    append_record(wide_rec, wide);
+    release_record(wide_rec, wide);
+    remove_table(get_table(schema_name(wide)));
+  }
+  for (size_t i = 0; i < NUM_SEARCH_RECORDS; i++)
+    release_record(recs[i], sch);
+
+  put_pager_profiler_info(INFO);
+  close_db();
+  put_msg(INFO,  "test_tbl_search() succeeds.\n");
+}
+
 void test_tbl_natural_join(char const* my_tbl, char const* yr_tbl) {
   put_msg(INFO, "test_tbl_natural_join (\"%s\", \"%s\") ...\n", my_tbl, yr_tbl);
 
@@ -94,6 +220,405 @@ void test_tbl_natural_join(char const* my_tbl, char const* yr_tbl) {
 
   table_display(tbl_o);
 
+  /* the plan streams the same records as the joined table holds, also
+     when it looks up the right records with an index */
+  create_index(tbl_y, "Int", HASH_INDEX);
+  schema_p sch_o = table_schema(tbl_o);
+  record rec = new_record(sch_o), plan_rec = new_record(sch_o);
+  plan_p plan;
+  int num_joined;
+  for (int by_index = 0; by_index < 2; by_index++) {
+    set_join_method(by_index ? JOIN_INDEX_NESTED_LOOP : JOIN_NESTED_LOOP);
+    plan = plan_natural_join(plan_scan(tbl_m, 0, 0, 0),
+                             plan_scan(tbl_y, 0, 0, 0));
+    num_joined = 0;
+    set_tbl_position(tbl_o, TBL_BEG);
+    plan_open(plan);
+    while (plan_next(plan, plan_rec)) {
+      if (get_record(rec, sch_o) != 1 || !equal_record(rec, plan_rec, sch_o)) {
+        put_msg(FATAL, "test_tbl_natural_join: record %d of the plan differs\n",
+                num_joined);
+        exit(EXIT_FAILURE);
+      }
+      num_joined++;
+    }
+    plan_close(plan);
+    if (get_record(rec, sch_o) == 1) {
+      put_msg(FATAL, "test_tbl_natural_join: the plan stops after %d records\n",
+              num_joined);
+      exit(EXIT_FAILURE);
+    }
+    plan_release(plan);
+  }
+
+  /* a hash join may build on either input, and a block nested loop joins
+     chunks of left records, so their records may come in another order.
+     With little memory, the inputs of a hash join go to partitions and the
+     chunks hold a record or two. */
+  for (int k = 0; k < 8; k++) {
+    int build_left = k & 1;
+    join_method m = k & 4 ? JOIN_BLOCK_NESTED_LOOP : JOIN_HASH;
+    set_join_method(m);
+    set_join_mem_budget(k & 2 ? 64 : 1L << 20);
+    plan = build_left
+      ? plan_natural_join(plan_scan(tbl_m, "Int", "=", 3),
+                          plan_scan(tbl_y, 0, 0, 0))
+      : plan_natural_join(plan_scan(tbl_m, 0, 0, 0),
+                          plan_scan(tbl_y, 0, 0, 0));
+    int num_expected = build_left ? table_count(tbl_o, "Int", "=", 3)
+      : num_joined;
+    int n = 0;
+    plan_open(plan);
+    while (plan_next(plan, plan_rec)) {
+      int found = 0;
+      set_tbl_position(tbl_o, TBL_BEG);
+      while (!found && get_record(rec, sch_o) == 1)
+        found = equal_record(rec, plan_rec, sch_o);
+      if (!found) {
+        put_msg(FATAL, "test_tbl_natural_join: record %d of method %d"
+                " is not in the joined table\n", n, m);
+        exit(EXIT_FAILURE);
+      }
+      n++;
+    }
+    plan_close(plan);
+    plan_release(plan);
+    if (n != num_expected) {
+      put_msg(FATAL, "test_tbl_natural_join: method %d gives %d records,"
+              " should be %d\n", m, n, num_expected);
+      exit(EXIT_FAILURE);
+    }
+  }
+  set_join_mem_budget(1L << 20);
+  release_record(plan_rec, sch_o);
+  release_record(rec, sch_o);
+
+  /* inputs sorted on the shared field, with runs of equal keys, are
+     merged in the order of the keys, then of the left and right records */
+  char *merge_attrs[2][2] = {{"K", "A"}, {"K", "B"}};
+  int merge_types[] = {INT_TYPE, INT_TYPE};
+  schema_p sch_l = create_test_schema("MergeL", 2, merge_attrs[0], merge_types);
+  schema_p sch_r = create_test_schema("MergeR", 2, merge_attrs[1], merge_types);
+  set_schema_layout(sch_r, COL_LAYOUT);
+  record rec_l = new_record(sch_l), rec_r = new_record(sch_r);
+  for (int i = 0; i < 3 * NUM_RECORDS; i++) {
+    fill_record(rec_l, sch_l, i / 3, i);
+    append_record(rec_l, sch_l);
+    fill_record(rec_r, sch_r, i / 2 + 5, i);
+    append_record(rec_r, sch_r);
+  }
+  release_record(rec_l, sch_l);
+  release_record(rec_r, sch_r);
+  tbl_p tbl_l = get_table("MergeL"), tbl_r = get_table("MergeR");
+  for (join_method m = JOIN_AUTO; m <= JOIN_MERGE; m++) {
+    if (m == JOIN_HASH)
+      continue; /* builds on the left input here, so the order differs */
+    set_join_method(m);
+    plan = plan_filter(plan_natural_join(plan_scan(tbl_l, 0, 0, 0),
+                                         plan_scan(tbl_r, 0, 0, 0)),
+                       "A", "!=", 40);
+    rec = new_record(plan_schema(plan));
+    plan_open(plan);
+    for (int k = 5; k < NUM_RECORDS; k++)
+      for (int a = 3 * k; a < 3 * k + 3; a++)
+        for (int b = 2 * (k - 5); b < 2 * (k - 5) + 2 && a != 40; b++)
+          if (!plan_next(plan, rec) || *(int *)rec[0] != k
+              || *(int *)rec[1] != a || *(int *)rec[2] != b) {
+            put_msg(FATAL, "test_tbl_natural_join: method %d does not join"
+                    " (%d, %d, %d) in order\n", m, k, a, b);
+            exit(EXIT_FAILURE);
+          }
+    if (plan_next(plan, rec)) {
+      put_msg(FATAL, "test_tbl_natural_join: method %d joins too many"
+              " records\n", m);
+      exit(EXIT_FAILURE);
+    }
+    plan_close(plan);
+    release_record(rec, plan_schema(plan));
+    plan_release(plan);
+  }
+  set_join_method(JOIN_AUTO);
+  remove_table(tbl_l);
+  remove_table(tbl_r);
+
+  /* a columnar table of many blocks is read record by record when its
+     records are looked up, by a nested loop, its index or in a chain,
+     while the scans of the other tables keep their pages */
+  char *col_attrs[3][2] = {{"K", "A"}, {"K", "M"}, {"M", "C"}};
+  int col_sizes[] = {100, 2000, 300};
+  char const* col_names[] = {"ColR", "ColS", "ColT"};
+  tbl_p col_tbls[3];
+  for (int t = 0; t < 3; t++) {
+    schema_p sch = create_test_schema(col_names[t], 2, col_attrs[t],
+                                      merge_types);
+    if (t == 1)
+      set_schema_layout(sch, COL_LAYOUT);
+    rec = new_record(sch);
+    for (int i = 0; i < col_sizes[t]; i++) {
+      fill_record(rec, sch, t == 1 ? i % 50 : t == 2 ? 7 * i : i, i);
+      append_record(rec, sch);
+    }
+    release_record(rec, sch);
+    col_tbls[t] = get_table(col_names[t]);
+  }
+  create_index(col_tbls[1], "K", HASH_INDEX);
+  create_index(col_tbls[0], "K", HASH_INDEX);
+  int col_expected[3] = {0, 0, 0};
+  for (int j = 0; j < col_sizes[1]; j++)
+    if (j % 50 < col_sizes[0]) {
+      col_expected[0]++;
+      col_expected[1] += j % 7 == 0 && j / 7 < col_sizes[2];
+      col_expected[2] += j % 50 < 10;
+    }
+  join_method col_methods[] = {JOIN_NESTED_LOOP, JOIN_INDEX_NESTED_LOOP,
+                               JOIN_AUTO};
+  for (int k = 0; k < 3; k++) {
+    set_join_method(col_methods[k]);
+    plan_p col_plans[3] = {
+      plan_natural_join(plan_scan(col_tbls[0], 0, 0, 0),
+                        plan_scan(col_tbls[1], 0, 0, 0)),
+      plan_natural_join(plan_natural_join(plan_scan(col_tbls[0], 0, 0, 0),
+                                          plan_scan(col_tbls[1], 0, 0, 0)),
+                        plan_scan(col_tbls[2], 0, 0, 0)),
+      plan_filter(plan_natural_join(plan_scan(col_tbls[1], 0, 0, 0),
+                                    plan_scan(col_tbls[0], 0, 0, 0)),
+                  "K", "<", 10)};
+    for (int p = 0; p < 3; p++) {
+      int n = plan_count(col_plans[p]);
+      plan_release(col_plans[p]);
+      if (n != col_expected[p]) {
+        put_msg(FATAL, "test_tbl_natural_join: method %d joins %d records"
+                " over a columnar table in join %d, should be %d\n",
+                col_methods[k], n, p, col_expected[p]);
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  /* for a few left records, the automatic choice looks up the columnar
+     right table with its index, as the index nested loop does, where a
+     value is in few right records, and reads it all for a hash join where
+     a value is in many */
+  create_index(col_tbls[1], "M", HASH_INDEX);
+  join_method few_methods[] = {JOIN_AUTO, JOIN_INDEX_NESTED_LOOP, JOIN_HASH};
+  for (int many = 0; many < 2; many++) {
+    int few_reads[3], few_joined[3];
+    for (int k = 0; k < 3; k++) {
+      set_join_method(few_methods[k]);
+      plan = plan_natural_join(many ? plan_scan(col_tbls[0], "A", "<", 3)
+                               : plan_scan(col_tbls[2], "C", "<", 3),
+                               plan_scan(col_tbls[1], 0, 0, 0));
+      pager_profiler_reset();
+      few_joined[k] = plan_count(plan);
+      few_reads[k] = pager_profiler_reads();
+      plan_release(plan);
+    }
+    if (few_joined[0] != (many ? 3 * col_sizes[1] / 50 : 3)
+        || few_joined[1] != few_joined[0] || few_joined[2] != few_joined[0]
+        || few_reads[0] >= few_reads[many ? 1 : 2]) {
+      put_msg(FATAL, "test_tbl_natural_join: the automatic choice joins %d"
+              " records of a columnar table with %d reads, the index nested"
+              " loop %d with %d reads, the hash join %d with %d reads\n",
+              few_joined[0], few_reads[0], few_joined[1], few_reads[1],
+              few_joined[2], few_reads[2]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  set_join_method(JOIN_AUTO);
+  for (int t = 0; t < 3; t++)
+    remove_table(col_tbls[t]);
+
+  /* the records join on all the shared fields, here a str field of
+     different lengths and an int field in another order */
+  char *keys_attrs[] = {"S", "K", "A"};
+  int keys_types[] = {STR_TYPE, INT_TYPE, INT_TYPE};
+  sch_l = create_test_schema("KeysL", 3, keys_attrs, keys_types);
+  sch_r = new_schema("KeysR");
+  add_field(sch_r, new_int_field("K"));
+  add_field(sch_r, new_str_field("S", 12));
+  add_field(sch_r, new_int_field("B"));
+  char const* strs[] = {"s0", "s1", "s2", "s3"};
+  rec_l = new_record(sch_l);
+  rec_r = new_record(sch_r);
+  int num_expected = 0;
+  for (int i = 0; i < 3 * NUM_RECORDS; i++) {
+    fill_record(rec_l, sch_l, strs[i % 3], i % 7, i);
+    append_record(rec_l, sch_l);
+    fill_record(rec_r, sch_r, i % 7, strs[i % 4], i);
+    append_record(rec_r, sch_r);
+    for (int j = 0; j < 3 * NUM_RECORDS; j++)
+      num_expected += i % 7 == j % 7 && i % 3 == j % 4;
+  }
+  release_record(rec_l, sch_l);
+  release_record(rec_r, sch_r);
+  tbl_l = get_table("KeysL");
+  tbl_r = get_table("KeysR");
+  for (int k = 0; k <= JOIN_INDEX_NESTED_LOOP + 1; k++) {
+    join_method m = k > JOIN_INDEX_NESTED_LOOP ? JOIN_HASH : k;
+    set_join_method(m);
+    set_join_mem_budget(k > JOIN_INDEX_NESTED_LOOP ? 64 : 1L << 20);
+    plan = plan_natural_join(plan_scan(tbl_l, 0, 0, 0),
+                             plan_scan(tbl_r, 0, 0, 0));
+    rec = new_record(plan_schema(plan));
+    int n = 0;
+    plan_open(plan);
+    while (plan_next(plan, rec)) {
+      int a = *(int *)rec[2], b = *(int *)rec[3];
+      if (a % 7 != b % 7 || a % 3 != b % 4 || *(int *)rec[1] != a % 7
+          || strcmp(rec[0], strs[a % 3]) != 0) {
+        put_msg(FATAL, "test_tbl_natural_join: method %d joins %d and %d\n",
+                m, a, b);
+        exit(EXIT_FAILURE);
+      }
+      n++;
+    }
+    plan_close(plan);
+    release_record(rec, plan_schema(plan));
+    plan_release(plan);
+    if (n != num_expected) {
+      put_msg(FATAL, "test_tbl_natural_join: method %d gives %d records on"
+              " two fields, should be %d\n", m, n, num_expected);
+      exit(EXIT_FAILURE);
+    }
+  }
+  set_join_method(JOIN_AUTO);
+  set_join_mem_budget(1L << 20);
+  remove_table(tbl_l);
+  remove_table(tbl_r);
+
+  /* a chain of joins gives the records of the joins in the order written,
+     with the fields in that order, whichever order and join methods it
+     takes, also with a columnar table looked up by its indexes */
+  char *chain_attrs[3][2] = {{"A", "K"}, {"K", "M"}, {"M", "C"}};
+  int chain_types[] = {INT_TYPE, INT_TYPE};
+  int chain_sizes[] = {3 * NUM_RECORDS, 40 * NUM_RECORDS, 2 * NUM_RECORDS};
+  char const* chain_names[] = {"ChainA", "ChainB", "ChainC"};
+  tbl_p chain[3];
+  for (int t = 0; t < 3; t++) {
+    schema_p sch = create_test_schema(chain_names[t], 2, chain_attrs[t],
+                                      chain_types);
+    if (t == 1)
+      set_schema_layout(sch, COL_LAYOUT);
+    rec = new_record(sch);
+    for (int i = 0; i < chain_sizes[t]; i++) {
+      /* the records of a K of the columnar table are in all its blocks */
+      if (t == 1)
+        fill_record(rec, sch, i % 7, i % 7 % 5);
+      else
+        fill_record(rec, sch, t == 2 ? i % 5 : i, t == 0 ? i % 7 : i % 5);
+      append_record(rec, sch);
+    }
+    release_record(rec, sch);
+    chain[t] = get_table(chain_names[t]);
+  }
+  create_index(chain[1], "K", HASH_INDEX);
+  create_index(chain[1], "M", HASH_INDEX);
+  join_method chain_methods[] = {JOIN_AUTO, JOIN_NESTED_LOOP,
+                                 JOIN_INDEX_NESTED_LOOP};
+  for (int v = -1; v < 7; v += 3) {
+    char const* attr = v < 0 ? 0 : "K";
+    set_join_method(JOIN_HASH);
+    plan = plan_natural_join(plan_natural_join(plan_scan(chain[0], 0, 0, 0),
+                                               plan_scan(chain[1], 0, 0, 0)),
+                             plan_scan(chain[2], 0, 0, 0));
+    if (attr)
+      plan = plan_filter(plan, attr, "=", v);
+    int num_expected = plan_count(plan);
+    plan_release(plan);
+    tbl_p orders[][3] = {{chain[0], chain[1], chain[2]},
+                         {chain[2], chain[0], chain[1]}};
+    /* positions of A, K, M and C in the records of the orders */
+    int pos[2][4] = {{0, 1, 2, 3}, {2, 3, 0, 1}};
+    for (int j = 0; j < 3; j++) {
+      set_join_method(chain_methods[j]);
+      for (int o = 0; o < 2; o++) {
+        plan = plan_natural_joins(3, orders[o], attr, "=", v);
+        rec = new_record(plan_schema(plan));
+        int n = 0;
+        plan_open(plan);
+        while (plan_next(plan, rec)) {
+          int a = *(int *)rec[pos[o][0]], k = *(int *)rec[pos[o][1]];
+          int m = *(int *)rec[pos[o][2]], c = *(int *)rec[pos[o][3]];
+          if (k != a % 7 || m != k % 5 || m != c % 5 || (attr && k != v)) {
+            put_msg(FATAL, "test_tbl_natural_join: the chain %d joins"
+                    " (%d, %d, %d, %d)\n", o, a, k, m, c);
+            exit(EXIT_FAILURE);
+          }
+          n++;
+        }
+        plan_close(plan);
+        release_record(rec, plan_schema(plan));
+        plan_release(plan);
+        if (n != num_expected) {
+          put_msg(FATAL, "test_tbl_natural_join: the chain %d with K = %d"
+                  " and method %d gives %d records, should be %d\n",
+                  o, v, chain_methods[j], n, num_expected);
+          exit(EXIT_FAILURE);
+        }
+      }
+    }
+  }
+  set_join_method(JOIN_AUTO);
+  for (int t = 0; t < 3; t++)
+    remove_table(chain[t]);
+
+  /* written with the large tables first, the chain is cheaper from the
+     small table, which looks up the middle one with its index */
+  int big_sizes[] = {2000, 2000, 3};
+  for (int t = 0; t < 3; t++) {
+    schema_p sch = create_test_schema(chain_names[t], 2, chain_attrs[t],
+                                      chain_types);
+    rec = new_record(sch);
+    for (int i = 0; i < big_sizes[t]; i++) {
+      fill_record(rec, sch, i, t == 1 ? i % 500 : i);
+      append_record(rec, sch);
+    }
+    release_record(rec, sch);
+    chain[t] = get_table(chain_names[t]);
+  }
+  create_index(chain[1], "M", HASH_INDEX);
+  pager_profiler_reset();
+  plan = plan_natural_joins(3, chain, 0, 0, 0);
+  int n_cheap = plan_count(plan), reads_cheap = pager_profiler_reads();
+  plan_release(plan);
+  pager_profiler_reset();
+  plan = plan_natural_join(plan_natural_join(plan_scan(chain[0], 0, 0, 0),
+                                             plan_scan(chain[1], 0, 0, 0)),
+                           plan_scan(chain[2], 0, 0, 0));
+  int n_written = plan_count(plan), reads_written = pager_profiler_reads();
+  plan_release(plan);
+  if (n_cheap != n_written || reads_cheap >= reads_written) {
+    put_msg(FATAL, "test_tbl_natural_join: the chain joins %d records with"
+            " %d reads, as written %d records with %d reads\n",
+            n_cheap, reads_cheap, n_written, reads_written);
+    exit(EXIT_FAILURE);
+  }
+  for (int t = 0; t < 3; t++)
+    remove_table(chain[t]);
+
+  /* a condition pushed below the join keeps the records of the search
+     of the joined table: on the left ids, the shared int and the right ids */
+  char id_m[11] = "Id", id_y[11] = "Id";
+  char *where_attrs[] = {strcat(id_m, my_tbl), "Int", strcat(id_y, yr_tbl)};
+  char const* ops[] = {"<", "=", ">="};
+  for (join_method m = JOIN_NESTED_LOOP; m <= JOIN_INDEX_NESTED_LOOP; m++) {
+    set_join_method(m);
+    for (size_t j = 0; j < 3; j++)
+      for (int v = 0; v < 30; v += 6) {
+        plan = plan_filter(plan_natural_join(plan_scan(tbl_m, 0, 0, 0),
+                                             plan_scan(tbl_y, 0, 0, 0)),
+                           where_attrs[j], ops[j], v);
+        int n = plan_count(plan);
+        plan_release(plan);
+        if (n != table_count(tbl_o, where_attrs[j], ops[j], v)) {
+          put_msg(FATAL, "test_tbl_natural_join: %s %s %d joined %d records,"
+                  " should be %d\n", where_attrs[j], ops[j], v, n,
+                  table_count(tbl_o, where_attrs[j], ops[j], v));
+          exit(EXIT_FAILURE);
+        }
+      }
+  }
+  set_join_method(JOIN_AUTO);
 
   put_db_info(DEBUG);
   remove_table(tbl_o);
@@ -103,3 +628,116 @@ void test_tbl_natural_join(char const* my_tbl, char const* yr_tbl) {
   put_pager_profiler_info(INFO);
   put_msg(INFO,  "test_tbl_natural_join() done.\n\n");
 }
+
+void test_tbl_update_delete(char const* tbl_name) {
+  put_msg(INFO, "test_tbl_update_delete (\"%s\") ...\n", tbl_name);
+
+  open_db();
+
+  char id_attr[11] = "Id", str_attr[11] = "Str";
+  char *attrs[] = {strcat(id_attr, tbl_name), strcat(str_attr,tbl_name), "Int"};
+  int attr_types[] = {INT_TYPE, STR_TYPE, INT_TYPE};
+  schema_p sch = create_test_schema(tbl_name, 3, attrs, attr_types);
+  tbl_p tbl = get_table(tbl_name);
+  /* the indexes have to follow the records that move or go away */
+  create_index(tbl, "Int", BTREE_INDEX);
+  create_index(tbl, "Int", HASH_INDEX);
+  create_index(tbl, id_attr, BITMAP_INDEX);
+  create_index(tbl, "Int", BLOOM_FILTER);
+
+  record recs[NUM_RECORDS];
+  test_data_gen(sch, recs, NUM_RECORDS);
+  for (size_t rec_n = 0; rec_n < NUM_RECORDS; rec_n++)
+    append_record(recs[rec_n], sch);
+
+  /* longer values, so that some records have to move */
+  char const* new_str = "A_much_longer_value";
+  int num_updated = table_update(tbl, str_attr, new_str, id_attr, "<", 8);
+  int num_deleted = table_delete(tbl, id_attr, ">=", NUM_RECORDS - 4);
+  if (num_updated != 8 || num_deleted != 4) {
+    put_msg(FATAL, "test_tbl_update_delete: %d updated, %d deleted, should be 8 and 4\n",
+            num_updated, num_deleted);
+    exit(EXIT_FAILURE);
+  }
+  for (size_t rec_n = 0; rec_n < 8; rec_n++)
+    assign_str_field(recs[rec_n][1], new_str);
+
+  /* records may have moved, so check them by id */
+  record out_rec = new_record(sch);
+  int rec_n = 0;
+  set_tbl_position(tbl, TBL_BEG);
+  while (get_record(out_rec, sch)) {
+    int id = *(int *)out_rec[0];
+    if (id >= NUM_RECORDS - 4 || !equal_record(out_rec, recs[id], sch)) {
+      put_msg(FATAL, "test_tbl_update_delete:\n");
+      put_record_info(FATAL, out_rec, sch);
+      exit(EXIT_FAILURE);
+    }
+    rec_n++;
+  }
+  if (rec_n != NUM_RECORDS - 4)
+    put_msg(ERROR, "only %d of %d records read", rec_n, NUM_RECORDS - 4);
+
+  release_record(out_rec, sch);
+  for (size_t i = 0; i < NUM_RECORDS; i++)
+    release_record(recs[i], sch);
+
+  close_db();
+
+  /* the catalog must keep the counts of the changed table */
+  open_db();
+  tbl = get_table(tbl_name);
+  sch = get_schema(tbl_name);
+  out_rec = new_record(sch);
+  rec_n = 0;
+  set_tbl_position(tbl, TBL_BEG);
+  while (get_record(out_rec, sch))
+    rec_n++;
+  if (!tbl || rec_n != NUM_RECORDS - 4) {
+    put_msg(FATAL, "test_tbl_update_delete: %d records after reopening\n", rec_n);
+    exit(EXIT_FAILURE);
+  }
+
+  /* the indexes on the int field find what a scan finds */
+  table_update(tbl, "Int", "-5", id_attr, "<", 3);
+  char const* ops[] = {"<=", "="};
+  for (int v = -5; v < 100; v += 7)
+    for (size_t k = 0; k < 2; k++) {
+      int counts[2];
+      for (int i = 0; i < 2; i++) {
+        set_search_method(i ? SEARCH_LINEAR : SEARCH_AUTO);
+        tbl_p res = table_search(tbl, "Int", ops[k], v);
+        counts[i] = 0;
+        set_tbl_position(res, TBL_BEG);
+        while (get_record(out_rec, table_schema(res)))
+          counts[i]++;
+        remove_table(res);
+      }
+      if (counts[0] != counts[1]) {
+        put_msg(FATAL, "test_tbl_update_delete: Int %s %d found %d records"
+                " with the indexes, %d without\n", ops[k], v, counts[0], counts[1]);
+        exit(EXIT_FAILURE);
+      }
+    }
+
+  /* counting with the bitmaps of the ids */
+  char const* count_ops[] = {"=", "!=", ">="};
+  for (int v = 0; v < NUM_RECORDS; v += 3)
+    for (size_t k = 0; k < 3; k++) {
+      set_search_method(SEARCH_AUTO);
+      int n = table_count(tbl, id_attr, count_ops[k], v);
+      set_search_method(SEARCH_LINEAR);
+      if (n != table_count(tbl, id_attr, count_ops[k], v)) {
+        put_msg(FATAL, "test_tbl_update_delete: %s %s %d counted %d records"
+                " with the bitmaps, %d without\n", id_attr, count_ops[k], v, n,
+                table_count(tbl, id_attr, count_ops[k], v));
+        exit(EXIT_FAILURE);
+      }
+    }
+  set_search_method(SEARCH_AUTO);
+  release_record(out_rec, sch);
+  close_db();
+
+  put_pager_profiler_info(INFO);
+  put_msg(INFO,  "test_tbl_update_delete() succeeds.\n");
+}
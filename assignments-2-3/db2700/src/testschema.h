@@ -4,7 +4,11 @@
 #include "schema.h"
 
 extern void test_tbl_write(char const* tbl_name);
+extern void test_tbl_write_pax(char const* tbl_name);
+extern void test_tbl_write_columnar(char const* tbl_name);
 extern void test_tbl_read(char const* tbl_name);
+extern void test_tbl_update_delete(char const* tbl_name);
+extern void test_tbl_search(char const* tbl_name, tbl_layout layout);
 extern void test_tbl_natural_join(char const* my_tbl, char const* yr_tbl);
 
 #endif